@@ -1,7 +1,14 @@
 set ShadersIn=%1\shaders
 set ShadersOut=%2\shaders
 
+rem Shaders are compiled to lists of words that src\render\shader_code.cpp includes
+
 if not exist %ShadersOut% mkdir %ShadersOut%
 
-%VULKAN_SDK%\Bin\glslc.exe shaders\shader.vert -o %ShadersOut%\vert.spv
-%VULKAN_SDK%\Bin\glslc.exe shaders\shader.frag -o %ShadersOut%\frag.spv
\ No newline at end of file
+%VULKAN_SDK%\Bin\glslc.exe shaders\shader.vert -mfmt=num -o %ShadersOut%\vert.spv.inc
+%VULKAN_SDK%\Bin\glslc.exe shaders\shader.frag -mfmt=num -o %ShadersOut%\frag.spv.inc
+%VULKAN_SDK%\Bin\glslc.exe shaders\instanced.vert -mfmt=num -o %ShadersOut%\instanced_vert.spv.inc
+%VULKAN_SDK%\Bin\glslc.exe shaders\compact.comp -mfmt=num -o %ShadersOut%\compact_comp.spv.inc
+%VULKAN_SDK%\Bin\glslc.exe shaders\raycast.vert -mfmt=num -o %ShadersOut%\raycast_vert.spv.inc
+%VULKAN_SDK%\Bin\glslc.exe shaders\raycast.frag -mfmt=num -o %ShadersOut%\raycast_frag.spv.inc
+%VULKAN_SDK%\Bin\glslc.exe shaders\density.vert -mfmt=num -o %ShadersOut%\density_vert.spv.inc
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include <map>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "audio_config.h"
@@ -13,6 +14,9 @@ namespace tomway
 {
     enum class channel_group { MUSIC, SFX };
     
+    // Opening the audio device can take a while, so it happens on a thread of its own while the rest of the engine
+    // starts up. Anything that plays or mixes waits for it to finish. Loading and streaming only decode, they can be
+    // called from any thread before the device is ready.
     class audio_system
     {
     public:
@@ -43,6 +47,7 @@ namespace tomway
         std::map<channel, float> _channel_volumes;
         std::map<channel_group, std::vector<channel>> _group_channels;
         std::map<channel_group, float> _group_volumes;
+        std::thread _init_thread;
         SoLoud::Soloud _soloud;
     };
 }
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <thread>
+
+#include "tomway_utility.h"
+
+namespace tomway
+{
+    // Runs one piece of work on its own thread and lets the main loop poll it for progress, so long loads and saves
+    // don't stall rendering. A job can be started again once the previous one has been finished.
+    class background_job
+    {
+    public:
+        using work_fn = std::function<bool(progress_fn const&)>;
+
+        background_job() = default;
+        ~background_job();
+        background_job(background_job&) = delete;
+        background_job(background_job&&) = delete;
+        background_job& operator=(background_job const&) = delete;
+        background_job& operator=(background_job const&&) = delete;
+
+        // Joins the worker and returns what the work returned. Blocks until the work is done if it isn't yet.
+        bool finish();
+        float get_progress() const;
+        bool is_done() const;
+        // True from start until finish, including after the work is done
+        bool is_running() const;
+        // Fails if a job is already running or hasn't been finished
+        bool start(work_fn work);
+    private:
+        std::atomic<bool> _done = { false };
+        std::atomic<float> _progress = { 0.0f };
+        bool _result = false;
+        std::thread _thread;
+    };
+}
@@ -1,8 +1,13 @@
 #pragma once
+#include <chrono>
+#include <memory>
+
+#include "background_job.h"
 #include "camera_controller.h"
 #include "time_system.h"
 #include "ui_system.h"
 #include "window_system.h"
+#include "worker_pool.h"
 #include "audio/audio_system.h"
 #include "input/input_system.h"
 #include "render/cell_geometry.h"
@@ -14,7 +19,11 @@ namespace tomway
     class engine
     {
     public:
-        engine(size_t const& grid_size);
+        engine(
+            size_t const& grid_size,
+            simulation_backend_config const& backend_config = {},
+            render_mode renderer = render_mode::INSTANCED,
+            frame_pacing_config const& frame_pacing = {});
         ~engine() = default;
         engine(engine&) = delete;
         engine(engine&&) = delete;
@@ -25,20 +34,38 @@ namespace tomway
     private:
         static std::string _get_file_location();
 
+        void _finish_load(bool success);
         void _load_file();
+        void _open_replay();
         void _load_perf();
+        void _pace_frame(bool active);
         void _load_sim();
+        void _paste_file();
         void _reset_sim();
-        void _save_sim() const;
+        void _save_sim();
+        void _start_asset_job();
         void _start_sim();
+        void _step_replay();
         void _step_sim();
+        void _toggle_recording();
+        void _update_job();
         
+        // Startup is timed from here to the first presented frame
+        std::chrono::steady_clock::time_point const _start_time = std::chrono::steady_clock::now();
         simulation_system _simulation_system;	
-        cell_geometry _cell_geometry_generator;
+        // Shared by everything that splits per frame or per generation work across threads
+        worker_pool _worker_pool;
+        cell_geometry _cell_geometry_generator { _worker_pool };
         window_system _window_system = { 1024, 768 };
         audio_system _audio_system;
 	    ui_system _ui_system { _window_system };
-        render_system _render_system { _window_system, _cell_geometry_generator };
+        audio _button_audio;
+        audio _iteration_audio;
+        audio _music_audio;
+        // Sounds are decoded while the audio device opens and the renderer creates its device and pipelines
+        background_job _asset_job;
+        // Created in the constructor once the asset job has started, so that the two overlap
+        std::unique_ptr<render_system> _render_system;
         input_system _input_system;
         time_system _time_system { 5 };
 	    camera_controller _camera_controller;
@@ -54,9 +81,10 @@ namespace tomway
         bool _start = false;
         std::string _load_path;
         size_t _new_grid_size = 0;
-        audio _button_audio;
-        audio _iteration_audio;
-        audio _music_audio;
+        bool _first_frame_drawn = false;
+        frame_pacing_config _frame_pacing;
+        // Frames in a row where nothing happened
+        size_t _quiet_frames = 0;
         channel _music_channel;
     };
 }
@@ -26,6 +26,11 @@ namespace tomway {
 		F1,
 		F2,
 		F3,
+		F4,
+		F5,
+		F6,
+		F7,
+		F8,
 	};
 
 	struct input_event
@@ -25,6 +25,8 @@ namespace tomway
         input_system& operator=(input_system const&) = delete;
         input_system& operator=(input_system const&&) = delete;
         
+        // Any button held, held keys move the camera without sending events
+        static bool any_btn_down();
         static bool btn_down(input_button btn);
         static bool btn_just_down(input_button btn);
         static bool btn_just_up(input_button btn);
@@ -52,6 +54,11 @@ namespace tomway
             { input_button::F1, {}},
             { input_button::F2, {}},
             { input_button::F3, {}},
+            { input_button::F4, {}},
+            { input_button::F5, {}},
+            { input_button::F6, {}},
+            { input_button::F7, {}},
+            { input_button::F8, {}},
         };
     };
 }
\ No newline at end of file
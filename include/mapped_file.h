@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace tomway
+{
+    // Read-only memory mapping of a whole file. Pages are only read from disk when they are touched.
+    class mapped_file
+    {
+    public:
+        mapped_file() = default;
+        ~mapped_file();
+        mapped_file(mapped_file&) = delete;
+        mapped_file(mapped_file&&) = delete;
+        mapped_file& operator=(mapped_file const&) = delete;
+        mapped_file& operator=(mapped_file const&&) = delete;
+
+        void close();
+        uint8_t const* get_data() const;
+        size_t get_size() const;
+        bool open(std::string const& path);
+    private:
+        uint8_t const* _data = nullptr;
+        size_t _size = 0;
+#ifdef _WIN32
+        void* _file = nullptr;
+        void* _mapping = nullptr;
+#endif
+    };
+}
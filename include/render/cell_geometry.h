@@ -1,6 +1,12 @@
 #pragma once
-#include "simulation/cell_container.h"
+#include <array>
+
+#include "simulation/simulation_backend.h"
 #include "vertex.h"
+#include "worker_pool.h"
+#include "render/cell_slots.h"
+#include "render/cell_tile.h"
+#include "render/density_pyramid.h"
 #include "render/vertex_chunk.h"
 
 namespace tomway
@@ -8,32 +14,101 @@ namespace tomway
     class cell_geometry
     {
     public:
-        cell_geometry();
+        static unsigned int constexpr BACKGROUND_VERT_COUNT = 6;
+
+        explicit cell_geometry(worker_pool& workers);
         ~cell_geometry() = default;
         cell_geometry(cell_geometry&) = delete;
         cell_geometry(cell_geometry&&) = delete;
         cell_geometry& operator=(cell_geometry const&) = delete;
         cell_geometry& operator=(cell_geometry const&&) = delete;
         
-        void bind_cells(cell_container const* cells);
-        std::vector<vertex_chunk> get_vertices(size_t max_chunk_alloc_size_bytes);
-        bool is_dirty() const;
+        // Appends a quad for every non-empty block of the tile at the given pyramid level
+        void append_density_quads(cell_tile const& tile, size_t level, std::vector<density_quad>& out);
+        void bind_cells(simulation_backend const* cells, live_cell_list const* live_cells);
+        // The world space quad under the board
+        std::array<vertex, BACKGROUND_VERT_COUNT> get_background_vertices() const;
+        // Bit-packed snapshot of the bound generation. It shares the simulation's storage, so let go of it before the
+        // next step or the step has to copy the board.
+        cell_container get_board() const;
+        // One cell's cube with its corner at the origin, the mesh the instanced path draws for every live cell
+        static std::vector<vertex> const& get_cell_mesh();
+        // Distance between neighbouring cells' corners
+        static float get_cell_spacing();
+        // Width and height of a cell's cube
+        static glm::vec2 get_cell_extent();
+        // Position scale to draw the background vertices with, they span the board in 16 bits whatever its size
+        float get_background_scale() const;
+        // Population counts of the bound generation's blocks, brought up to date on first use after each bind
+        density_pyramid const& get_density_pyramid();
+        // World position of cell (0, 0)'s corner
+        glm::vec2 get_grid_origin() const;
+        size_t get_grid_size() const;
+        // Stable instance slots for the live cells, brought up to date on first use after each bind
+        cell_slots& get_slots();
+        // World units in one step of a cell vertex's position
+        static float get_position_scale();
+        // Live cell coordinates grouped by tile, row-major within each tile. These are the instances for the instanced
+        // path, each tile's cells are one contiguous range starting at its first_instance.
+        live_cell_list const& get_instances();
+        // Tiles with at least one live cell. A tile's chunk and first_vertex are set by get_vertex_layout.
+        std::vector<cell_tile> const& get_tiles();
+        // Changes every time new cells are bound, so each consumer can tell whether it is up to date
+        uint64_t get_version() const;
+        // Splits the vertices for every live cell into chunks of at most max_chunk_alloc_size_bytes, laid out tile by
+        // tile, and gives each tile its place in them. Nothing is written until write_vertices.
+        std::vector<vertex_chunk> const& get_vertex_layout(size_t max_chunk_alloc_size_bytes);
+        // Writes the vertices laid out by the last get_vertex_layout, chunk i to chunk_memory[i]. Each tile's positions
+        // are relative to its min corner. The memory is only ever stored to, front to back within each tile, so it can
+        // be write-combined mapped GPU memory.
+        void write_vertices(std::vector<void*> const& chunk_memory);
     private:
-        static float constexpr BACKGROUND_VERT_COLOR = 0.025f;
-        static unsigned int constexpr BACKGROUND_VERT_COUNT = 6;
+        // The background's far corners, its positions are scaled to fit the board
+        static uint16_t constexpr BACKGROUND_STEPS = UINT16_MAX;
         static std::vector<vertex> const BASE_VERTS;
         static float constexpr CELL_BORDER = 0.1f;
         static float constexpr CELL_HEIGHT = 0.25f;
         static float constexpr CELL_WIDTH = 0.5f;
         static float constexpr CELL_POS_OFFSET = CELL_WIDTH + CELL_BORDER;
-        static glm::vec3 constexpr COLOR_RED = {1.0f, 0.0f, 0.0f}; 
-        static glm::vec3 constexpr COLOR_LG = {0, 0.085f, 0}; 
-        static glm::vec3 constexpr COLOR_DG = {0, 0.025f, 0}; 
-        static glm::vec3 constexpr COLOR_LB = {0, 0, 0.085f}; 
-        static glm::vec3 constexpr COLOR_DB = {0, 0, 0.025f}; 
-        cell_container const* _cells;
-        bool _cells_dirty = true;
+        // Every cell dimension is a whole number of position steps, so cell vertices are exact in 16 bits
+        static float constexpr POSITION_SCALE = 0.05f;
+        static uint16_t constexpr CELL_HEIGHT_STEPS = 5;
+        static uint16_t constexpr CELL_WIDTH_STEPS = 10;
+        static uint16_t constexpr CELL_POS_OFFSET_STEPS = 12;
+        // Indices into the color table in the vertex shaders
+        static uint8_t constexpr COLOR_RED = 0;
+        static uint8_t constexpr COLOR_LG = 1;
+        static uint8_t constexpr COLOR_DG = 2;
+        static uint8_t constexpr COLOR_LB = 3;
+        static uint8_t constexpr COLOR_DB = 4;
+        // Tiles are at least this many cells on a side, bigger boards use bigger tiles to keep the draw count down
+        static size_t constexpr MIN_TILE_SIZE = 64;
+        // Keeps one tile's vertices well under the smallest allowed maximum allocation
+        static size_t constexpr MAX_TILE_SIZE = 512;
+        static size_t constexpr TARGET_TILES_PER_SIDE = 32;
+        // Fewer live cells than this per part and handing the parts out costs more than it saves
+        static size_t constexpr MIN_CELLS_PER_WORKER = 16384;
+        void _update_density();
+        void _update_slots();
+        void _update_tiles();
+        void _write_background_vertices(vertex* out) const;
+        // Writes the vertices of tiles [first, end), whose first vertices and chunks have already been assigned
+        void _write_tile_vertices(size_t first_tile, size_t end_tile, std::vector<void*> const& chunk_memory) const;
+        simulation_backend const* _cells;
         std::vector<vertex_chunk> _chunks;
-        std::vector<vertex> _vertices;
+        uint64_t _chunks_version = 0;
+        density_pyramid _density;
+        uint64_t _density_version = 0;
+        live_cell_list const* _live_cells;
+        cell_slots _slots;
+        uint64_t _slots_version = 0;
+        live_cell_list _tile_cells;
+        std::vector<uint32_t> _tile_offsets;
+        std::vector<cell_tile> _tiles;
+        uint64_t _tiles_version = 0;
+        uint64_t _version = 1;
+        // Where each part of write_vertices starts, and where the last one ends
+        std::vector<size_t> _worker_first_tiles;
+        worker_pool& _workers;
     };
 }
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "simulation/cell_container.h"
+
+namespace tomway
+{
+    // x of a slot whose cell has died, the instanced vertex shader collapses these
+    uint32_t constexpr EMPTY_SLOT = UINT32_MAX;
+
+    // Gives every live cell a stable slot in the instance buffer, so a generation only writes the cells that were born
+    // and tombstones the ones that died. Freed slots are reused before the slots grow, and once more than half of
+    // them are tombstones everything is packed to the front again.
+    //
+    // Births and deaths come from walking the new live cell list alongside the last one. Both are row-major, so it's
+    // a single merge with no lookups.
+    class cell_slots
+    {
+    public:
+        // A run of slots whose contents changed
+        struct dirty_range
+        {
+            uint32_t first_slot;
+            uint32_t slot_count;
+        };
+
+        size_t get_births() const;
+        size_t get_deaths() const;
+        // Changed slots since the last update, sorted and merged into runs
+        std::vector<dirty_range> const& get_dirty_ranges() const;
+        // Slots in use, live or tombstoned. Everything past this is unused.
+        size_t get_slot_count() const;
+        // Slot contents, a live cell's coordinates or EMPTY_SLOT
+        live_cell_list const& get_slots() const;
+        // For when the copy of the slots on the other end was lost, the next upload has to be all of them
+        void mark_all_dirty();
+        // Brings the slots up to date with a new generation, live_cells must be row-major
+        void update(live_cell_list const& live_cells);
+    private:
+        // Packing the slots costs a full upload, so small slot counts never bother
+        static size_t constexpr MIN_COMPACTION_SLOTS = 1024;
+        // Dirty slots this close together are uploaded as one run, a copy region costs more to record than a couple of
+        // slots cost to send
+        static uint32_t constexpr MAX_RANGE_GAP = 2;
+        uint32_t _allocate(cell_coord const& cell);
+        void _compact(live_cell_list const& live_cells);
+        void _merge_dirty_ranges();
+        size_t _births = 0;
+        // Last generation's live cells, row-major, and the slot each one is in
+        live_cell_list _cells;
+        std::vector<uint32_t> _cell_slots;
+        size_t _deaths = 0;
+        std::vector<uint32_t> _dirty;
+        std::vector<dirty_range> _dirty_ranges;
+        std::vector<uint32_t> _free;
+        live_cell_list _next_cells;
+        std::vector<uint32_t> _next_cell_slots;
+        live_cell_list _slots;
+    };
+}
\ No newline at end of file
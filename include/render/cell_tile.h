@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+namespace tomway
+{
+    // Order of the faces in the cell mesh. A tile's geometry is laid out face by face in the same order, so every
+    // face of a tile is one contiguous range and the ones the camera can't see are simply left out of the draw.
+    enum class cell_face : uint8_t { TOP, BOTTOM, BACK, FRONT, LEFT, RIGHT };
+
+    uint8_t constexpr CELL_FACE_COUNT = 6;
+
+    // Where a face sits in the mesh, also the normal index its vertices carry
+    constexpr uint8_t face_index(cell_face const face)
+    {
+        return static_cast<uint8_t>(face);
+    }
+
+    uint8_t constexpr VERTS_PER_FACE = 6;
+
+    // A square block of the board with at least one live cell
+    struct cell_tile
+    {
+        // World space bounds of the tile's area of the board
+        glm::vec3 min;
+        glm::vec3 max;
+        // The tile's first cell and how many cells it spans on a side, edge tiles can run past the end of the board
+        uint32_t x;
+        uint32_t y;
+        uint32_t size;
+        // Live cells in the tile and where they start in the tile-ordered instance list
+        uint32_t cell_count;
+        uint32_t first_instance;
+        // Vertex chunk holding the tile's vertices and where they start in it
+        size_t chunk;
+        uint32_t first_vertex;
+    };
+
+    // One block of the density pyramid drawn as a flat quad in place of its cubes, the per-instance data of
+    // density.vert. Coverage is how much of the quad the tops of its live cells would cover.
+    struct density_quad
+    {
+        glm::vec3 min;
+        float coverage;
+        glm::vec2 size;
+    };
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "simulation/cell_container.h"
+
+namespace tomway
+{
+    // Live cell counts for square blocks of the board at every power of two scale. Level 0 blocks are BLOCK_SIZE
+    // cells on a side and each level above sums 2x2 blocks of the one below, up to one block covering the board.
+    //
+    // Level 0 is counted again from the live cell list every generation, which is a pass over the population like
+    // building the list itself. The levels above are what's incremental: the new level 0 counts are compared with
+    // the last ones and only the blocks that changed are carried up, unless so many changed that summing every level
+    // again is cheaper.
+    class density_pyramid
+    {
+    public:
+        static size_t constexpr BLOCK_SIZE = 8;
+
+        // Cells on a side of a block at the given level
+        static size_t get_block_size(size_t level);
+        size_t get_blocks_per_side(size_t level) const;
+        // Level 0 blocks whose count changed in the last update
+        size_t get_changed_blocks() const;
+        uint32_t get_count(size_t level, size_t x, size_t y) const;
+        size_t get_level_count() const;
+        void update(size_t grid_size, live_cell_list const& live_cells);
+    private:
+        void _resize(size_t grid_size);
+        void _sum_levels();
+        size_t _changed_blocks = 0;
+        size_t _grid_size = 0;
+        std::vector<std::vector<uint32_t>> _levels;
+        std::vector<uint32_t> _next_counts;
+        std::vector<size_t> _sides;
+    };
+}
\ No newline at end of file
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <array>
+#include <glm/glm.hpp>
+
+namespace tomway
+{
+    // View frustum as six inward facing planes, used to cull tiles on the CPU before they're drawn
+    class frustum
+    {
+    public:
+        explicit frustum(glm::mat4 const& view_projection);
+        // Conservative, a box that only comes close to a corner can still count as intersecting
+        bool intersects(glm::vec3 const& min, glm::vec3 const& max) const;
+    private:
+        std::array<glm::vec4, 6> _planes;
+    };
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace tomway
+{
+    class gpu_allocator;
+
+    // One device memory allocation that buffers are carved out of
+    struct gpu_block
+    {
+        vk::UniqueDeviceMemory memory_u;
+        vk::DeviceSize size;
+        uint32_t memory_type;
+        // The whole block, mapped for as long as it lives when its memory is host visible
+        void* mapped;
+        vk::DeviceSize used;
+        // Free ranges, size by offset. Neighbours are merged as ranges are freed.
+        std::map<vk::DeviceSize, vk::DeviceSize> free_ranges;
+    };
+
+    // A buffer's range of a gpu_block, handed back to the block when it's destroyed. The sub-allocated counterpart of
+    // vk::UniqueDeviceMemory.
+    class gpu_memory
+    {
+    public:
+        gpu_memory() = default;
+        gpu_memory(gpu_allocator* allocator, gpu_block* block, vk::DeviceSize offset, vk::DeviceSize size);
+        ~gpu_memory();
+        gpu_memory(gpu_memory const&) = delete;
+        gpu_memory(gpu_memory&& other) noexcept;
+        gpu_memory& operator=(gpu_memory const&) = delete;
+        gpu_memory& operator=(gpu_memory&& other) noexcept;
+
+        explicit operator bool() const;
+        // Null unless the memory is host visible
+        void* get_mapped() const;
+        vk::DeviceMemory get_memory() const;
+        vk::DeviceSize get_offset() const;
+        vk::DeviceSize get_size() const;
+        void reset();
+    private:
+        gpu_allocator* _allocator = nullptr;
+        gpu_block* _block = nullptr;
+        vk::DeviceSize _offset = 0;
+        vk::DeviceSize _size = 0;
+    };
+
+    // Sub-allocates buffers from a few large device memory blocks per memory type instead of one allocation each.
+    // Freed ranges are merged and reused, and each new block of a type is twice the size of the last so a growing board
+    // soon stops reaching the driver at all. Host visible blocks are mapped once, when they're created.
+    //
+    // Only buffers come from here, so bufferImageGranularity never applies. Every host visible type the renderer asks
+    // for is also host coherent, so there's no nonCoherentAtomSize to respect either.
+    class gpu_allocator
+    {
+    public:
+        struct heap_usage
+        {
+            bool device_local;
+            vk::DeviceSize heap_size;
+            // What VK_EXT_memory_budget says the process can use and is using, the heap size and the allocator's own
+            // blocks without it
+            vk::DeviceSize budget;
+            vk::DeviceSize usage;
+            size_t block_count;
+            vk::DeviceSize block_bytes;
+            vk::DeviceSize used_bytes;
+        };
+
+        gpu_allocator() = default;
+        ~gpu_allocator() = default;
+        gpu_allocator(gpu_allocator&) = delete;
+        gpu_allocator(gpu_allocator&&) = delete;
+        gpu_allocator& operator=(gpu_allocator const&) = delete;
+        gpu_allocator& operator=(gpu_allocator const&&) = delete;
+
+        gpu_memory allocate(vk::MemoryRequirements const& requirements, uint32_t memory_type);
+        // Per heap, the budget is queried fresh on every call when the extension is enabled
+        std::vector<heap_usage> get_heap_usage() const;
+        bool has_memory_budget() const;
+        void init(vk::PhysicalDevice physical_device, vk::Device device, size_t max_allocation_size, bool has_memory_budget);
+    private:
+        friend class gpu_memory;
+
+        gpu_block* _create_block(uint32_t memory_type, vk::DeviceSize min_size);
+        void _free(gpu_block* block, vk::DeviceSize offset, vk::DeviceSize size);
+        std::vector<std::unique_ptr<gpu_block>> _blocks;
+        vk::Device _device;
+        bool _has_memory_budget = false;
+        vk::DeviceSize _max_allocation_size = 0;
+        vk::PhysicalDeviceMemoryProperties _memory_properties;
+        // Size of the next block of each memory type
+        std::vector<vk::DeviceSize> _next_block_sizes;
+        vk::PhysicalDevice _physical_device;
+    };
+}
\ No newline at end of file
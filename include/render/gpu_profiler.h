@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.hpp>
+
+namespace tomway
+{
+    // Where a frame's command buffer writes its timestamps. The passes are the spans between neighbouring stamps.
+    enum class gpu_timestamp { FRAME_START, UPLOAD_END, CELLS_END, FRAME_END, COUNT };
+    // Copies and compaction before the render pass, the scene's draws, and ImGui
+    enum class gpu_pass { UPLOAD, CELLS, UI, COUNT };
+
+    size_t constexpr GPU_TIMESTAMP_COUNT = static_cast<size_t>(gpu_timestamp::COUNT);
+    size_t constexpr GPU_PASS_COUNT = static_cast<size_t>(gpu_pass::COUNT);
+
+    char const* to_string(gpu_pass pass);
+
+    struct gpu_frame_timings
+    {
+        uint64_t frame;
+        std::array<double, GPU_PASS_COUNT> pass_ms;
+        double frame_ms;
+        bool has_statistics;
+        uint64_t vertex_invocations;
+        uint64_t fragment_invocations;
+    };
+
+    // Times each frame's passes with timestamp queries and counts its shader invocations with a pipeline statistics
+    // query, whether Tracy is attached or not. Every frame in flight has its own queries, and they're only read once
+    // that frame's fence has been waited on, so reading them never stalls. The last HISTORY_FRAMES frames are kept
+    // for the averages, percentiles and CSV export.
+    class gpu_profiler
+    {
+    public:
+        static size_t constexpr HISTORY_FRAMES = 600;
+
+        struct pass_summary
+        {
+            double average_ms;
+            double p99_ms;
+        };
+
+        gpu_profiler() = default;
+        ~gpu_profiler() = default;
+        gpu_profiler(gpu_profiler&) = delete;
+        gpu_profiler(gpu_profiler&&) = delete;
+        gpu_profiler& operator=(gpu_profiler const&) = delete;
+        gpu_profiler& operator=(gpu_profiler const&&) = delete;
+
+        // Resets the frame's queries, call first thing in its command buffer
+        void begin_frame(vk::CommandBuffer const& command_buffer, unsigned frame);
+        // Both outside a render pass. Skipped when the device can't count invocations, or when the pass executes
+        // secondaries and the device can't inherit the query into them.
+        void begin_statistics(vk::CommandBuffer const& command_buffer, unsigned frame, bool executes_secondaries);
+        void end_statistics(vk::CommandBuffer const& command_buffer, unsigned frame);
+        // Reads what the frame last recorded. Only call once its fence has been waited on.
+        void collect(unsigned frame);
+        bool export_csv(std::string const& path) const;
+        std::deque<gpu_frame_timings> const& get_history() const;
+        // What secondaries executed inside the statistics query have to be begun with
+        vk::QueryPipelineStatisticFlags get_inherited_statistics() const;
+        pass_summary get_frame_summary() const;
+        pass_summary get_pass_summary(gpu_pass pass) const;
+        bool has_statistics() const;
+        bool has_timestamps() const;
+
+        void init(
+            vk::PhysicalDevice physical_device,
+            vk::Device device,
+            uint32_t queue_family,
+            unsigned frames_in_flight,
+            bool pipeline_statistics,
+            bool inherited_queries);
+
+        void write_timestamp(vk::CommandBuffer const& command_buffer, unsigned frame, gpu_timestamp timestamp);
+    private:
+        struct frame_queries
+        {
+            uint64_t frame_number = 0;
+            bool recorded = false;
+            bool has_statistics = false;
+        };
+
+        vk::Device _device;
+        std::vector<frame_queries> _frames;
+        std::deque<gpu_frame_timings> _history;
+        bool _inherited_queries = false;
+        uint64_t _recorded_frames = 0;
+        vk::UniqueQueryPool _statistics_pool_u;
+        vk::UniqueQueryPool _timestamp_pool_u;
+        uint64_t _timestamp_mask = 0;
+        // Nanoseconds per timestamp tick
+        double _timestamp_period = 0.0;
+    };
+}
\ No newline at end of file
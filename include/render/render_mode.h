@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+namespace tomway
+{
+    // How render_system turns the live cells into draws. The modes can be switched between at runtime so that they
+    // can be compared on the same board.
+    //   VERTEX          every live cell is expanded into 36 world space vertices on the CPU
+    //   INSTANCED       one shared cube mesh, drawn once per live cell from a buffer of cell coordinates
+    //   INCREMENTAL     instanced, but each live cell keeps its slot in the buffer and only births and deaths are
+    //                   uploaded
+    //   GPU_COMPACT     the board's bits are uploaded as they are and a compute pass builds the instances and the
+    //                   indirect draw that renders them
+    //   RAYCAST         the board's bits are uploaded as they are and a full screen pass raycasts them, no geometry
+    enum class render_mode { VERTEX, INSTANCED, INCREMENTAL, GPU_COMPACT, RAYCAST };
+
+    render_mode next_render_mode(render_mode mode);
+    char const* to_string(render_mode mode);
+    bool to_render_mode(std::string const& name, render_mode& mode);
+}
@@ -8,13 +8,21 @@
 	#define VALIDATION_LAYERS "VK_LAYER_KHRONOS_validation"
 #endif
 
+#include <deque>
+#include <functional>
+#include <unordered_map>
 #include <vulkan/vulkan.hpp>
 
 #include "cell_geometry.h"
+#include "render/gpu_allocator.h"
+#include "render/gpu_profiler.h"
+#include "render/render_mode.h"
+#include "render/shader_code.h"
 #include "TracyVulkan.hpp"
 #include "transform.h"
 #include "vertex.h"
 #include "window_system.h"
+#include "worker_pool.h"
 
 namespace tomway {
 	struct QueueFamilyIndices {
@@ -22,6 +30,8 @@ namespace tomway {
 		bool graphics_avail;
 		uint32_t present_family;
 		bool present_avail;
+		// A transfer only family when there is one, the graphics family otherwise
+		uint32_t transfer_family;
 	};
 
 	struct SwapchainSupportDetails {
@@ -30,9 +40,108 @@ namespace tomway {
 		std::vector<vk::PresentModeKHR> present_modes;
 	};
 
+	// Matches the push constants in shader.vert and instanced.vert. Vertex positions are in steps of position_scale
+	// from the origin, plus the cell's coordinates times spacing for instances.
+	struct cell_grid_push_constants {
+		glm::vec2 origin;
+		float spacing;
+		float position_scale;
+	};
+
+	// Matches the push constants in raycast.frag
+	struct raycast_push_constants {
+		glm::mat4 inverse_view_projection;
+		glm::vec4 camera;
+		glm::vec2 grid_origin;
+		glm::vec2 viewport_size;
+		float spacing;
+		uint32_t grid_size;
+		uint32_t uints_per_row;
+		float cell_width;
+		float cell_height;
+		uint32_t max_steps;
+	};
+
+	// Where cell vertices are written. DIRECT maps the vertex buffers themselves, for devices with device local memory
+	// the CPU can see all of (resizable BAR, unified memory and software devices). STAGED writes into mapped staging
+	// buffers that are copied to the vertex buffers on the GPU.
+	enum class vertex_upload_strategy { STAGED, DIRECT };
+
+	// One generation of the vertex path's geometry. The renderer draws from one set while the next generation uploads
+	// into another, and switches over once the transfer timeline reaches the upload's value.
+	struct vertex_buffer_set {
+		std::vector<vk::UniqueBuffer> staging_buffers_u;
+		std::vector<gpu_memory> staging_buffers_memory_u;
+		std::vector<vk::UniqueBuffer> buffers_u;
+		std::vector<gpu_memory> buffers_memory_u;
+		vk::UniqueCommandBuffer upload_command_buffer_u;
+		// Where the vertices are written, the staging buffers or the vertex buffers themselves
+		std::vector<void*> mapped;
+		std::vector<vertex_chunk> chunks;
+		// The tiles as they were laid out for these chunks
+		std::vector<cell_tile> tiles;
+		// Bumped whenever the buffers are recreated, so draw groups that bound the old ones know to record again
+		uint64_t generation = 0;
+		uint64_t upload_value = 0;
+		// Frame timeline value of the last frame that drew from the set
+		uint64_t last_drawn_frame = 0;
+	};
+
+	// A host visible buffer that one frame in flight copies cells out of
+	struct staging_buffer {
+		vk::UniqueBuffer buffer_u;
+		gpu_memory memory_u;
+		void* mapped = nullptr;
+		size_t capacity = 0;
+	};
+
+	// Everything that was sized to a swapchain that has since been replaced. It's kept until the first frame drawn on
+	// the new swapchain finishes, by which point nothing in flight can still be using it. Members are in creation
+	// order so they're destroyed in reverse.
+	struct retired_swapchain {
+		vk::UniqueSwapchainKHR swapchain_u;
+		std::vector<vk::UniqueImageView> image_views_u;
+		vk::UniqueImage depth_image_u;
+		vk::UniqueDeviceMemory depth_image_memory_u;
+		vk::UniqueImageView depth_image_view_u;
+		std::vector<vk::UniqueFramebuffer> framebuffers_u;
+		// Frame timeline value that has to be reached before it can be destroyed
+		uint64_t retire_frame = 0;
+	};
+
+	// A tile that survived culling this frame, faces has a bit set for each cell_face the camera can see
+	struct visible_tile {
+		cell_tile const* tile;
+		uint8_t faces;
+		float distance_sq;
+	};
+
+	// Neighbouring tiles drawn from one secondary command buffer. Each group has its own pool, so any thread can record
+	// it, and a secondary per frame in flight that's only recorded again when what it would draw changes.
+	struct draw_group {
+		vk::UniqueCommandPool command_pool_u;
+		std::vector<vk::UniqueCommandBuffer> command_buffers_u;
+		// What each frame's secondary was recorded from, empty until it has been
+		std::vector<std::vector<uint64_t>> recorded_keys;
+		// This frame's visible tiles in the group, nearest first, and the key they make
+		std::vector<visible_tile> tiles;
+		std::vector<uint64_t> key;
+	};
+
+	// Matches the push constants in compact.comp. The board is read as 32 bit uints, two to a cell_container word.
+	struct board_layout_push_constants {
+		uint32_t uints_per_row;
+		uint32_t uint_count;
+		uint32_t instance_capacity;
+	};
+
 	class render_system {
 	public:
-		render_system(window_system& window_system, cell_geometry& cell_geometry, unsigned max_frames_in_flight = 2);
+		render_system(
+			window_system& window_system,
+			cell_geometry& cell_geometry,
+			worker_pool& workers,
+			unsigned max_frames_in_flight = 2);
 		~render_system();
 		render_system(render_system&) = delete;
 		render_system(render_system&&) = delete;
@@ -40,9 +149,14 @@ namespace tomway {
 		render_system& operator=(render_system const&&) = delete;
 
 		void draw_frame(transform const& transform);
+		bool export_gpu_timings(std::string const& path) const;
+		render_mode get_render_mode() const;
+		// Something still has to reach the screen, a generation that hasn't been uploaded or an upload in flight
+		bool has_pending_work() const;
 		void minimized();
 		void new_frame();
 		void resize_framebuffer();
+		void set_render_mode(render_mode mode);
 	private:
 		/*
 		########  WARNING WARNING WARNING WARNING
@@ -52,6 +166,9 @@ namespace tomway {
 		
 		vk::UniqueInstance _instance_u;
 		vk::UniqueDevice _device_u;
+		gpu_allocator _allocator;
+		vk::UniquePipelineCache _pipeline_cache_u;
+		gpu_profiler _gpu_profiler;
 		vk::UniqueSurfaceKHR _surface_u;
 		vk::UniqueSwapchainKHR _swapchain_u;
 		std::vector<vk::UniqueImageView> _image_views_u;
@@ -59,51 +176,119 @@ namespace tomway {
 		vk::UniqueDescriptorSetLayout _descriptor_set_layout_u;
 		vk::UniquePipelineLayout _pipeline_layout_u;
 		vk::UniquePipeline _graphics_pipeline_u;
+		vk::UniquePipeline _instanced_pipeline_u;
+		vk::UniquePipeline _density_pipeline_u;
+		vk::UniqueDescriptorSetLayout _compaction_descriptor_set_layout_u;
+		vk::UniquePipelineLayout _compaction_pipeline_layout_u;
+		vk::UniquePipeline _compaction_pipeline_u;
+		vk::UniqueDescriptorSetLayout _raycast_descriptor_set_layout_u;
+		vk::UniquePipelineLayout _raycast_pipeline_layout_u;
+		vk::UniquePipeline _raycast_pipeline_u;
 		vk::UniqueImage _depth_image_u;
 		vk::UniqueDeviceMemory _depth_image_memory_u;
 		vk::UniqueImageView _depth_image_view_u;
 		std::vector<vk::UniqueFramebuffer> _framebuffers_u;
+		std::deque<retired_swapchain> _retired_swapchains;
 		vk::UniqueCommandPool _command_pool_u;
+		vk::UniqueCommandPool _transfer_command_pool_u;
 		std::vector<vk::UniqueCommandBuffer> _command_buffers_u;
+		// The background, density quads and ImGui for the tile paths, recorded on the main thread every frame
+		std::vector<vk::UniqueCommandBuffer> _main_command_buffers_u;
+		std::vector<draw_group> _draw_groups;
 		std::vector<vk::UniqueSemaphore> _image_available_sems_u;
 		std::vector<vk::UniqueSemaphore> _render_finished_sems_u;
 		std::vector<vk::UniqueFence> _in_flight_fences_u;
-		std::vector<vk::UniqueBuffer> _vertex_staging_buffers_u;
-		std::vector<vk::UniqueDeviceMemory> _vertex_staging_buffers_memory_u;
-		std::vector<vk::UniqueBuffer> _vertex_buffers_u;
-		std::vector<vk::UniqueDeviceMemory> _vertex_buffers_memory_u;
+		vk::UniqueSemaphore _frame_timeline_u;
+		vk::UniqueSemaphore _transfer_timeline_u;
+		std::vector<vertex_buffer_set> _vertex_buffer_sets;
+		vk::UniqueBuffer _cell_mesh_buffer_u;
+		gpu_memory _cell_mesh_buffer_memory_u;
+		std::vector<staging_buffer> _instance_staging_buffers;
+		vk::UniqueBuffer _instance_buffer_u;
+		gpu_memory _instance_buffer_memory_u;
+		std::vector<staging_buffer> _board_staging_buffers;
+		vk::UniqueBuffer _board_buffer_u;
+		gpu_memory _board_buffer_memory_u;
+		vk::UniqueBuffer _draw_command_buffer_u;
+		gpu_memory _draw_command_buffer_memory_u;
+		std::vector<vk::UniqueBuffer> _density_buffers_u;
+		std::vector<gpu_memory> _density_buffers_memory_u;
 		std::vector<vk::UniqueBuffer> _uniform_buffers_u;
-		std::vector<vk::UniqueDeviceMemory> _uniform_buffers_memory_u;
+		std::vector<gpu_memory> _uniform_buffers_memory_u;
 		vk::UniqueDescriptorPool _descriptor_pool_main_u;
 		vk::UniqueDescriptorPool _descriptor_pool_imgui_u;
+		vk::UniqueDescriptorPool _descriptor_pool_compaction_u;
+		vk::UniqueDescriptorPool _descriptor_pool_raycast_u;
 
 		/*
 		########  STRICT ORDERING SECTION END
 		*/
 
+		cell_grid_push_constants _background_constants = {};
+		size_t _board_capacity_bytes = 0;
+		board_layout_push_constants _board_layout_constants = {};
 		bool _cell_buffer_dirty = true;
 		cell_geometry& _cell_geometry;
+		cell_grid_push_constants _cell_grid_constants = {};
+		size_t _cell_upload_bytes = 0;
+		vk::DescriptorSet _compaction_descriptor_set;
 		unsigned _curr_frame;
+		std::vector<size_t> _density_buffer_capacities;
+		std::vector<void*> _density_buffers_mapped;
+		std::vector<density_quad> _density_quads;
+		size_t _density_tile_count = 0;
 		std::vector<vk::DescriptorSet> _descriptor_sets;
+		// Index into _draw_groups by group column and row, packed into one key
+		std::unordered_map<uint64_t, size_t> _draw_group_indices;
+		size_t _draw_groups_drawn = 0;
+		size_t _draw_groups_recorded = 0;
+		// Index into _vertex_buffer_sets, SIZE_MAX until the first upload finishes
+		size_t _drawn_vertex_set = SIZE_MAX;
+		uint64_t _frame_number = 0;
 		bool _framebuffer_resized;
 		vk::Queue _graphics_queue;
 		std::vector<vk::Image> _images;
+		// Bumped whenever the instance or cell mesh buffer is recreated, so draw groups know to record again
+		uint64_t _instance_buffer_generation = 0;
+		size_t _instance_capacity = 0;
+		uint32_t _instance_count = 0;
+		size_t _instance_grid_size = 0;
 		unsigned _max_frames_in_flight;
 		vk::SampleCountFlagBits _msaa_samples = vk::SampleCountFlagBits::e1;
 		size_t _max_mem_allocation_size;
 		vk::PhysicalDevice _physical_device;
 		vk::Queue _present_queue;
 		QueueFamilyIndices _queue_indices;
+		raycast_push_constants _raycast_constants = {};
+		vk::DescriptorSet _raycast_descriptor_set;
+		render_mode _render_mode = render_mode::INSTANCED;
+		size_t _slot_births = 0;
+		std::vector<vk::BufferCopy> _slot_copy_regions;
+		size_t _slot_deaths = 0;
 		std::vector<const char*> _required_device_extensions = { vk::KHRSwapchainExtensionName };
-		std::vector<void*> _vertex_staging_memory;
 		vk::Extent2D _swapchain_extent;
 		vk::Format _swapchain_format;
 		std::vector<void*> _uniform_buffers_mapped;
 		std::vector<const char*> _validation_layers = { VALIDATION_LAYERS };
-		std::vector<vertex_chunk> _vertex_chunks;
+		std::vector<visible_tile> _visible_tiles;
+		vertex_upload_strategy _vertex_upload_strategy = vertex_upload_strategy::STAGED;
+		size_t _tile_count = 0;
 		std::vector<TracyVkCtx> _tracy_contexts;
+		vk::Queue _transfer_queue;
+		uint64_t _transfer_value = 0;
+		// Vertex buffers are shared by these families, graphics and transfer, when they differ
+		std::vector<uint32_t> _upload_queue_families;
+		render_mode _uploaded_mode = render_mode::INSTANCED;
+		uint64_t _uploaded_version = 0;
+		size_t _uploading_vertex_set = SIZE_MAX;
 		bool _window_minimized;
 		window_system& _window_system;
+		worker_pool& _workers;
+
+		void begin_secondary(vk::CommandBuffer const& command_buffer);
+		void cull_tiles(transform const& transform);
+		void create_board_buffers(size_t size);
+		void create_cell_mesh_buffer();
 
 		void create_buffer(
 			size_t size,
@@ -111,10 +296,11 @@ namespace tomway {
 			vk::SharingMode sharing_mode,
 			vk::MemoryPropertyFlags memory_property_flags,
 			vk::UniqueBuffer& buffer_u,
-			vk::UniqueDeviceMemory& buffer_memory_u);
+			gpu_memory& buffer_memory_u);
 
 		void create_command_buffer();
 		void create_command_pool();
+		void create_compaction_pipeline();
 		void create_depth_resources();
 		void create_descriptor_pools();
 		void create_descriptor_sets();
@@ -127,17 +313,51 @@ namespace tomway {
 			vk::UniqueImage& image_u, vk::UniqueDeviceMemory& memory_u);
 		
 		void create_image_views();
+		void create_instance_buffers(size_t capacity);
 		void create_logical_device();
-		void create_swapchain();
+
+		vk::UniquePipeline create_pipeline(
+			shader_code const& vert_shader,
+			shader_code const& frag_shader,
+			vk::PipelineVertexInputStateCreateInfo const& vertex_input_state,
+			vk::PipelineLayout const& pipeline_layout);
+
+		void create_pipeline_cache();
+		void create_raycast_pipeline();
+		void create_swapchain(vk::SwapchainKHR old_swapchain);
 		void create_sync_objects();
 		void create_uniform_buffers();
-		void create_vertex_buffers(std::vector<vertex_chunk> const& chunks);
+		void create_vertex_buffers(vertex_buffer_set& set, std::vector<vertex_chunk> const& chunks);
 		void create_vk_instance();
 		uint32_t find_memory_type(uint32_t type_filter, vk::MemoryPropertyFlags properties);
 		void pick_physical_device();
+		void poll_vertex_upload();
+		void record_background_draw(vk::CommandBuffer const& command_buffer);
+		void record_board_compaction(vk::CommandBuffer& command_buffer);
 		void record_command_buffer(vk::CommandBuffer& command_buffer, uint32_t image_index);
+		void record_density_draws(vk::CommandBuffer const& command_buffer);
+		std::vector<vk::CommandBuffer> record_draw_groups();
+		void record_draw_state(vk::CommandBuffer const& command_buffer);
+		void record_instance_bindings(vk::CommandBuffer const& command_buffer);
+		void record_instanced_draws(vk::CommandBuffer& command_buffer);
+		void record_raycast_draw(vk::CommandBuffer& command_buffer);
+		void record_instance_transfer(vk::CommandBuffer& command_buffer);
+		void record_tile_draws(vk::CommandBuffer const& command_buffer, std::vector<visible_tile> const& tiles);
 		void recreate_swapchain();
-		void transfer_vertices(std::vector<vertex_chunk> const& vertex_chunks) const;
+		void release_retired_swapchains();
+		void* reserve_staging_buffer(std::vector<staging_buffer>& buffers, size_t size);
+		void save_pipeline_cache();
+		bool should_grow_instances(size_t count) const;
+		bool start_vertex_upload();
+		void submit_one_time_commands(std::function<void(vk::CommandBuffer const&)> const& record);
+		void transfer_board();
+		void transfer_density_quads();
+		void transfer_instances();
+		void transfer_slots();
+		void update_cell_grid(size_t grid_size);
+		void update_compaction_descriptor_set();
+		void update_raycast_constants(transform const& transform);
+		void update_raycast_descriptor_set();
 		void update_uniform_buffer(transform transform);
 	};
 
@@ -147,15 +367,15 @@ namespace tomway {
 	static vk::Extent2D choose_swap_extent(const window_system& windowSystem, const vk::SurfaceCapabilitiesKHR& capabilities);
 	static vk::PresentModeKHR choose_swap_present_mode(const std::vector<vk::PresentModeKHR> modes);
 	static vk::SurfaceFormatKHR choose_swap_surface_format(const std::vector<vk::SurfaceFormatKHR> formats);
+	static vertex_upload_strategy choose_vertex_upload_strategy(const vk::PhysicalDevice& physical_device);
 	static vk::UniqueImageView create_image_view(const vk::Device& device, const vk::Image& image, vk::Format format, vk::ImageAspectFlags aspect_mask, uint32_t mip_levels);
 	static vk::UniqueRenderPass create_render_pass(const vk::PhysicalDevice& physical_device, const vk::Device& device, const vk::Format& format, vk::SampleCountFlagBits samples);
-	static vk::UniqueShaderModule create_shader_module(const vk::Device& device, const std::vector<char>& bytes);
+	static vk::UniqueShaderModule create_shader_module(const vk::Device& device, const shader_code& code);
 	static vk::Format find_depth_format(const vk::PhysicalDevice& physical_device);
 	static QueueFamilyIndices find_queue_families(const vk::PhysicalDevice& physical_device, const vk::SurfaceKHR& surface);
 	static size_t get_max_memory_allocation(const vk::PhysicalDevice& physical_device);
 	static vk::SampleCountFlagBits get_max_usable_sample_count(const vk::PhysicalDevice& physical_device);
 	static bool is_device_suitable(const vk::PhysicalDevice& device, const vk::SurfaceKHR& surface, const std::vector<const char*>& required_device_extensions);
 	static bool is_queue_family_complete(const QueueFamilyIndices& device_indices);
-	static std::vector<char> read_shader_bytes(const std::string& file_path);
 	static inline bool need_bigger_chunk_alloc(std::vector<vertex_chunk> const& lhs, std::vector<vertex_chunk> const& new_chunks);
 }
\ No newline at end of file
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace tomway
+{
+    // SPIR-V for one of the shaders in shaders/. compile.bat writes each one out as a list of words that
+    // shader_code.cpp includes, so the shaders are part of the executable and nothing is read from disk at startup.
+    struct shader_code
+    {
+        uint32_t const* words;
+        size_t size_bytes;
+    };
+
+    extern shader_code const COMPACT_COMP_SHADER;
+    extern shader_code const DENSITY_VERT_SHADER;
+    extern shader_code const FRAG_SHADER;
+    extern shader_code const INSTANCED_VERT_SHADER;
+    extern shader_code const RAYCAST_FRAG_SHADER;
+    extern shader_code const RAYCAST_VERT_SHADER;
+    extern shader_code const VERT_SHADER;
+}
\ No newline at end of file
@@ -1,16 +1,21 @@
 #pragma once
 
-#include <glm/glm.hpp>
+#include <cstdint>
 #include <vulkan/vulkan.hpp>
 
 namespace tomway {
+	// 8 bytes a vertex. The position is in whole steps of the draw's position scale from the draw's origin, both of
+	// which are push constants, and the normal and color are indices into tables in the vertex shaders.
 	struct vertex
 	{
-		glm::vec3 pos;
-		glm::vec3 normal;
-		glm::vec3 color;
+		uint16_t x;
+		uint16_t y;
+		uint16_t z;
+		// The face the vertex belongs to, in cell_face order
+		uint8_t normal;
+		uint8_t color;
 
-		static std::array<vk::VertexInputAttributeDescription, 3> get_attribute_descriptions();
+		static std::array<vk::VertexInputAttributeDescription, 1> get_attribute_descriptions();
 		static vk::VertexInputBindingDescription get_binding_description();
 	};
 }
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "mapped_file.h"
+#include "simulation/cell_container.h"
+
+namespace tomway
+{
+    // Neighbour count masks for the only rule the simulation runs, B3/S23
+    uint32_t constexpr CONWAY_BIRTH_MASK = 1 << 3;
+    uint32_t constexpr CONWAY_SURVIVE_MASK = 1 << 2 | 1 << 3;
+
+    // Board files are the header, then the tile index, then the tile data, all in the writing machine's native byte
+    // order. Loading maps the structs and words straight out of the file, so they only load on a machine with the same
+    // byte order, which every platform the game builds for shares.
+    struct board_file_header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t tile_size;
+        uint64_t grid_size;
+        uint64_t generation;
+        uint32_t birth_mask;
+        uint32_t survive_mask;
+        uint32_t tile_count;
+        uint32_t reserved;
+        uint64_t index_offset;
+    };
+
+    // Tiles that have no live cells are left out of the index. Each tile that is present is tile_size rows of one
+    // 64-bit word, the same layout as a cell_container row, so loading is a word copy.
+    struct board_file_tile
+    {
+        uint32_t tile_x;
+        uint32_t tile_y;
+        uint64_t offset;
+    };
+
+    static_assert(sizeof(board_file_header) == 56, "board_file_header must match the on-disk layout");
+    static_assert(sizeof(board_file_tile) == 16, "board_file_tile must match the on-disk layout");
+
+    // Versioned binary board format. Files are memory mapped and validated up front, after which the board is read
+    // by copying the words of the tiles in the index.
+    class board_file
+    {
+    public:
+        static uint32_t constexpr VERSION = 1;
+        static uint32_t constexpr TILE_SIZE = cell_container::WORD_BITS;
+
+        board_file() = default;
+        ~board_file() = default;
+        board_file(board_file&) = delete;
+        board_file(board_file&&) = delete;
+        board_file& operator=(board_file const&) = delete;
+        board_file& operator=(board_file const&&) = delete;
+
+        // True if the file starts with the board file magic, used to tell these apart from JSON saves
+        static bool is_board_file(std::string const& path);
+        static bool write(
+            std::string const& path,
+            cell_container const& cells,
+            uint64_t generation,
+            progress_fn const& progress = nullptr);
+
+        board_file_header const& get_header() const;
+        bool open(std::string const& path);
+        // Replaces cells with the whole board
+        void read(cell_container& cells, progress_fn const& progress = nullptr) const;
+    private:
+        uint64_t const* _get_tile_words(board_file_tile const& tile) const;
+        mapped_file _file;
+        board_file_header _header = {};
+        board_file_tile const* _tiles = nullptr;
+        size_t _tiles_per_side = 0;
+    };
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+#include "simulation/cell_container.h"
+
+namespace tomway
+{
+    // Streaming JSON board files: { "grid_size": n, "cells": [[x, y], ...] }. Reading is a single SAX pass that
+    // validates and populates at the same time, so memory is the board itself rather than a DOM of every cell. Files
+    // that put "cells" before "grid_size" are still accepted, their coordinates are held as 8 byte pairs until the
+    // size is known. Writing always puts "grid_size" first. Progress is reported against the file size when reading
+    // and the cell count when writing.
+    bool read_board_json(std::string const& path, cell_container& cells, progress_fn const& progress = nullptr);
+    bool write_board_json(
+        std::string const& path,
+        size_t grid_size,
+        live_cell_list const& live_cells,
+        progress_fn const& progress = nullptr);
+}
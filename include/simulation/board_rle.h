@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "simulation/cell_container.h"
+
+namespace tomway
+{
+    // A pattern in the run length encoded format the rest of the Life ecosystem uses. The pattern is kept as its runs
+    // of live cells so that it can be placed anywhere on a board a word at a time.
+    class rle_pattern
+    {
+    public:
+        struct run
+        {
+            uint32_t x;
+            uint32_t y;
+            uint32_t length;
+        };
+
+        size_t get_height() const;
+        size_t get_population() const;
+        size_t get_width() const;
+        // Clears the pattern's bounding box and sets its live cells with the top left corner at (x, y), wrapping
+        // around the edges the same way the simulation does. Fails if the pattern is bigger than the board.
+        bool paste(cell_container& cells, size_t x, size_t y) const;
+        bool read(std::string const& path, progress_fn const& progress = nullptr);
+    private:
+        size_t _height = 0;
+        size_t _population = 0;
+        std::vector<run> _runs;
+        size_t _width = 0;
+    };
+
+    // Writes the whole board, with x and y set to the grid size so the pattern comes back where it was
+    bool write_board_rle(std::string const& path, cell_container const& cells, progress_fn const& progress = nullptr);
+}
@@ -1,36 +1,126 @@
 #pragma once
+#include <cstdint>
+#include <iterator>
+#include <memory>
 #include <vector>
 #include "simulation/cell.h"
+#include "tomway_utility.h"
 
 namespace tomway
 {
+    struct cell_coord
+    {
+        uint32_t x;
+        uint32_t y;
+    };
+
+    using live_cell_list = std::vector<cell_coord>;
+
+    // The board is stored one bit per cell, each row padded out to a whole number of 64-bit words. A live count is
+    // kept per row so that enumeration can jump over empty rows as well as empty words.
+    //
+    // Copies are copy-on-write: copying a container shares its storage and the first write to either side gives that
+    // side storage of its own. Snapshots are free until the board changes, and a shared copy can be read from another
+    // thread while the original keeps being written.
     class cell_container
     {
-    public:        
-        class iterator : public std::vector<cell>::iterator {
+    public:
+        using word = uint64_t;
+        static size_t constexpr WORD_BITS = 64;
+        // Largest board a file is allowed to ask for, 512 MB of cells. Sizes read from files are checked against it
+        // before anything is allocated.
+        static size_t constexpr MAX_GRID_SIZE = 1 << 16;
+
+        // Forward iterator over the live cells in [first row, end row), in row-major order
+        class live_cell_iterator
+        {
         public:
-            iterator(std::vector<cell>::iterator const& c);
+            using iterator_category = std::forward_iterator_tag;
+            using value_type = cell_coord;
+            using difference_type = std::ptrdiff_t;
+            using pointer = cell_coord const*;
+            using reference = cell_coord const&;
+
+            live_cell_iterator(cell_container const* cells, size_t row, size_t end_row);
+            reference operator*() const;
+            pointer operator->() const;
+            live_cell_iterator& operator++();
+            live_cell_iterator operator++(int);
+            bool operator==(live_cell_iterator const& rhs) const;
+            bool operator!=(live_cell_iterator const& rhs) const;
+        private:
+            void _advance();
+            void _load_row();
+            cell_container const* _cells;
+            cell_coord _current = {};
+            size_t _end_row;
+            size_t _row;
+            word _word = 0;
+            size_t _word_index = 0;
         };
-        
-        class const_iterator : public std::vector<cell>::const_iterator {
+
+        class live_cell_range
+        {
         public:
-            const_iterator(std::vector<cell>::const_iterator const& c);
+            live_cell_range(cell_container const* cells, size_t first_row, size_t end_row);
+            // Bulk version of iterating the range, appends every live cell to out
+            void append_to(live_cell_list& out) const;
+            live_cell_iterator begin() const;
+            live_cell_iterator end() const;
+            size_t end_row() const;
+            size_t first_row() const;
+            // Splits the range into at most partitions sub-ranges of whole rows with roughly equal live counts
+            std::vector<live_cell_range> partition(size_t partitions) const;
+            size_t population() const;
+        private:
+            cell_container const* _cells;
+            size_t _end_row;
+            size_t _first_row;
         };
 
         explicit cell_container(size_t grid_size);
-        iterator begin();
-        const_iterator begin() const;
+        // Shares other's storage rather than copying it, the grid sizes must match
         void copy_from(cell_container const& other);
-        iterator end();
-        const_iterator end() const;
+        // First column at or after x in row y whose cell is in the given state, or grid_size if there isn't one
+        size_t find_next(size_t y, size_t x, bool alive) const;
         cell get_cell(size_t x, size_t y) const;
         bool get_alive(size_t x, size_t y) const;
-		void randomize();
+        size_t get_population() const;
+        size_t get_row_population(size_t y) const;
+        word get_word(size_t y, size_t word_index) const;
+        live_cell_range live_cells() const;
+        live_cell_range live_cells(size_t first_row, size_t end_row) const;
+        // Gives this container storage of its own if anything else is sharing it. Every write does this, call it
+        // directly ahead of a run of set_alive_unchecked.
+        void prepare_write();
+        void randomize(progress_fn const& progress = nullptr);
         void set_alive(size_t x, size_t y, bool alive);
+        // set_alive without the sharing check, for step kernels. Only valid after prepare_write() with no copies of
+        // this container taken since.
+        void set_alive_unchecked(size_t x, size_t y, bool alive);
+        // Sets length cells starting at x in row y, a word at a time. The run must not go past the end of the row.
+        void set_run(size_t y, size_t x, size_t length, bool alive);
+        // Overwrites 64 cells at once. Bits past the end of the row must be zero.
+        void set_word(size_t y, size_t word_index, word value);
         size_t size() const;
         size_t grid_size() const;
+        size_t words_per_row() const;
+        // The board's words, row-major with words_per_row() to a row. Valid until the next write.
+        word const* words() const;
     private:
-        std::vector<cell> _cells;
+        struct storage
+        {
+            std::vector<uint32_t> row_population;
+            std::vector<word> words;
+        };
+
+        // Gives this container its own copy of the storage if anything else is sharing it
+        void _detach();
         size_t _grid_size;
+        size_t _words_per_row;
+        std::shared_ptr<storage> _storage;
+        // Cached from _storage so reads don't go through the shared pointer
+        uint32_t* _row_population;
+        word* _words;
     };
 }
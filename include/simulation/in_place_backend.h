@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+
+#include "simulation/simulation_backend.h"
+
+namespace tomway
+{
+    // Steps a single board in place instead of ping-ponging between two. Only the rows that have already been
+    // overwritten but are still needed as neighbors are saved: the original top row (the bottom row's wrapped
+    // neighbor) and the original previous row. Peak memory is one board plus three rows.
+    class in_place_backend : public simulation_backend
+    {
+    public:
+        in_place_backend();
+
+        bool get_alive(size_t x, size_t y) const override;
+        uint64_t get_generation() const override;
+        size_t get_grid_size() const override;
+        void get_live_cells(live_cell_list& out) const override;
+        char const* get_name() const override;
+        void load(cell_container const& cells, uint64_t generation) override;
+        void snapshot(cell_container& out) const override;
+        void step(live_cell_list* live_cells) override;
+    private:
+        void _save_row(size_t y, std::vector<uint8_t>& row) const;
+        cell_container _cells;
+        std::vector<uint8_t> _curr_row;
+        std::vector<uint8_t> _first_row;
+        uint64_t _generation = 0;
+        size_t _grid_size = 0;
+        std::vector<uint8_t> _prev_row;
+    };
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "simulation/simulation_backend.h"
+
+namespace tomway
+{
+    // Runs two backends side by side and compares their checksums every generation. The primary backend answers
+    // all queries, the shadow backend only exists to be compared against. The first divergence is logged with the
+    // generation and the first differing cell, after which verification stops so the log isn't flooded.
+    class lockstep_backend : public simulation_backend
+    {
+    public:
+        lockstep_backend(std::unique_ptr<simulation_backend> primary, std::unique_ptr<simulation_backend> shadow);
+
+        bool get_alive(size_t x, size_t y) const override;
+        uint64_t get_generation() const override;
+        size_t get_grid_size() const override;
+        void get_live_cells(live_cell_list& out) const override;
+        char const* get_name() const override;
+        void load(cell_container const& cells, uint64_t generation) override;
+        void snapshot(cell_container& out) const override;
+        void step(live_cell_list* live_cells) override;
+
+        bool has_diverged() const;
+        uint64_t get_divergence_generation() const;
+        simulation_backend const& get_primary() const;
+        simulation_backend const& get_shadow() const;
+    private:
+        void _verify();
+        bool _diverged = false;
+        uint64_t _divergence_generation = 0;
+        std::unique_ptr<simulation_backend> _primary;
+        std::unique_ptr<simulation_backend> _shadow;
+    };
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mapped_file.h"
+#include "simulation/cell_container.h"
+
+namespace tomway
+{
+    // A recording is a header followed by one frame per generation. Keyframes hold the whole board and every other
+    // frame holds the XOR against the frame before it. Both are stored as the board's words with runs of zero words
+    // collapsed to a varint and only the non-zero bytes of the rest kept, which is what makes sparse boards and
+    // slowly changing deltas cheap.
+    struct recording_header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t keyframe_interval;
+        uint64_t grid_size;
+    };
+
+    enum class recording_frame_type : uint32_t { KEYFRAME, DELTA };
+
+    struct recording_frame_header
+    {
+        recording_frame_type type;
+        uint32_t reserved;
+        uint64_t generation;
+        uint64_t payload_size;
+    };
+
+    static_assert(sizeof(recording_header) == 24, "recording_header must match the on-disk layout");
+    static_assert(sizeof(recording_frame_header) == 24, "recording_frame_header must match the on-disk layout");
+
+    // Encodes and writes frames on a background thread so recording never waits on the disk. The game loop hands
+    // over a snapshot per generation. If the writer falls too far behind, snapshots are dropped and the next one is
+    // written as a keyframe so the recording stays consistent around the gap.
+    class recording_writer
+    {
+    public:
+        static uint32_t constexpr KEYFRAME_INTERVAL = 64;
+        static size_t constexpr MAX_PENDING_FRAMES = 16;
+        static uint32_t constexpr VERSION = 1;
+
+        recording_writer() = default;
+        ~recording_writer();
+        recording_writer(recording_writer&) = delete;
+        recording_writer(recording_writer&&) = delete;
+        recording_writer& operator=(recording_writer const&) = delete;
+        recording_writer& operator=(recording_writer const&&) = delete;
+
+        // Writes everything still queued, then stops the thread and closes the file
+        void close();
+        uint64_t get_bytes_written() const;
+        uint64_t get_frames_dropped() const;
+        uint64_t get_frames_written() const;
+        // True once a write has failed, after which nothing more is written and the recording should be stopped
+        bool has_failed() const;
+        bool open(std::string const& path, size_t grid_size);
+        void push(cell_container&& cells, uint64_t generation);
+    private:
+        struct pending_frame
+        {
+            cell_container cells;
+            uint64_t generation;
+            bool keyframe;
+        };
+
+        void _run();
+        void _write(pending_frame& frame);
+
+        std::atomic<uint64_t> _bytes_written { 0 };
+        std::condition_variable _condition;
+        std::atomic<bool> _failed { false };
+        std::ofstream _file;
+        bool _force_keyframe = true;
+        std::atomic<uint64_t> _frames_dropped { 0 };
+        std::atomic<uint64_t> _frames_written { 0 };
+        size_t _grid_size = 0;
+        uint64_t _last_keyframe_generation = 0;
+        std::mutex _mutex;
+        std::vector<uint8_t> _payload;
+        std::deque<pending_frame> _pending;
+        cell_container _previous { 0 };
+        uint64_t _previous_generation = 0;
+        bool _stopping = false;
+        std::thread _thread;
+    };
+
+    // Plays a recording back by decoding frames straight out of a memory mapped file. Seeking decodes the nearest
+    // keyframe at or before the target and applies deltas from there, so nothing is ever re-simulated.
+    class recording_reader
+    {
+    public:
+        recording_reader() = default;
+        ~recording_reader() = default;
+        recording_reader(recording_reader&) = delete;
+        recording_reader(recording_reader&&) = delete;
+        recording_reader& operator=(recording_reader const&) = delete;
+        recording_reader& operator=(recording_reader const&&) = delete;
+
+        cell_container const& get_cells() const;
+        uint64_t get_first_generation() const;
+        uint64_t get_generation() const;
+        uint64_t get_last_generation() const;
+        bool open(std::string const& path);
+        // Moves to the last recorded generation at or before the given one
+        void seek(uint64_t generation);
+        // Moves to the next recorded generation, false at the end of the recording
+        bool step();
+    private:
+        struct frame_entry
+        {
+            uint64_t generation;
+            uint64_t offset;
+            uint64_t payload_size;
+            bool keyframe;
+        };
+
+        bool _apply(size_t index);
+        cell_container _cells { 0 };
+        size_t _current = 0;
+        mapped_file _file;
+        std::vector<frame_entry> _frames;
+    };
+}
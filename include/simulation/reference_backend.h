@@ -0,0 +1,29 @@
+#pragma once
+
+#include "simulation/simulation_backend.h"
+
+namespace tomway
+{
+    // The original double-buffered simulation. Each step reads the old board and writes the new one, then the two
+    // swap. Other backends are verified against this one.
+    class reference_backend : public simulation_backend
+    {
+    public:
+        reference_backend();
+
+        bool get_alive(size_t x, size_t y) const override;
+        uint64_t get_generation() const override;
+        size_t get_grid_size() const override;
+        void get_live_cells(live_cell_list& out) const override;
+        char const* get_name() const override;
+        void load(cell_container const& cells, uint64_t generation) override;
+        void snapshot(cell_container& out) const override;
+        void step(live_cell_list* live_cells) override;
+    private:
+        inline size_t wrap(long long int val) const;
+        uint64_t _generation = 0;
+        size_t _grid_size = 0;
+        unsigned int _index = 0;
+        cell_container _cells[2];
+    };
+}
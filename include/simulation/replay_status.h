@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+namespace tomway
+{
+    struct replay_status
+    {
+        bool active;
+        uint64_t first_generation;
+        uint64_t last_generation;
+        uint64_t generation;
+    };
+}
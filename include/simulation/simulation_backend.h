@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "simulation/cell_container.h"
+
+namespace tomway
+{
+    enum class simulation_backend_type { REFERENCE, IN_PLACE };
+
+    struct simulation_backend_config
+    {
+        simulation_backend_type backend = simulation_backend_type::REFERENCE;
+        bool lockstep_verify = false;
+        simulation_backend_type verify_backend = simulation_backend_type::REFERENCE;
+    };
+
+    // A simulation backend owns the board state and knows how to step it. Everything outside the simulation talks
+    // to the board through this interface so that faster engines can be swapped in at runtime and checked against
+    // the reference implementation with the lockstep backend.
+    class simulation_backend
+    {
+    public:
+        simulation_backend() = default;
+        virtual ~simulation_backend() = default;
+        simulation_backend(simulation_backend&) = delete;
+        simulation_backend(simulation_backend&&) = delete;
+        simulation_backend& operator=(simulation_backend const&) = delete;
+        simulation_backend& operator=(simulation_backend const&&) = delete;
+
+        // Checksum of the current generation. Backends must enumerate live cells in row-major order for this to be
+        // comparable between implementations.
+        uint64_t checksum() const;
+        static uint64_t checksum(size_t grid_size, live_cell_list const& live_cells);
+
+        virtual bool get_alive(size_t x, size_t y) const = 0;
+        virtual uint64_t get_generation() const = 0;
+        virtual size_t get_grid_size() const = 0;
+        // Appends every live cell of the current generation to out in row-major order
+        virtual void get_live_cells(live_cell_list& out) const = 0;
+        virtual char const* get_name() const = 0;
+        virtual void load(cell_container const& cells, uint64_t generation) = 0;
+        virtual void snapshot(cell_container& out) const = 0;
+        // Steps one generation. When live_cells isn't null it is cleared and filled with the new generation's live
+        // cells in row-major order while they are computed, so consumers never have to rescan the board.
+        virtual void step(live_cell_list* live_cells) = 0;
+    };
+
+    char const* to_string(simulation_backend_type type);
+    bool to_simulation_backend_type(std::string const& name, simulation_backend_type& type);
+    std::unique_ptr<simulation_backend> make_simulation_backend(simulation_backend_type type);
+    std::unique_ptr<simulation_backend> make_simulation_backend(simulation_backend_config const& config);
+}
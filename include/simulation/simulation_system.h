@@ -1,11 +1,18 @@
 #pragma once
 
+#include <memory>
 #include <string>
 
+#include "background_job.h"
 #include "simulation/cell_container.h"
+#include "simulation/recording.h"
+#include "simulation/replay_status.h"
+#include "simulation/simulation_backend.h"
 
 namespace tomway
 {
+    enum class board_job_type { NONE, LOAD, SAVE };
+
     class simulation_system
     {
     public:
@@ -15,18 +22,76 @@ namespace tomway
         simulation_system(simulation_system&&) = delete;
         simulation_system& operator=(simulation_system const&) = delete;
         simulation_system& operator=(simulation_system const&&) = delete;
-        
-        bool deserialize(std::string const& json);
+
+        void close_replay();
+        simulation_backend const* get_backend() const;
+        simulation_backend_config const& get_backend_config() const;
         size_t get_cell_count() const;
-        cell_container const* get_current_cells() const;
+        float get_job_progress() const;
+        board_job_type get_job_type() const;
+        live_cell_list const& get_live_cells() const;
+        replay_status get_replay_status() const;
+        bool is_recording() const;
+        bool is_replaying() const;
+        // Loads a binary board file, a JSON save, or an RLE pattern. RLE patterns don't carry a board size, so they
+        // are centered on a board of at least min_grid_size.
+        bool load_file(std::string const& path, size_t min_grid_size = 0);
+        // load_file on a background thread. The board isn't replaced until update_job sees the job finish, so the
+        // current one can still be drawn in the meantime. Fails if another load or save is still running.
+        bool load_file_async(std::string const& path, size_t min_grid_size = 0);
         void new_frame();
-        std::string serialize() const;
+        // Replaces the board with the first generation of a recording. Stepping is done with step_replay until the
+        // replay is closed.
+        bool open_replay(std::string const& path);
+        // Pastes an RLE pattern centered on (center_x, center_y) without resetting the generation
+        bool paste_file(std::string const& path, size_t center_x, size_t center_y);
+        // Saves JSON or RLE when the path ends in .json or .rle, and a binary board file otherwise
+        bool save_file(std::string const& path) const;
+        // Saves a copy-on-write snapshot of the current generation on a background thread, the simulation can keep
+        // stepping while it is written. Fails if another load or save is still running.
+        bool save_file_async(std::string const& path);
+        void seek_replay(uint64_t generation);
+        void set_backend(simulation_backend_config const& config);
         void start(size_t grid_size);
+        // start with the random board filled in on a background thread, finished by update_job like a load
+        bool start_async(size_t grid_size);
+        // Records every generation from here on until stop_recording, starting with the current one
+        bool start_recording(std::string const& path);
+        // False once the last recorded generation is reached
+        bool step_replay();
         void step_simulation();
+        void stop_recording();
+        // Call once a frame. Returns true on the frame a background load or save finishes, with success set to
+        // whether it worked. A finished load has replaced the board by the time this returns.
+        bool update_job(bool& success);
     private:
-        inline size_t wrap(long long int val) const;
-        size_t _grid_size;
-        unsigned int _index = 0;
-        cell_container _cells[2];
+        void _apply_loaded(cell_container const& cells, uint64_t generation);
+        void _load_replay_frame();
+        static bool _read_board(
+            std::string const& path,
+            size_t min_grid_size,
+            cell_container& cells,
+            uint64_t& generation,
+            progress_fn const& progress);
+        bool _start_job(board_job_type type, background_job::work_fn work);
+        static bool _write_board(
+            std::string const& path,
+            cell_container const& cells,
+            uint64_t generation,
+            progress_fn const& progress);
+        // Must be declared before _backend, the constructor builds the backend from it
+        simulation_backend_config _backend_config;
+        std::unique_ptr<simulation_backend> _backend;
+        // Filled by the step kernel, or lazily by enumerating the board after a load
+        mutable live_cell_list _live_cells;
+        mutable bool _live_cells_valid = false;
+        std::unique_ptr<recording_writer> _recorder;
+        std::unique_ptr<recording_reader> _replay;
+        // Where a background load puts the board, owned by the job thread while it runs
+        cell_container _job_cells = cell_container(0);
+        uint64_t _job_generation = 0;
+        board_job_type _job_type = board_job_type::NONE;
+        // Declared last so the job is joined before anything it uses is destroyed
+        background_job _job;
     };
-}
\ No newline at end of file
+}
@@ -5,6 +5,14 @@
 
 namespace tomway
 {
+    struct frame_pacing_config
+    {
+        // Stop drawing while nothing changes and wait for events or the next tick instead
+        bool idle = true;
+        // 0 for no cap
+        float max_fps = 240.0f;
+    };
+
     class time_system
     {
     public:
@@ -16,13 +24,30 @@ namespace tomway
         time_system& operator=(time_system const&&) = delete;
         
         bool get_new_tick() const;
+        // Seconds until new_frame next reports a tick
+        float get_time_to_next_tick() const;
+        // Waits until the frame that started in the last new_frame has taken 1 / max fps. Sleeps while a sleep is sure
+        // to wake up in time and spins for the rest, so the cap is kept to well under a millisecond.
+        void limit_frame_rate();
+        // The loop slept on purpose, the time since the last frame still counts toward ticks but not the next delta
+        void mark_idle();
         float new_frame();
+        void set_max_fps(float max_fps);
     private:
         uint64_t _frame_accumulator = 0;
         float _frame_timer = 0;
+        bool _idle = false;
         std::chrono::high_resolution_clock::time_point _last_frame_start_time;
         uint64_t _last_sec_frames = 0;
+        float _max_fps = 0;
         bool _new_tick = false;
+        // How long a 1 ms sleep really takes, the running mean and variance and the mean plus a standard deviation.
+        // Seeded with one sample a little over 1 ms, which has to stay under a frame at the highest frame rates or
+        // the first sleep never happens and the estimate never learns anything.
+        uint64_t _sleep_count = 1;
+        double _sleep_estimate = 0.0015;
+        double _sleep_m2 = 0;
+        double _sleep_mean = 0.0015;
         std::chrono::high_resolution_clock::time_point _start_time;
         float _tick_timer = 0;
         float _ticks_per_sec;
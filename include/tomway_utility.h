@@ -1,17 +1,47 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <stdexcept>
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 #define LOG_INFO(msg, ...) SDL_Log(msg, ##__VA_ARGS__)
 #define LOG_ERROR(msg, ...) SDL_LogError(0, msg, ##__VA_ARGS__)
 
 namespace tomway {
+	// Reports how far along a long running operation is, from 0 to 1
+	using progress_fn = std::function<void(float)>;
+
 	class not_implemented_exception : public std::logic_error {
 	public:
 		not_implemented_exception();
 	};
 
+	// Index of the lowest set bit, value must not be zero
+	inline unsigned count_trailing_zeros(uint64_t const value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, value);
+		return static_cast<unsigned>(index);
+#else
+		return static_cast<unsigned>(__builtin_ctzll(value));
+#endif
+	}
+
+	inline unsigned count_set_bits(uint64_t const value)
+	{
+#ifdef _MSC_VER
+		return static_cast<unsigned>(__popcnt64(value));
+#else
+		return static_cast<unsigned>(__builtin_popcountll(value));
+#endif
+	}
+
 	template<typename ... Args>
 	std::string string_format( const std::string& format, Args ... args )
 	{
@@ -5,6 +5,7 @@
 #include "window_system.h"
 #include "audio/audio.h"
 #include "audio/audio_config.h"
+#include "simulation/replay_status.h"
 #include "simulation/sim_config.h"
 
 namespace tomway
@@ -15,6 +16,8 @@ namespace tomway
     using set_sim_config_fn = void(*)(const sim_config&);
     using menu_start_callback = std::function<void()>;
     using menu_exit_callback = std::function<void()>;
+    using get_replay_status_fn = std::function<replay_status()>;
+    using seek_replay_fn = std::function<void(uint64_t)>;
 
     class ui_system
     {
@@ -32,12 +35,15 @@ namespace tomway
             menu_start_callback const& menu_start_callback,
             menu_exit_callback const& menu_exit_callback);
         
+        static void bind_replay_callbacks(get_replay_status_fn const& get_status_fn, seek_replay_fn const& seek_fn);
         static void bind_sim_config(get_sim_config_fn get_config_fn, set_sim_config_fn set_config_fn);
         static void check_system_ready();
         static void add_debug_text(std::string const& text);
         static void hide_loading_screen();
         static void hide_menu();
         static bool is_menu_open();
+        // Fraction of the load that's done, shown on the loading screen until it is hidden
+        static void set_loading_progress(float progress);
         static void show_loading_screen();
         static void show_menu();
         static void toggle_menu();
@@ -53,9 +59,12 @@ namespace tomway
         set_audio_config_fn _audio_config_set_fn;
         audio _button_audio;
         std::vector<std::string> _debug_texts;
+        float _loading_progress = 0.0f;
         bool _loading_screen = false;
         menu_exit_callback _menu_exit_callback;
         menu_start_callback _menu_start_callback;
+        get_replay_status_fn _replay_status_get_fn;
+        seek_replay_fn _replay_seek_fn;
         get_sim_config_fn _sim_config_get_fn;
         set_sim_config_fn _sim_config_set_fn;
         
@@ -66,6 +75,7 @@ namespace tomway
         void _draw_audio_menu();
         void _draw_main_menu();
         void _draw_menu();
+        void _draw_replay();
     };
 }
 
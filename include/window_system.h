@@ -31,6 +31,8 @@ namespace tomway {
 		void register_minimized_callback(std::function<void()> const& callback);
 		void set_mouse_visible(bool mouse_visible);
 		void toggle_mouse_visible();
+		// Blocks until there's an event or timeout_ms passes. The events are left for handle_events.
+		bool wait_for_events(int timeout_ms);
 		void wait_while_minimized();
 	private:
 		std::vector<std::function<void()>> _framebuffer_resize_callbacks;
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace tomway
+{
+    // Threads that are started once and then reused for work that gets split up every frame or generation, so the
+    // split doesn't pay for creating and joining threads each time. The thread calling run works through parts too.
+    class worker_pool
+    {
+    public:
+        using part_fn = std::function<void(size_t part)>;
+
+        // One thread fewer than the hardware has, the thread calling run makes up the last one
+        worker_pool();
+        ~worker_pool();
+        worker_pool(worker_pool&) = delete;
+        worker_pool(worker_pool&&) = delete;
+        worker_pool& operator=(worker_pool const&) = delete;
+        worker_pool& operator=(worker_pool const&&) = delete;
+
+        // Threads that parts run on, including the one calling run
+        size_t get_concurrency() const;
+        // Calls work once for every part in [0, part_count) and returns when all of them have finished. Parts are
+        // taken in order by whichever thread is free. Only one run at a time, from one thread.
+        void run(size_t part_count, part_fn const& work);
+    private:
+        void _run_parts();
+        void _work();
+        size_t _active = 0;
+        uint64_t _batch = 0;
+        std::condition_variable _done_condition;
+        std::mutex _mutex;
+        std::atomic<size_t> _next_part = { 0 };
+        size_t _part_count = 0;
+        bool _stopping = false;
+        std::vector<std::thread> _threads;
+        part_fn const* _work_fn = nullptr;
+        std::condition_variable _work_condition;
+    };
+}
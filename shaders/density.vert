@@ -0,0 +1,31 @@
+# version 450
+
+layout(binding = 0) uniform Transform {
+    mat4 model;
+    mat4 view;
+    mat4 projection;
+} transform;
+
+// One flat quad per block of the density pyramid, drawn in place of the cubes of a distant tile
+layout(location = 0) in vec3 inMin;
+layout(location = 1) in float inCoverage;
+layout(location = 2) in vec2 inSize;
+
+layout(location = 0) out vec3 fragColor;
+
+// Same as the cubes and the background's darkest corner in cell_geometry
+const vec3 COLOR_RED = vec3(1.0, 0.0, 0.0);
+const vec3 COLOR_DG = vec3(0.0, 0.025, 0.0);
+
+void main() {
+    // Same winding as the background quad so it faces up
+    vec2 corners[6] = vec2[](vec2(0.0, 0.0), vec2(1.0, 1.0), vec2(0.0, 1.0), vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(1.0, 1.0));
+    vec3 position = inMin + vec3(corners[gl_VertexIndex] * inSize, 0.0);
+    gl_Position = transform.projection * transform.view * transform.model * vec4(position, 1.0);
+
+    // Blending the colors by how much the cubes' tops would cover gives the block's average as seen from afar
+    vec3 color = mix(COLOR_DG, COLOR_RED, inCoverage);
+    float cosTheta = clamp(dot(vec3(0.0, 0.0, 1.0), normalize(vec3(-1, 0.65, 0.3))), 0, 1);
+    vec3 ambient_light = vec3(0.025f);
+    fragColor = color * ambient_light + color * vec3(1.0f, 1.0f, 1.0f) * cosTheta;
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+# version 450
+
+layout(binding = 0) uniform Transform {
+    mat4 model;
+    mat4 view;
+    mat4 projection;
+} transform;
+
+// Where cell (0, 0) sits, how far apart cells are and the size of a mesh position step. The instance data is only
+// the cell's coordinates.
+layout(push_constant) uniform CellGrid {
+    vec2 origin;
+    float spacing;
+    float positionScale;
+} grid;
+
+// x, y, z position steps, then the normal index in the low byte and the color index in the high byte
+layout(location = 0) in uvec4 inVertex;
+layout(location = 1) in uvec2 inCell;
+
+layout(location = 0) out vec3 fragColor;
+
+// In cell_face order
+const vec3 NORMALS[6] = vec3[](
+    vec3(0.0, 0.0, 1.0), vec3(0.0, 0.0, -1.0), vec3(0.0, -1.0, 0.0),
+    vec3(0.0, 1.0, 0.0), vec3(-1.0, 0.0, 0.0), vec3(1.0, 0.0, 0.0));
+
+// COLOR_RED, COLOR_LG, COLOR_DG, COLOR_LB, COLOR_DB in cell_geometry
+const vec3 COLORS[5] = vec3[](
+    vec3(1.0, 0.0, 0.0), vec3(0.0, 0.085, 0.0), vec3(0.0, 0.025, 0.0), vec3(0.0, 0.0, 0.085), vec3(0.0, 0.0, 0.025));
+
+void main() {
+    // Slots whose cell died are left in place until they're reused, every vertex lands on one point outside the clip
+    // volume so nothing is drawn
+    if (inCell.x == 0xFFFFFFFFu) {
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        fragColor = vec3(0.0);
+        return;
+    }
+
+    vec3 position = vec3(grid.origin + vec2(inCell) * grid.spacing, 0.0) + vec3(inVertex.xyz) * grid.positionScale;
+    vec3 normal = NORMALS[inVertex.w & 0xFFu];
+    vec3 color = COLORS[inVertex.w >> 8];
+    gl_Position = transform.projection * transform.view * transform.model * vec4(position, 1.0);
+    float cosTheta = clamp(dot(normal, normalize(vec3(-1, 0.65, 0.3))), 0, 1);
+    vec3 ambient_light = vec3(0.025f);
+    fragColor = color * ambient_light + color * vec3(1.0f, 1.0f, 1.0f) * cosTheta; 
+}
\ No newline at end of file
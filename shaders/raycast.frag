@@ -0,0 +1,130 @@
+# version 450
+
+// Walks each pixel's ray through the board's grid (a 2D DDA) and shades the first raised cell it hits, so the cost
+// of a frame depends on the resolution rather than how many cells are alive
+
+layout(std430, binding = 0) readonly buffer Board {
+    uint bits[];
+} board;
+
+layout(push_constant) uniform Raycast {
+    mat4 inverseViewProjection;
+    vec4 camera;
+    vec2 gridOrigin;
+    vec2 viewportSize;
+    float spacing;
+    uint gridSize;
+    uint uintsPerRow;
+    float cellWidth;
+    float cellHeight;
+    // A ray inside the slab crosses at most 2 * gridSize + 2 cells, so this bounds the walk whatever the angle
+    uint maxSteps;
+} raycast;
+
+layout(location = 0) out vec4 outColor;
+
+// Same as the background quad in cell_geometry
+const vec3 COLOR_RED = vec3(1.0, 0.0, 0.0);
+const vec3 COLOR_LG = vec3(0.0, 0.085, 0.0);
+const vec3 COLOR_DG = vec3(0.0, 0.025, 0.0);
+const vec3 COLOR_LB = vec3(0.0, 0.0, 0.085);
+const vec3 COLOR_DB = vec3(0.0, 0.0, 0.025);
+
+// Same lighting as shader.vert
+vec3 shade(vec3 color, vec3 normal) {
+    float cosTheta = clamp(dot(normal, normalize(vec3(-1, 0.65, 0.3))), 0, 1);
+    vec3 ambient_light = vec3(0.025f);
+    return color * ambient_light + color * vec3(1.0f, 1.0f, 1.0f) * cosTheta;
+}
+
+bool isAlive(ivec2 cell) {
+    uint index = uint(cell.y) * raycast.uintsPerRow + uint(cell.x) / 32u;
+    return (board.bits[index] >> (uint(cell.x) % 32u) & 1u) != 0u;
+}
+
+// Slab test, returns the entry distance and the normal of the face that was entered, or a negative distance on a miss
+float intersectBox(vec3 origin, vec3 invDir, vec3 boxMin, vec3 boxMax, out vec3 normal) {
+    vec3 t0 = (boxMin - origin) * invDir;
+    vec3 t1 = (boxMax - origin) * invDir;
+    vec3 tNear = min(t0, t1);
+    vec3 tFar = max(t0, t1);
+    float enter = max(max(tNear.x, tNear.y), tNear.z);
+    float exit = min(min(tFar.x, tFar.y), tFar.z);
+    if (enter > exit || exit < 0.0) return -1.0;
+
+    if (enter == tNear.x) normal = vec3(-sign(invDir.x), 0.0, 0.0);
+    else if (enter == tNear.y) normal = vec3(0.0, -sign(invDir.y), 0.0);
+    else normal = vec3(0.0, 0.0, -sign(invDir.z));
+
+    return max(enter, 0.0);
+}
+
+void main() {
+    vec2 ndc = gl_FragCoord.xy / raycast.viewportSize * 2.0 - 1.0;
+    vec4 target = raycast.inverseViewProjection * vec4(ndc, 0.5, 1.0);
+    vec3 origin = raycast.camera.xyz;
+    vec3 dir = normalize(target.xyz / target.w - origin);
+    // Axis aligned rays divide by zero here, the infinities work out in the comparisons below
+    vec3 invDir = 1.0 / dir;
+
+    float boardSize = float(raycast.gridSize) * raycast.spacing;
+    vec3 boardMin = vec3(raycast.gridOrigin, 0.0);
+    vec3 boardMax = vec3(raycast.gridOrigin + boardSize, raycast.cellHeight);
+    vec3 normal;
+    float t = intersectBox(origin, invDir, boardMin, boardMax, normal);
+
+    if (t < 0.0) {
+        outColor = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
+    // Walk the cells the ray crosses while it's inside the slab the cubes stand in
+    vec3 tFar3 = max((boardMin - origin) * invDir, (boardMax - origin) * invDir);
+    float tExit = min(min(tFar3.x, tFar3.y), tFar3.z);
+    vec2 start = ((origin + dir * t).xy - raycast.gridOrigin) / raycast.spacing;
+    ivec2 cell = clamp(ivec2(floor(start)), ivec2(0), ivec2(int(raycast.gridSize) - 1));
+    ivec2 step = ivec2(sign(dir.xy));
+    vec2 tDelta = abs(raycast.spacing * invDir.xy);
+    vec2 nextBoundary = raycast.gridOrigin + (vec2(cell) + max(vec2(step), vec2(0.0))) * raycast.spacing;
+    vec2 tMax = (nextBoundary - origin.xy) * invDir.xy;
+
+    for (uint i = 0u; i < raycast.maxSteps; i++) {
+        if (isAlive(cell)) {
+            vec3 cellMin = vec3(raycast.gridOrigin + vec2(cell) * raycast.spacing, 0.0);
+            vec3 cellMax = cellMin + vec3(raycast.cellWidth, raycast.cellWidth, raycast.cellHeight);
+            float hit = intersectBox(origin, invDir, cellMin, cellMax, normal);
+
+            if (hit >= 0.0) {
+                outColor = vec4(shade(COLOR_RED, normal), 1.0);
+                return;
+            }
+        }
+
+        if (tMax.x < tMax.y) {
+            if (tMax.x > tExit) break;
+            cell.x += step.x;
+            tMax.x += tDelta.x;
+        }
+        else {
+            if (tMax.y > tExit) break;
+            cell.y += step.y;
+            tMax.y += tDelta.y;
+        }
+
+        if (any(lessThan(cell, ivec2(0))) || any(greaterThanEqual(cell, ivec2(raycast.gridSize)))) break;
+    }
+
+    // Nothing in the way, so the ray lands on the background if it's heading down onto the board
+    if (origin.z > 0.0 && dir.z < 0.0) {
+        vec2 ground = (origin + dir * (-origin.z / dir.z)).xy;
+        vec2 uv = (ground - raycast.gridOrigin) / (boardSize - (raycast.spacing - raycast.cellWidth));
+
+        if (all(greaterThanEqual(uv, vec2(0.0))) && all(lessThanEqual(uv, vec2(1.0)))) {
+            vec3 color = mix(mix(COLOR_LG, COLOR_LB, uv.x), mix(COLOR_DG, COLOR_DB, uv.x), uv.y);
+            outColor = vec4(shade(color, vec3(0.0, 0.0, 1.0)), 1.0);
+            return;
+        }
+    }
+
+    outColor = vec4(0.0, 0.0, 0.0, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,7 @@
+# version 450
+
+// One triangle that covers the whole screen, the fragment shader does the rest
+void main() {
+    vec2 positions[3] = vec2[](vec2(-1.0, -1.0), vec2(3.0, -1.0), vec2(-1.0, 3.0));
+    gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+}
\ No newline at end of file
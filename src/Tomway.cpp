@@ -1,13 +1,111 @@
 ﻿// tomway.cpp : Defines the entry point for the application.
 
+#include <cstdlib>
+
 #include "tomway.h"
 #include "engine.h"
+#include "tomway_utility.h"
 
 size_t constexpr GRID_SIZE = 100;
 
+// Backends are picked on the command line:
+//   --backend=<name>  simulation backend to run
+//   --verify=<name>   run <name> in lockstep with the main backend and report the first divergence
+static tomway::simulation_backend_config parse_backend_config(int argc, char* argv[])
+{
+	tomway::simulation_backend_config config;
+	std::string const backend_arg = "--backend=";
+	std::string const verify_arg = "--verify=";
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string const arg = argv[i];
+
+		if (arg.compare(0, backend_arg.size(), backend_arg) == 0)
+		{
+			if (not tomway::to_simulation_backend_type(arg.substr(backend_arg.size()), config.backend))
+			{
+				LOG_ERROR("Unknown simulation backend: %s", arg.c_str());
+			}
+		}
+		else if (arg.compare(0, verify_arg.size(), verify_arg) == 0)
+		{
+			config.lockstep_verify = tomway::to_simulation_backend_type(
+				arg.substr(verify_arg.size()),
+				config.verify_backend);
+
+			if (not config.lockstep_verify)
+			{
+				LOG_ERROR("Unknown verification backend: %s", arg.c_str());
+			}
+		}
+	}
+
+	return config;
+}
+
+//   --renderer=<name>  how the cells are drawn, see render_mode.h
+static tomway::render_mode parse_render_mode(int argc, char* argv[])
+{
+	tomway::render_mode mode = tomway::render_mode::INSTANCED;
+	std::string const renderer_arg = "--renderer=";
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string const arg = argv[i];
+
+		if (arg.compare(0, renderer_arg.size(), renderer_arg) == 0
+			and not tomway::to_render_mode(arg.substr(renderer_arg.size()), mode))
+		{
+			LOG_ERROR("Unknown renderer: %s", arg.c_str());
+		}
+	}
+
+	return mode;
+}
+
+// Frame pacing outside of PERF builds:
+//   --max-fps=<n>  cap on the frame rate while there's something to draw, 0 for none
+//   --no-idle      keep drawing every frame when nothing has changed
+static tomway::frame_pacing_config parse_frame_pacing_config(int argc, char* argv[])
+{
+	tomway::frame_pacing_config config;
+	std::string const max_fps_arg = "--max-fps=";
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string const arg = argv[i];
+
+		if (arg.compare(0, max_fps_arg.size(), max_fps_arg) == 0)
+		{
+			char* end = nullptr;
+			float const max_fps = std::strtof(arg.c_str() + max_fps_arg.size(), &end);
+
+			if (*end != '\0' or max_fps < 0)
+			{
+				LOG_ERROR("Invalid frame rate cap: %s", arg.c_str());
+				continue;
+			}
+
+			config.max_fps = max_fps;
+		}
+		else if (arg == "--no-idle")
+		{
+			config.idle = false;
+		}
+	}
+
+	return config;
+}
+
 int main(int argc, char* argv[])
 {
-	tomway::engine engine(GRID_SIZE);
+	tomway::engine engine(
+		GRID_SIZE,
+		parse_backend_config(argc, argv),
+		parse_render_mode(argc, argv),
+		parse_frame_pacing_config(argc, argv));
+
 	engine.run();
 	exit(0);
 }
\ No newline at end of file
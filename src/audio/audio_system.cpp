@@ -3,6 +3,7 @@
 #include <memory>
 #include <stdexcept>
 
+#include "SDL.h"
 #include "soloud_wav.h"
 #include "soloud_wavstream.h"
 #include "Tracy.hpp"
@@ -12,19 +13,23 @@ tomway::audio_system* tomway::audio_system::_inst = nullptr;
 tomway::audio_system::audio_system()
     : _group_volumes({{ channel_group::MUSIC, 1.0f}, { channel_group::SFX, 1.0f }})
 {
-    _soloud.init();
+    // SDL's subsystems have to be initialized on the main thread, the device itself can be opened on any
+    SDL_InitSubSystem(SDL_INIT_AUDIO);
+    _init_thread = std::thread([this] { _soloud.init(); });
     _inst = this;
 }
 
 tomway::audio_system::~audio_system()
 {
     _inst = nullptr;
+    if (_init_thread.joinable()) _init_thread.join();
     _soloud.deinit();
 }
 
 void tomway::audio_system::check_system_ready()
 {
     if (not _inst) throw std::runtime_error("Audio system not available");
+    if (_inst->_init_thread.joinable()) _inst->_init_thread.join();
 }
 
 void tomway::audio_system::fade(channel& channel, float target, float time)
@@ -49,8 +54,6 @@ float tomway::audio_system::get_volume(channel_group channel_group)
 
 tomway::audio tomway::audio_system::load_file(std::string const& path)
 {
-    check_system_ready();
-    
     auto const wav = std::make_shared<SoLoud::Wav>();
     wav->load(path.c_str());
     audio audio;
@@ -60,8 +63,6 @@ tomway::audio tomway::audio_system::load_file(std::string const& path)
 
 tomway::audio tomway::audio_system::stream_file(std::string const& path)
 {
-    check_system_ready();
-    
     auto const wav_stream = std::make_shared<SoLoud::WavStream>();
     wav_stream->load(path.c_str());
     audio audio;
@@ -134,6 +135,8 @@ void tomway::audio_system::set_global_volume(float global_vol)
 
 tomway::audio_config tomway::audio_system::get_audio_config()
 {
+    check_system_ready();
+
     return {
         _inst->_soloud.getGlobalVolume(),
         _inst->_group_volumes[channel_group::MUSIC],
@@ -143,6 +146,7 @@ tomway::audio_config tomway::audio_system::get_audio_config()
 
 void tomway::audio_system::set_audio_config(audio_config audio_config)
 {
+    check_system_ready();
     _inst->_soloud.setGlobalVolume(audio_config.global_volume);
     set_volume(channel_group::MUSIC, audio_config.music_volume);
     set_volume(channel_group::SFX, audio_config.sfx_volume);
@@ -0,0 +1,46 @@
+#include "background_job.h"
+
+tomway::background_job::~background_job()
+{
+    if (_thread.joinable()) _thread.join();
+}
+
+bool tomway::background_job::finish()
+{
+    if (_thread.joinable()) _thread.join();
+    return _result;
+}
+
+float tomway::background_job::get_progress() const
+{
+    return _progress.load(std::memory_order_relaxed);
+}
+
+bool tomway::background_job::is_done() const
+{
+    return _thread.joinable() and _done.load(std::memory_order_acquire);
+}
+
+bool tomway::background_job::is_running() const
+{
+    return _thread.joinable();
+}
+
+bool tomway::background_job::start(work_fn work)
+{
+    if (_thread.joinable()) return false;
+
+    _done.store(false, std::memory_order_relaxed);
+    _progress.store(0.0f, std::memory_order_relaxed);
+    _result = false;
+
+    _thread = std::thread([this, work]
+    {
+        progress_fn const progress = [this](float const value) { _progress.store(value, std::memory_order_relaxed); };
+        _result = work(progress);
+        _progress.store(1.0f, std::memory_order_relaxed);
+        _done.store(true, std::memory_order_release);
+    });
+
+    return true;
+}
@@ -1,28 +1,47 @@
 #include "engine.h"
 
-#include <fstream>
+#include <algorithm>
+#include <cmath>
 
 #include "nfd.h"
 #include "tomway_utility.h"
 #include "Tracy.hpp"
 
-tomway::engine::engine(size_t const& grid_size)
+tomway::engine::engine(
+	size_t const& grid_size,
+	simulation_backend_config const& backend_config,
+	render_mode const renderer,
+	frame_pacing_config const& frame_pacing)
 	: _camera_controller({0.0f, 0.0f, grid_size >= 1000.0f ? 990.0f : grid_size}, 90.0f, 0.0f),
-	_grid_size(grid_size)
+	_grid_size(grid_size),
+	_frame_pacing(frame_pacing)
 {
-    
+	_start_asset_job();
+	_render_system = std::make_unique<render_system>(_window_system, _cell_geometry_generator, _worker_pool);
+	_simulation_system.set_backend(backend_config);
+	_render_system->set_render_mode(renderer);
+#ifdef PERF
+	// Profiling runs draw every frame as fast as they can
+	_frame_pacing = { false, 0.0f };
+#endif
+	_time_system.set_max_fps(_frame_pacing.max_fps);
 }
 
 void tomway::engine::run()
 {
 	ui_system::bind_menu_callbacks([this] { _start = true; }, [this] { _exit_loop = true; });
+
+	ui_system::bind_replay_callbacks(
+		[this] { return _simulation_system.get_replay_status(); },
+		[this](uint64_t const generation)
+		{
+			_simulation_system.seek_replay(generation);
+			_cell_geometry_generator.bind_cells(_simulation_system.get_backend(), &_simulation_system.get_live_cells());
+		});
 	
-	_music_audio = audio_system::stream_file("assets/audio/HoliznaCC0 - Cosmic Waves.mp3");
+	_asset_job.finish();
 	_music_channel = audio_system::play(_music_audio, tomway::channel_group::MUSIC, 0);
 	audio_system::fade(_music_channel, 0.2f, 60);
-	
-	_button_audio = audio_system::load_file("assets/audio/click5.ogg");
-	_iteration_audio = audio_system::load_file("assets/audio/bong_001.ogg");
 
 #ifdef PERF
 	_load_perf();
@@ -33,13 +52,16 @@ void tomway::engine::run()
 		ZoneScopedN("SDL_main | game loop");
 		_ui_system.new_frame();
 		auto window_events = _window_system.handle_events();
-		_render_system.new_frame();
+		_render_system->new_frame();
 		_window_system.get_vulkan_framebuffer_size(_width, _height);
 		_audio_system.new_frame();
 		_input_system.new_frame();
 		_input_system.process_events(window_events);
 		_delta = _time_system.new_frame();
 		_simulation_system.new_frame();
+		_update_job();
+		// Nothing is allowed to touch the board while a new one is being loaded over it
+		bool const board_loading = _simulation_system.get_job_type() == board_job_type::LOAD;
 		
 		if (input_system::btn_just_up(input_button::SPACE)) _step = true;
 		if (input_system::btn_just_up(input_button::L)) _locked = !_locked;
@@ -52,23 +74,37 @@ void tomway::engine::run()
 		}
 
 		if (input_system::btn_just_up(input_button::F2)) _save_sim();
-		// _load_sim must happen before the P handler, _load_file, and _start_sim so that the loading screen is drawn
-		if (_loading) _load_sim();
+		if (input_system::btn_just_up(input_button::F7)) _render_system->set_render_mode(next_render_mode(_render_system->get_render_mode()));
+		if (input_system::btn_just_up(input_button::F8)) _render_system->export_gpu_timings("gpu_timings.csv");
+		// _load_sim must happen before the P handler, _load_file, and _start_sim so that the loading screen is drawn.
+		// A load asked for during a save waits for the save to finish.
+		if (_loading and _simulation_system.get_job_type() == board_job_type::NONE) _load_sim();
 		
-		if (input_system::btn_just_up(input_button::P))
+		if (input_system::btn_just_up(input_button::P) and not board_loading)
 		{
 			ui_system::show_loading_screen();
 			_new_grid_size = 2500;
 			_loading = true;
 		}
 		
-		if (input_system::btn_just_up(input_button::F3)) _load_file();
-		if (_start) _start_sim();
+		if (not board_loading)
+		{
+			if (input_system::btn_just_up(input_button::F3)) _load_file();
+			if (input_system::btn_just_up(input_button::F4)) _paste_file();
+			if (input_system::btn_just_up(input_button::F5)) _toggle_recording();
+			if (input_system::btn_just_up(input_button::F6)) _open_replay();
+			if (_start) _start_sim();
+		}
 		
-		if (not ui_system::is_menu_open())
+		if (not ui_system::is_menu_open() and not board_loading)
 		{
 			if (input_system::btn_just_up(input_button::R)) _reset_sim();
-			if ((!_locked && _time_system.get_new_tick()) || _step) _step_sim();
+			// Replays advance a generation per rendered frame, there's nothing to simulate
+			if (_simulation_system.is_replaying())
+			{
+				if (!_locked || _step) _step_replay();
+			}
+			else if ((!_locked && _time_system.get_new_tick()) || _step) _step_sim();
 			if (not _window_system.get_mouse_visible()) _camera_controller.update(_delta);
 		}
 
@@ -78,8 +114,24 @@ void tomway::engine::run()
 		transform.view = _camera_controller.get_view_transform();
 		transform.projection = _camera_controller.get_projection_transform(_width, _height);
 		_ui_system.build_ui();
-		_render_system.draw_frame(transform);
-		
+		_render_system->draw_frame(transform);
+
+		if (not _first_frame_drawn)
+		{
+			auto const elapsed = std::chrono::steady_clock::now() - _start_time;
+			LOG_INFO("Time to first frame: %.1f ms", std::chrono::duration<double, std::milli>(elapsed).count());
+			_first_frame_drawn = true;
+		}
+
+		bool const active = not window_events.empty()
+			or input_system::any_btn_down()
+			or _loading
+			or _start
+			or _simulation_system.get_job_type() != board_job_type::NONE
+			or (_simulation_system.is_replaying() and not _locked)
+			or _render_system->has_pending_work();
+
+		_pace_frame(active);
 		FrameMark;
 	}
 }
@@ -88,7 +140,7 @@ std::string tomway::engine::_get_file_location()
 {
     ZoneScoped;
 	nfdchar_t *out_path = nullptr;
-	nfdresult_t result = NFD_OpenDialog(nullptr, nullptr, &out_path );
+	nfdresult_t result = NFD_OpenDialog("tomway,json,rle,tomrec", nullptr, &out_path );
 	std::string ret = {};
         
 	if (result == NFD_OKAY && out_path != nullptr)
@@ -108,6 +160,23 @@ std::string tomway::engine::_get_file_location()
 	return ret;
 }
 
+void tomway::engine::_finish_load(bool const success)
+{
+	_camera_controller.reset();
+	ui_system::hide_loading_screen();
+
+	if (success)
+	{
+		_cell_geometry_generator.bind_cells(_simulation_system.get_backend(), &_simulation_system.get_live_cells());
+		ui_system::hide_menu();
+	}
+	else
+	{
+		ui_system::show_menu();
+		_window_system.set_mouse_visible(true);
+	}
+}
+
 void tomway::engine::_load_file()
 {
 	_load_path = _get_file_location();
@@ -125,57 +194,83 @@ void tomway::engine::_load_file()
 
 void tomway::engine::_load_perf()
 {
-	std::ifstream save_file;
-	std::string data;
-	save_file.open("test/600.json");
-	save_file >> data;
-	save_file.close();
-	_simulation_system.deserialize(data);
-	_cell_geometry_generator.bind_cells(_simulation_system.get_current_cells());
+	_simulation_system.load_file("test/600.json");
+	_cell_geometry_generator.bind_cells(_simulation_system.get_backend(), &_simulation_system.get_live_cells());
 }
 
+// Starts the load on a background thread, _update_job finishes it
 void tomway::engine::_load_sim()
 {
-	bool deser_success = true;
+	bool started;
 			
 	if (_deser)
 	{
-		std::string data;
-		std::ifstream save_file;
-		save_file.open(_load_path);
-
-		if (save_file)
-		{
-			save_file >> data;
-			save_file.close();
-			deser_success = _simulation_system.deserialize(data);
-		}
-		else
-		{
-			LOG_ERROR("Could not load file: %s", _load_path.c_str());
-		}
-				
+		started = _simulation_system.load_file_async(_load_path, _grid_size);
 		_deser = false;
 	}
 	else
 	{
-		_simulation_system.start(_new_grid_size);
+		started = _simulation_system.start_async(_new_grid_size);
 	}
 			
 	_loading = false;
-	_camera_controller.reset();
-	ui_system::hide_loading_screen();
+	if (not started) _finish_load(false);
+}
+
+void tomway::engine::_open_replay()
+{
+	auto const replay_path = _get_file_location();
+	if (replay_path.empty()) return;
 
-	if (deser_success)
+	if (_simulation_system.open_replay(replay_path))
 	{
-		auto const cells = _simulation_system.get_current_cells();
-		_cell_geometry_generator.bind_cells(cells);
+		_cell_geometry_generator.bind_cells(_simulation_system.get_backend(), &_simulation_system.get_live_cells());
 		ui_system::hide_menu();
+		_window_system.set_mouse_visible(true);
+		_locked = true;
 	}
-	else
+}
+
+// A few frames are still drawn after the last thing that happened so ImGui can settle, then the loop sleeps until an
+// event arrives or the simulation's next tick is due. Otherwise the frame rate is capped.
+void tomway::engine::_pace_frame(bool const active)
+{
+	ZoneScoped;
+	size_t constexpr QUIET_FRAMES_BEFORE_IDLE = 3;
+	// Wake up now and then even when locked, nothing depends on it but it keeps the loop from looking hung
+	int constexpr MAX_IDLE_WAIT_MS = 1000;
+	_quiet_frames = active ? 0 : _quiet_frames + 1;
+
+	if (not _frame_pacing.idle or _quiet_frames < QUIET_FRAMES_BEFORE_IDLE)
 	{
-		ui_system::show_menu();
-		_window_system.set_mouse_visible(true);
+		_time_system.limit_frame_rate();
+		return;
+	}
+
+	int timeout_ms = MAX_IDLE_WAIT_MS;
+
+	if (not _locked)
+	{
+		int const tick_ms = static_cast<int>(std::ceil(_time_system.get_time_to_next_tick() * 1000.0f));
+		timeout_ms = std::min(tick_ms, MAX_IDLE_WAIT_MS);
+	}
+
+	_window_system.wait_for_events(timeout_ms);
+	_time_system.mark_idle();
+}
+
+void tomway::engine::_paste_file()
+{
+	if (_simulation_system.get_cell_count() == 0) return;
+
+	auto const paste_path = _get_file_location();
+	if (paste_path.empty()) return;
+
+	size_t const grid_size = _simulation_system.get_backend()->get_grid_size();
+
+	if (_simulation_system.paste_file(paste_path, grid_size / 2, grid_size / 2))
+	{
+		_cell_geometry_generator.bind_cells(_simulation_system.get_backend(), &_simulation_system.get_live_cells());
 	}
 }
 
@@ -183,31 +278,38 @@ void tomway::engine::_reset_sim()
 {
 	audio_system::play(_button_audio, channel_group::SFX, 0.2f);
 	_simulation_system.start(0);
-	_cell_geometry_generator.bind_cells(_simulation_system.get_current_cells());
+	_cell_geometry_generator.bind_cells(_simulation_system.get_backend(), &_simulation_system.get_live_cells());
 	ui_system::show_menu();
 	_locked = true;
 	_window_system.set_mouse_visible(true);
 	_camera_controller.reset();
 }
 
-void tomway::engine::_save_sim() const
+void tomway::engine::_save_sim()
 {
 	if (_simulation_system.get_cell_count() == 0) return;
+
+	if (_simulation_system.get_job_type() != board_job_type::NONE)
+	{
+		LOG_ERROR("Can't save while another load or save is running.");
+		return;
+	}
 	
 	auto save_path = _get_file_location();
 
-	if (not save_path.empty())
-	{
-		std::ofstream save_file;
-		save_file.open(save_path);
+	if (not save_path.empty()) _simulation_system.save_file_async(save_path);
+}
 
-		if (save_file)
-		{
-			auto data = _simulation_system.serialize();
-			save_file << data;
-			save_file.close();
-		}
-	}
+void tomway::engine::_start_asset_job()
+{
+	_asset_job.start([this](progress_fn const&)
+	{
+		ZoneScopedN("engine | decode audio");
+		_music_audio = audio_system::stream_file("assets/audio/HoliznaCC0 - Cosmic Waves.mp3");
+		_button_audio = audio_system::load_file("assets/audio/click5.ogg");
+		_iteration_audio = audio_system::load_file("assets/audio/bong_001.ogg");
+		return true;
+	});
 }
 
 void tomway::engine::_start_sim()
@@ -219,12 +321,51 @@ void tomway::engine::_start_sim()
 	_locked = true;
 }
 
+void tomway::engine::_step_replay()
+{
+	// Pause at the end of the recording
+	if (not _simulation_system.step_replay()) _locked = true;
+	_cell_geometry_generator.bind_cells(_simulation_system.get_backend(), &_simulation_system.get_live_cells());
+	_step = false;
+}
+
 void tomway::engine::_step_sim()
 {
 	_simulation_system.step_simulation();
-	auto cells = _simulation_system.get_current_cells();
-	_cell_geometry_generator.bind_cells(cells);
+	_cell_geometry_generator.bind_cells(_simulation_system.get_backend(), &_simulation_system.get_live_cells());
 	_step = false;
 	float iteration_vol = std::max(0.03f, audio_system::get_volume(_music_channel) / 2);
 	audio_system::play(_iteration_audio, channel_group::SFX, iteration_vol);
 }
+
+void tomway::engine::_toggle_recording()
+{
+	if (_simulation_system.is_recording())
+	{
+		_simulation_system.stop_recording();
+		return;
+	}
+
+	if (_simulation_system.get_cell_count() == 0 or _simulation_system.is_replaying()) return;
+
+	auto const record_path = _get_file_location();
+	if (not record_path.empty()) _simulation_system.start_recording(record_path);
+}
+
+void tomway::engine::_update_job()
+{
+	board_job_type const job_type = _simulation_system.get_job_type();
+	if (job_type == board_job_type::LOAD) ui_system::set_loading_progress(_simulation_system.get_job_progress());
+
+	bool success;
+	if (not _simulation_system.update_job(success)) return;
+
+	if (job_type == board_job_type::LOAD)
+	{
+		_finish_load(success);
+	}
+	else if (success)
+	{
+		LOG_INFO("Board saved.");
+	}
+}
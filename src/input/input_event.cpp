@@ -44,6 +44,16 @@ tomway::input_button tomway::to_input_button(SDL_Keycode const& sdl_keycode) {
 		return input_button::F2;
 	case SDLK_F3:
 		return input_button::F3;
+	case SDLK_F4:
+		return input_button::F4;
+	case SDLK_F5:
+		return input_button::F5;
+	case SDLK_F6:
+		return input_button::F6;
+	case SDLK_F7:
+		return input_button::F7;
+	case SDLK_F8:
+		return input_button::F8;
 	default:
 		return input_button::NONE;
 	}
@@ -22,6 +22,18 @@ tomway::input_system::~input_system()
     _inst = nullptr;
 }
 
+bool tomway::input_system::any_btn_down()
+{
+    check_system_ready();
+
+    for (auto const& state : _inst->_button_states)
+    {
+        if (state.second.down) return true;
+    }
+
+    return false;
+}
+
 bool tomway::input_system::btn_down(input_button const btn)
 {
     check_system_ready();
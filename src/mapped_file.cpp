@@ -0,0 +1,106 @@
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+tomway::mapped_file::~mapped_file()
+{
+    close();
+}
+
+void tomway::mapped_file::close()
+{
+#ifdef _WIN32
+    if (_data) UnmapViewOfFile(_data);
+    if (_mapping) CloseHandle(_mapping);
+    if (_file) CloseHandle(_file);
+    _file = nullptr;
+    _mapping = nullptr;
+#else
+    if (_data) munmap(const_cast<uint8_t*>(_data), _size);
+#endif
+    _data = nullptr;
+    _size = 0;
+}
+
+uint8_t const* tomway::mapped_file::get_data() const
+{
+    return _data;
+}
+
+size_t tomway::mapped_file::get_size() const
+{
+    return _size;
+}
+
+bool tomway::mapped_file::open(std::string const& path)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE const file = CreateFileA(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN,
+        nullptr);
+
+    if (file == INVALID_HANDLE_VALUE) return false;
+    _file = file;
+
+    LARGE_INTEGER size;
+    if (not GetFileSizeEx(file, &size) or size.QuadPart == 0)
+    {
+        close();
+        return false;
+    }
+
+    _mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+    if (not _mapping)
+    {
+        close();
+        return false;
+    }
+
+    _data = static_cast<uint8_t const*>(MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+
+    if (not _data)
+    {
+        close();
+        return false;
+    }
+
+    _size = static_cast<size_t>(size.QuadPart);
+#else
+    int const file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) return false;
+
+    struct stat info;
+
+    if (fstat(file, &info) != 0 or info.st_size == 0)
+    {
+        ::close(file);
+        return false;
+    }
+
+    void* const data = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+    ::close(file);
+    if (data == MAP_FAILED) return false;
+
+    _data = static_cast<uint8_t const*>(data);
+    _size = static_cast<size_t>(info.st_size);
+#endif
+
+    return true;
+}
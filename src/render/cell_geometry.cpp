@@ -1,182 +1,434 @@
 #include "render/cell_geometry.h"
 
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
+
 #include "Tracy.hpp"
 
 std::vector<tomway::vertex> const tomway::cell_geometry::BASE_VERTS = {
     // X, Y, CELL_WIDTH (Top)
-    {{0.0f, 0.0f, CELL_HEIGHT}, {0.0f, 0.0f, 1.0f}, COLOR_RED},
-    {{CELL_WIDTH, 0.0f, CELL_HEIGHT}, {0.0f, 0.0f, 1.0f}, COLOR_RED},
-    {{0.0f, CELL_WIDTH, CELL_HEIGHT}, {0.0f, 0.0f, 1.0f}, COLOR_RED},
-    {{CELL_WIDTH, 0.0f, CELL_HEIGHT}, {0.0f, 0.0f, 1.0f}, COLOR_RED},
-    {{CELL_WIDTH, CELL_WIDTH, CELL_HEIGHT}, {0.0f, 0.0f, 1.0f}, COLOR_RED},
-    {{0.0f, CELL_WIDTH, CELL_HEIGHT}, {0.0f, 0.0f, 1.0f}, COLOR_RED},
+    {0, 0, CELL_HEIGHT_STEPS, face_index(cell_face::TOP), COLOR_RED},
+    {CELL_WIDTH_STEPS, 0, CELL_HEIGHT_STEPS, face_index(cell_face::TOP), COLOR_RED},
+    {0, CELL_WIDTH_STEPS, CELL_HEIGHT_STEPS, face_index(cell_face::TOP), COLOR_RED},
+    {CELL_WIDTH_STEPS, 0, CELL_HEIGHT_STEPS, face_index(cell_face::TOP), COLOR_RED},
+    {CELL_WIDTH_STEPS, CELL_WIDTH_STEPS, CELL_HEIGHT_STEPS, face_index(cell_face::TOP), COLOR_RED},
+    {0, CELL_WIDTH_STEPS, CELL_HEIGHT_STEPS, face_index(cell_face::TOP), COLOR_RED},
     
     // X, Y, 0 (Bottom)
-    {{0.0f, 0.0f, 0.0f}, {0.0f, 0.0f, -1.0f}, COLOR_RED},
-    {{0.0f, CELL_WIDTH, 0.0f}, {0.0f, 0.0f, -1.0f}, COLOR_RED},
-    {{CELL_WIDTH, 0.0f, 0.0f}, {0.0f, 0.0f, -1.0f}, COLOR_RED},
-    {{CELL_WIDTH, 0.0f, 0.0f}, {0.0f, 0.0f, -1.0f}, COLOR_RED},
-    {{0.0f, CELL_WIDTH, 0.0f}, {0.0f, 0.0f, -1.0f}, COLOR_RED},
-    {{CELL_WIDTH, CELL_WIDTH, 0.0f}, {0.0f, 0.0f, -1.0f}, COLOR_RED},
+    {0, 0, 0, face_index(cell_face::BOTTOM), COLOR_RED},
+    {0, CELL_WIDTH_STEPS, 0, face_index(cell_face::BOTTOM), COLOR_RED},
+    {CELL_WIDTH_STEPS, 0, 0, face_index(cell_face::BOTTOM), COLOR_RED},
+    {CELL_WIDTH_STEPS, 0, 0, face_index(cell_face::BOTTOM), COLOR_RED},
+    {0, CELL_WIDTH_STEPS, 0, face_index(cell_face::BOTTOM), COLOR_RED},
+    {CELL_WIDTH_STEPS, CELL_WIDTH_STEPS, 0, face_index(cell_face::BOTTOM), COLOR_RED},
     
     // X, 0, Z (Back)
-    {{0.0f, 0.0f, 0.0f}, {0.0f, -1.0f, 0.0f}, COLOR_RED},
-    {{CELL_WIDTH, 0.0f, 0.0f}, {0.0f, -1.0f, 0.0f}, COLOR_RED},
-    {{0.0f, 0.0f, CELL_HEIGHT}, {0.0f, -1.0f, 0.0f}, COLOR_RED},
-    {{0.0f, 0.0f, CELL_HEIGHT}, {0.0f, -1.0f, 0.0f}, COLOR_RED},
-    {{CELL_WIDTH, 0.0f, 0.0f}, {0.0f, -1.0f, 0.0f}, COLOR_RED},
-    {{CELL_WIDTH, 0.0f, CELL_HEIGHT}, {0.0f, -1.0f, 0.0f}, COLOR_RED},
+    {0, 0, 0, face_index(cell_face::BACK), COLOR_RED},
+    {CELL_WIDTH_STEPS, 0, 0, face_index(cell_face::BACK), COLOR_RED},
+    {0, 0, CELL_HEIGHT_STEPS, face_index(cell_face::BACK), COLOR_RED},
+    {0, 0, CELL_HEIGHT_STEPS, face_index(cell_face::BACK), COLOR_RED},
+    {CELL_WIDTH_STEPS, 0, 0, face_index(cell_face::BACK), COLOR_RED},
+    {CELL_WIDTH_STEPS, 0, CELL_HEIGHT_STEPS, face_index(cell_face::BACK), COLOR_RED},
     
     // X, CELL_WIDTH, Z (Front)
-    {{CELL_WIDTH, CELL_WIDTH, CELL_HEIGHT}, {0.0f, 1.0f, 0.0f}, COLOR_RED},
-    {{CELL_WIDTH, CELL_WIDTH, 0.0f}, {0.0f, 1.0f, 0.0f}, COLOR_RED},
-    {{0.0f, CELL_WIDTH, 0.0f}, {0.0f, 1.0f, 0.0f}, COLOR_RED},
-    {{CELL_WIDTH, CELL_WIDTH, CELL_HEIGHT}, {0.0f, 1.0f, 0.0f}, COLOR_RED},
-    {{0.0f, CELL_WIDTH, 0.0f}, {0.0f, 1.0f, 0.0f}, COLOR_RED},
-    {{0.0f, CELL_WIDTH, CELL_HEIGHT}, {0.0f, 1.0f, 0.0f}, COLOR_RED},
+    {CELL_WIDTH_STEPS, CELL_WIDTH_STEPS, CELL_HEIGHT_STEPS, face_index(cell_face::FRONT), COLOR_RED},
+    {CELL_WIDTH_STEPS, CELL_WIDTH_STEPS, 0, face_index(cell_face::FRONT), COLOR_RED},
+    {0, CELL_WIDTH_STEPS, 0, face_index(cell_face::FRONT), COLOR_RED},
+    {CELL_WIDTH_STEPS, CELL_WIDTH_STEPS, CELL_HEIGHT_STEPS, face_index(cell_face::FRONT), COLOR_RED},
+    {0, CELL_WIDTH_STEPS, 0, face_index(cell_face::FRONT), COLOR_RED},
+    {0, CELL_WIDTH_STEPS, CELL_HEIGHT_STEPS, face_index(cell_face::FRONT), COLOR_RED},
     
     // 0, Y, Z (LEFT)
-    {{0.0f, CELL_WIDTH, CELL_HEIGHT}, {-1.0f, 0.0f, 0.0f}, COLOR_RED},
-    {{0.0f, CELL_WIDTH, 0.0f}, {-1.0f, 0.0f, 0.0f}, COLOR_RED},
-    {{0.0f, 0.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}, COLOR_RED},
-    {{0.0f, CELL_WIDTH, CELL_HEIGHT}, {-1.0f, 0.0f, 0.0f}, COLOR_RED},
-    {{0.0f, 0.0f, 0.0f}, {-1.0f, 0.0f, 0.0f}, COLOR_RED},
-    {{0.0f, 0.0f, CELL_HEIGHT}, {-1.0f, 0.0f, 0.0f}, COLOR_RED},
+    {0, CELL_WIDTH_STEPS, CELL_HEIGHT_STEPS, face_index(cell_face::LEFT), COLOR_RED},
+    {0, CELL_WIDTH_STEPS, 0, face_index(cell_face::LEFT), COLOR_RED},
+    {0, 0, 0, face_index(cell_face::LEFT), COLOR_RED},
+    {0, CELL_WIDTH_STEPS, CELL_HEIGHT_STEPS, face_index(cell_face::LEFT), COLOR_RED},
+    {0, 0, 0, face_index(cell_face::LEFT), COLOR_RED},
+    {0, 0, CELL_HEIGHT_STEPS, face_index(cell_face::LEFT), COLOR_RED},
     
     // CELL_WIDTH, Y, Z (RIGHT)
-    {{CELL_WIDTH, CELL_WIDTH, CELL_HEIGHT}, {1.0f, 0.0f, 0.0f}, COLOR_RED},
-    {{CELL_WIDTH, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, COLOR_RED},
-    {{CELL_WIDTH, CELL_WIDTH, 0.0f}, {1.0f, 0.0f, 0.0f}, COLOR_RED},
-    {{CELL_WIDTH, CELL_WIDTH, CELL_HEIGHT}, {1.0f, 0.0f, 0.0f}, COLOR_RED},
-    {{CELL_WIDTH, 0.0f, CELL_HEIGHT}, {1.0f, 0.0f, 0.0f}, COLOR_RED},
-    {{CELL_WIDTH, 0.0f, 0.0f}, {1.0f, 0.0f, 0.0f}, COLOR_RED},
+    {CELL_WIDTH_STEPS, CELL_WIDTH_STEPS, CELL_HEIGHT_STEPS, face_index(cell_face::RIGHT), COLOR_RED},
+    {CELL_WIDTH_STEPS, 0, 0, face_index(cell_face::RIGHT), COLOR_RED},
+    {CELL_WIDTH_STEPS, CELL_WIDTH_STEPS, 0, face_index(cell_face::RIGHT), COLOR_RED},
+    {CELL_WIDTH_STEPS, CELL_WIDTH_STEPS, CELL_HEIGHT_STEPS, face_index(cell_face::RIGHT), COLOR_RED},
+    {CELL_WIDTH_STEPS, 0, CELL_HEIGHT_STEPS, face_index(cell_face::RIGHT), COLOR_RED},
+    {CELL_WIDTH_STEPS, 0, 0, face_index(cell_face::RIGHT), COLOR_RED},
 };
 
-tomway::cell_geometry::cell_geometry()
-    : _cells(nullptr)
+tomway::cell_geometry::cell_geometry(worker_pool& workers)
+    : _cells(nullptr),
+    _live_cells(nullptr),
+    _workers(workers)
+{
+}
+
+void tomway::cell_geometry::append_density_quads(
+    cell_tile const& tile,
+    size_t const level,
+    std::vector<density_quad>& out)
 {
+    _update_density();
+    size_t const grid_size = get_grid_size();
+    if (grid_size == 0 or _density.get_level_count() == 0) return;
+
+    size_t const block_size = density_pyramid::get_block_size(level);
+    size_t const blocks_per_side = _density.get_blocks_per_side(level);
+    size_t const first_x = tile.x / block_size;
+    size_t const first_y = tile.y / block_size;
+    size_t const end_x = std::min((tile.x + tile.size + block_size - 1) / block_size, blocks_per_side);
+    size_t const end_y = std::min((tile.y + tile.size + block_size - 1) / block_size, blocks_per_side);
+    glm::vec2 const origin = get_grid_origin();
+    // A live cell's top only covers part of the space it's given, the rest is border
+    float const top_fraction = CELL_WIDTH * CELL_WIDTH / (CELL_POS_OFFSET * CELL_POS_OFFSET);
+
+    for (size_t y = first_y; y < end_y; y++)
+    {
+        for (size_t x = first_x; x < end_x; x++)
+        {
+            uint32_t const count = _density.get_count(level, x, y);
+            if (count == 0) continue;
+
+            // Blocks on the far edges are cut short by the end of the board
+            size_t const cells_x = std::min(block_size, grid_size - x * block_size);
+            size_t const cells_y = std::min(block_size, grid_size - y * block_size);
+            density_quad quad = {};
+            quad.min = { origin.x + x * block_size * CELL_POS_OFFSET, origin.y + y * block_size * CELL_POS_OFFSET, CELL_HEIGHT };
+            quad.size = { cells_x * CELL_POS_OFFSET - CELL_BORDER, cells_y * CELL_POS_OFFSET - CELL_BORDER };
+            quad.coverage = top_fraction * count / (cells_x * cells_y);
+            out.push_back(quad);
+        }
+    }
 }
 
-void tomway::cell_geometry::bind_cells(cell_container const* cells)
+void tomway::cell_geometry::bind_cells(simulation_backend const* cells, live_cell_list const* live_cells)
 {
     ZoneScoped;
     _cells = cells;
-	_vertices.resize(cells->size() * BASE_VERTS.size() + BACKGROUND_VERT_COUNT);
-    _cells_dirty = true;
+    _live_cells = live_cells;
+    _version++;
+}
+
+std::array<tomway::vertex, tomway::cell_geometry::BACKGROUND_VERT_COUNT> tomway::cell_geometry::get_background_vertices() const
+{
+    std::array<vertex, BACKGROUND_VERT_COUNT> ret{};
+    _write_background_vertices(ret.data());
+    return ret;
+}
+
+tomway::cell_container tomway::cell_geometry::get_board() const
+{
+    cell_container ret(0);
+    if (_cells != nullptr) _cells->snapshot(ret);
+    return ret;
+}
+
+std::vector<tomway::vertex> const& tomway::cell_geometry::get_cell_mesh()
+{
+    return BASE_VERTS;
+}
+
+float tomway::cell_geometry::get_cell_spacing()
+{
+    return CELL_POS_OFFSET;
+}
+
+glm::vec2 tomway::cell_geometry::get_cell_extent()
+{
+    return { CELL_WIDTH, CELL_HEIGHT };
+}
+
+float tomway::cell_geometry::get_background_scale() const
+{
+    size_t const grid_size = get_grid_size();
+    return grid_size == 0 ? 0.0f : (grid_size * CELL_POS_OFFSET - CELL_BORDER) / BACKGROUND_STEPS;
+}
+
+tomway::density_pyramid const& tomway::cell_geometry::get_density_pyramid()
+{
+    _update_density();
+    return _density;
+}
+
+glm::vec2 tomway::cell_geometry::get_grid_origin() const
+{
+    float const origin = -1.0f * get_grid_size() / 2.0f * CELL_POS_OFFSET;
+    return { origin, origin };
+}
+
+size_t tomway::cell_geometry::get_grid_size() const
+{
+    return _cells == nullptr ? 0 : _cells->get_grid_size();
 }
 
-std::vector<vertex_chunk> tomway::cell_geometry::get_vertices(size_t max_chunk_alloc_size_bytes)
+tomway::cell_slots& tomway::cell_geometry::get_slots()
+{
+    _update_slots();
+    return _slots;
+}
+
+float tomway::cell_geometry::get_position_scale()
+{
+    return POSITION_SCALE;
+}
+
+tomway::live_cell_list const& tomway::cell_geometry::get_instances()
+{
+    _update_tiles();
+    return _tile_cells;
+}
+
+std::vector<tomway::cell_tile> const& tomway::cell_geometry::get_tiles()
+{
+    _update_tiles();
+    return _tiles;
+}
+
+uint64_t tomway::cell_geometry::get_version() const
+{
+    return _version;
+}
+
+std::vector<vertex_chunk> const& tomway::cell_geometry::get_vertex_layout(size_t max_chunk_alloc_size_bytes)
 {
     ZoneScoped;
     
-    if (_cells == nullptr or _cells->size() == 0)
+    if (_cells == nullptr or _live_cells == nullptr or _cells->get_grid_size() == 0)
     {
-        _cells_dirty = false;
-        return {};
+        _chunks.clear();
+        _chunks_version = _version;
+        return _chunks;
     }
 
-    if (not _cells_dirty)
+    if (_chunks_version == _version)
     {
         return _chunks;
     }
 
+    _update_tiles();
+
     // Start with the max allowed per memory allocation
     size_t verts_per_chunk = max_chunk_alloc_size_bytes / sizeof(vertex);
     // Get rid of the remainder through integer division, then multiply up
     verts_per_chunk = verts_per_chunk / BASE_VERTS.size() * BASE_VERTS.size();
-    size_t const max_verts_in_container = _cells->size() * BASE_VERTS.size();
+    size_t const grid_size = _cells->get_grid_size();
+    size_t const max_verts_in_container = grid_size * grid_size * BASE_VERTS.size() + BACKGROUND_VERT_COUNT;
     // If the maximum possible verts in our cell container is less than that, use that number instead
     verts_per_chunk = verts_per_chunk > max_verts_in_container ? max_verts_in_container : verts_per_chunk;
     
+    // The background is always the first thing in the first chunk
     size_t verts_acquired = BACKGROUND_VERT_COUNT;
-    size_t verts_curr_chunk = BACKGROUND_VERT_COUNT;
+    size_t chunk_start = 0;
     _chunks.clear();
 
-    // UL
-    _vertices[0].pos.x = -1.0f * _cells->grid_size() / 2.0f * CELL_POS_OFFSET;
-    _vertices[0].pos.y = -1.0f * _cells->grid_size() / 2.0f * CELL_POS_OFFSET;
-    _vertices[0].normal = {0.0f, 0.0f, 1.0f};
-    _vertices[0].color = COLOR_LG;
-
-    // LR
-    _vertices[1].pos.x =  _cells->grid_size() / 2.0f * CELL_POS_OFFSET - CELL_BORDER;
-    _vertices[1].pos.y =  _cells->grid_size() / 2.0f * CELL_POS_OFFSET - CELL_BORDER;
-    _vertices[1].normal = {0.0f, 0.0f, 1.0f};
-    _vertices[1].color = COLOR_DB;
-
-    // LL
-    _vertices[2].pos.x =  -1.0f * _cells->grid_size() / 2.0f * CELL_POS_OFFSET;
-    _vertices[2].pos.y =  _cells->grid_size() / 2.0f * CELL_POS_OFFSET - CELL_BORDER;
-    _vertices[2].normal = {0.0f, 0.0f, 1.0f};
-    _vertices[2].color = COLOR_DG;
-
-    // UL
-    _vertices[3].pos.x = -1.0f * _cells->grid_size() / 2.0f * CELL_POS_OFFSET;
-    _vertices[3].pos.y = -1.0f * _cells->grid_size() / 2.0f * CELL_POS_OFFSET;
-    _vertices[3].normal = {0.0f, 0.0f, 1.0f};
-    _vertices[3].color = COLOR_LG;
-
-    // UR
-    _vertices[4].pos.x =  _cells->grid_size() / 2.0f * CELL_POS_OFFSET - CELL_BORDER;
-    _vertices[4].pos.y =  -1.0f * _cells->grid_size() / 2.0f * CELL_POS_OFFSET;
-    _vertices[4].normal = {0.0f, 0.0f, 1.0f};
-    _vertices[4].color = COLOR_LB;
-
-    // LR
-    _vertices[5].pos.x =  _cells->grid_size() / 2.0f * CELL_POS_OFFSET - CELL_BORDER;
-    _vertices[5].pos.y =  _cells->grid_size() / 2.0f * CELL_POS_OFFSET - CELL_BORDER;
-    _vertices[5].normal = {0.0f, 0.0f, 1.0f};
-    _vertices[5].color = COLOR_DB;
+    // A prefix sum over the tiles' vertex counts. Tiles never straddle chunks, so each one can be drawn from a single
+    // vertex buffer, and once every tile knows where it starts they can all be written at the same time.
+    for (auto& tile : _tiles)
+    {
+        size_t const tile_verts = tile.cell_count * BASE_VERTS.size();
+
+        if (verts_acquired - chunk_start + tile_verts > verts_per_chunk)
+        {
+            _chunks.push_back({
+                verts_acquired - chunk_start,
+                (verts_acquired - chunk_start) * sizeof(vertex),
+                verts_per_chunk * sizeof(vertex)});
+
+            chunk_start = verts_acquired;
+        }
+
+        tile.chunk = _chunks.size();
+        tile.first_vertex = static_cast<uint32_t>(verts_acquired - chunk_start);
+        verts_acquired += tile_verts;
+    }
+
+    _chunks.push_back({
+        verts_acquired - chunk_start,
+        (verts_acquired - chunk_start) * sizeof(vertex),
+        verts_per_chunk * sizeof(vertex)});
+    
+    _chunks_version = _version;
+    return _chunks;
+}
+
+void tomway::cell_geometry::write_vertices(std::vector<void*> const& chunk_memory)
+{
+    ZoneScoped;
+    if (_chunks.empty()) return;
+    _write_background_vertices(static_cast<vertex*>(chunk_memory[0]));
 
+    size_t const max_parts = std::max<size_t>(_tile_cells.size() / MIN_CELLS_PER_WORKER, 1);
+    size_t const part_count = std::min(_workers.get_concurrency(), max_parts);
+    _worker_first_tiles.assign(1, 0);
+    size_t cells_assigned = 0;
+
+    // Tiles are handed out in runs of roughly equal live counts
+    for (size_t part = 0; part + 1 < part_count; part++)
     {
-        ZoneScopedN("tomway::cell_geometry::get_vertices | Cell iteration");
-        for (cell const& cell : *_cells)
+        size_t const target = _tile_cells.size() * (part + 1) / part_count;
+        size_t end_tile = _worker_first_tiles.back();
+
+        while (end_tile < _tiles.size() and cells_assigned < target)
         {
-            if (not cell._alive) continue;
-            
-            auto const adjusted_cell_pos_x = (static_cast<float>(cell._x) - _cells->grid_size() / 2.0f) * CELL_POS_OFFSET;
-            auto const adjusted_cell_pos_y = (static_cast<float>(cell._y) - _cells->grid_size() / 2.0f) * CELL_POS_OFFSET;
+            cells_assigned += _tiles[end_tile++].cell_count;
+        }
 
-            for (auto const& base_vert : BASE_VERTS)
-            {
-                auto& vert = _vertices[verts_acquired];
-                vert.pos.x = base_vert.pos.x + adjusted_cell_pos_x;
-                vert.pos.y = base_vert.pos.y + adjusted_cell_pos_y;
-                vert.pos.z = base_vert.pos.z;
-                vert.normal = base_vert.normal;
-                vert.color = base_vert.color;
-                verts_acquired += 1;
-                verts_curr_chunk += 1;
-            }
+        _worker_first_tiles.push_back(end_tile);
+    }
+
+    _worker_first_tiles.push_back(_tiles.size());
+
+    _workers.run(part_count, [this, &chunk_memory](size_t const part)
+    {
+        _write_tile_vertices(_worker_first_tiles[part], _worker_first_tiles[part + 1], chunk_memory);
+    });
+}
+
+void tomway::cell_geometry::_update_density()
+{
+    if (_density_version == _version) return;
+    _density_version = _version;
+    if (_live_cells == nullptr) return;
+    _density.update(get_grid_size(), *_live_cells);
+}
+
+void tomway::cell_geometry::_update_slots()
+{
+    if (_slots_version == _version) return;
+    _slots_version = _version;
+    if (_live_cells == nullptr) return;
+    _slots.update(*_live_cells);
+}
+
+// Buckets the live cells by tile with a counting sort. The live list is row-major, so the cells in each tile stay
+// row-major too.
+void tomway::cell_geometry::_update_tiles()
+{
+    if (_tiles_version == _version) return;
+    ZoneScoped;
+    _tiles_version = _version;
+    _tiles.clear();
+    _tile_cells.clear();
+    size_t const grid_size = get_grid_size();
+    if (grid_size == 0 or _live_cells == nullptr) return;
+
+    size_t tile_size = (grid_size + TARGET_TILES_PER_SIDE - 1) / TARGET_TILES_PER_SIDE;
+    tile_size = (tile_size + MIN_TILE_SIZE - 1) / MIN_TILE_SIZE * MIN_TILE_SIZE;
+    tile_size = tile_size < MIN_TILE_SIZE ? MIN_TILE_SIZE : tile_size > MAX_TILE_SIZE ? MAX_TILE_SIZE : tile_size;
+    size_t const tiles_per_side = (grid_size + tile_size - 1) / tile_size;
+    _tile_offsets.assign(tiles_per_side * tiles_per_side + 1, 0);
+
+    for (cell_coord const& cell : *_live_cells)
+    {
+        _tile_offsets[cell.y / tile_size * tiles_per_side + cell.x / tile_size + 1]++;
+    }
+
+    glm::vec2 const origin = get_grid_origin();
+
+    for (size_t i = 0; i + 1 < _tile_offsets.size(); i++)
+    {
+        uint32_t const count = _tile_offsets[i + 1];
+        _tile_offsets[i + 1] += _tile_offsets[i];
+        if (count == 0) continue;
+
+        size_t const tile_x = i % tiles_per_side;
+        size_t const tile_y = i / tiles_per_side;
+        cell_tile tile = {};
+        tile.min = { origin.x + tile_x * tile_size * CELL_POS_OFFSET, origin.y + tile_y * tile_size * CELL_POS_OFFSET, 0.0f };
+        tile.max = {
+            origin.x + std::min((tile_x + 1) * tile_size, grid_size) * CELL_POS_OFFSET - CELL_BORDER,
+            origin.y + std::min((tile_y + 1) * tile_size, grid_size) * CELL_POS_OFFSET - CELL_BORDER,
+            CELL_HEIGHT };
+        tile.x = static_cast<uint32_t>(tile_x * tile_size);
+        tile.y = static_cast<uint32_t>(tile_y * tile_size);
+        tile.size = static_cast<uint32_t>(tile_size);
+        tile.cell_count = count;
+        tile.first_instance = _tile_offsets[i];
+        _tiles.push_back(tile);
+    }
+
+    _tile_cells.resize(_live_cells->size());
 
-            if (verts_curr_chunk >= verts_per_chunk)
+    for (cell_coord const& cell : *_live_cells)
+    {
+        _tile_cells[_tile_offsets[cell.y / tile_size * tiles_per_side + cell.x / tile_size]++] = cell;
+    }
+}
+
+void tomway::cell_geometry::_write_tile_vertices(
+    size_t const first_tile,
+    size_t const end_tile,
+    std::vector<void*> const& chunk_memory) const
+{
+    ZoneScoped;
+    static_assert(sizeof(vertex) == sizeof(uint64_t), "Cell vertices are expanded as 64-bit words");
+
+    for (size_t t = first_tile; t < end_tile; t++)
+    {
+        cell_tile const& tile = _tiles[t];
+        vertex* out = static_cast<vertex*>(chunk_memory[tile.chunk]) + tile.first_vertex;
+        cell_coord const* tile_cells = _tile_cells.data() + tile.first_instance;
+
+        // Only the cells' offsets within the tile go in the vertices, the tile's corner is pushed with its draws
+
+        // Face by face rather than cell by cell, so that each face of the tile is one contiguous range
+        for (size_t face = 0; face < CELL_FACE_COUNT; face++)
+        {
+            // x and y are the low two 16-bit lanes of a vertex's word, and a cell's offset never carries out of its
+            // lane, so moving a vertex to its cell is one 64-bit add
+            uint64_t face_words[VERTS_PER_FACE];
+            std::memcpy(face_words, BASE_VERTS.data() + face * VERTS_PER_FACE, sizeof(face_words));
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+            // A face is three 16 byte stores of two vertices each
+            __m128i const face_lo = _mm_loadu_si128(reinterpret_cast<__m128i const*>(face_words));
+            __m128i const face_mid = _mm_loadu_si128(reinterpret_cast<__m128i const*>(face_words + 2));
+            __m128i const face_hi = _mm_loadu_si128(reinterpret_cast<__m128i const*>(face_words + 4));
+
+            for (size_t i = 0; i < tile.cell_count; i++)
             {
-                _chunks.push_back({
-                    _vertices.data() + verts_acquired - verts_per_chunk,
-                    verts_curr_chunk,
-                    verts_curr_chunk * sizeof(vertex),
-                    verts_per_chunk * sizeof(vertex)});
-                    
-                verts_curr_chunk = 0;
+                uint64_t const cell_x = (tile_cells[i].x - tile.x) * CELL_POS_OFFSET_STEPS;
+                uint64_t const cell_y = (tile_cells[i].y - tile.y) * CELL_POS_OFFSET_STEPS;
+                __m128i const offset = _mm_set1_epi64x(static_cast<long long>(cell_x | cell_y << 16));
+                auto* dst = reinterpret_cast<__m128i*>(out);
+                _mm_storeu_si128(dst, _mm_add_epi64(face_lo, offset));
+                _mm_storeu_si128(dst + 1, _mm_add_epi64(face_mid, offset));
+                _mm_storeu_si128(dst + 2, _mm_add_epi64(face_hi, offset));
+                out += VERTS_PER_FACE;
             }
-        }
+#else
+            for (size_t i = 0; i < tile.cell_count; i++)
+            {
+                uint64_t const cell_x = (tile_cells[i].x - tile.x) * CELL_POS_OFFSET_STEPS;
+                uint64_t const cell_y = (tile_cells[i].y - tile.y) * CELL_POS_OFFSET_STEPS;
+                uint64_t cell_words[VERTS_PER_FACE];
 
-        if (verts_curr_chunk)
-        {
-            _chunks.push_back({
-                _vertices.data() + verts_acquired - verts_curr_chunk,
-                verts_curr_chunk,
-                verts_curr_chunk * sizeof(vertex),
-                verts_per_chunk * sizeof(vertex)});
+                for (size_t v = 0; v < VERTS_PER_FACE; v++)
+                {
+                    cell_words[v] = face_words[v] + (cell_x | cell_y << 16);
+                }
+
+                std::memcpy(out, cell_words, sizeof(cell_words));
+                out += VERTS_PER_FACE;
+            }
+#endif
         }
-        
-        _cells_dirty = false;
     }
-    
-    return _chunks;
 }
 
-bool tomway::cell_geometry::is_dirty() const
+void tomway::cell_geometry::_write_background_vertices(vertex* out) const
 {
-    return _cells_dirty;
+    // Drawn from the grid origin with get_background_scale(), so the same vertices fit any board
+    uint8_t const up = face_index(cell_face::TOP);
+    uint16_t const far_edge = BACKGROUND_STEPS;
+
+    out[0] = {0, 0, 0, up, COLOR_LG}; // UL
+    out[1] = {far_edge, far_edge, 0, up, COLOR_DB}; // LR
+    out[2] = {0, far_edge, 0, up, COLOR_DG}; // LL
+    out[3] = {0, 0, 0, up, COLOR_LG}; // UL
+    out[4] = {far_edge, 0, 0, up, COLOR_LB}; // UR
+    out[5] = {far_edge, far_edge, 0, up, COLOR_DB}; // LR
 }
\ No newline at end of file
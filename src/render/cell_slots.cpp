@@ -0,0 +1,166 @@
+#include "render/cell_slots.h"
+
+#include <algorithm>
+
+#include "Tracy.hpp"
+
+namespace
+{
+    bool row_major_less(tomway::cell_coord const& lhs, tomway::cell_coord const& rhs)
+    {
+        return lhs.y < rhs.y or (lhs.y == rhs.y and lhs.x < rhs.x);
+    }
+}
+
+size_t tomway::cell_slots::get_births() const
+{
+    return _births;
+}
+
+size_t tomway::cell_slots::get_deaths() const
+{
+    return _deaths;
+}
+
+std::vector<tomway::cell_slots::dirty_range> const& tomway::cell_slots::get_dirty_ranges() const
+{
+    return _dirty_ranges;
+}
+
+size_t tomway::cell_slots::get_slot_count() const
+{
+    return _slots.size();
+}
+
+tomway::live_cell_list const& tomway::cell_slots::get_slots() const
+{
+    return _slots;
+}
+
+void tomway::cell_slots::mark_all_dirty()
+{
+    _dirty_ranges.clear();
+    if (not _slots.empty()) _dirty_ranges.push_back({ 0, static_cast<uint32_t>(_slots.size()) });
+}
+
+void tomway::cell_slots::update(live_cell_list const& live_cells)
+{
+    ZoneScoped;
+    _births = 0;
+    _deaths = 0;
+    _dirty.clear();
+    _next_cells.clear();
+    _next_cell_slots.clear();
+    _next_cells.reserve(live_cells.size());
+    _next_cell_slots.reserve(live_cells.size());
+    size_t old_index = 0;
+
+    // Deaths are handled before the births next to them so their slots can be reused straight away
+    for (cell_coord const& cell : live_cells)
+    {
+        while (old_index < _cells.size() and row_major_less(_cells[old_index], cell))
+        {
+            uint32_t const slot = _cell_slots[old_index++];
+            _slots[slot] = { EMPTY_SLOT, EMPTY_SLOT };
+            _free.push_back(slot);
+            _dirty.push_back(slot);
+            _deaths++;
+        }
+
+        uint32_t slot;
+
+        if (old_index < _cells.size() and _cells[old_index].x == cell.x and _cells[old_index].y == cell.y)
+        {
+            slot = _cell_slots[old_index++];
+        }
+        else
+        {
+            slot = _allocate(cell);
+            _births++;
+        }
+
+        _next_cells.push_back(cell);
+        _next_cell_slots.push_back(slot);
+    }
+
+    for (; old_index < _cells.size(); old_index++)
+    {
+        uint32_t const slot = _cell_slots[old_index];
+        _slots[slot] = { EMPTY_SLOT, EMPTY_SLOT };
+        _free.push_back(slot);
+        _dirty.push_back(slot);
+        _deaths++;
+    }
+
+    _cells.swap(_next_cells);
+    _cell_slots.swap(_next_cell_slots);
+
+    if (_slots.size() >= MIN_COMPACTION_SLOTS and _free.size() * 2 > _slots.size())
+    {
+        _compact(live_cells);
+        return;
+    }
+
+    _merge_dirty_ranges();
+}
+
+uint32_t tomway::cell_slots::_allocate(cell_coord const& cell)
+{
+    uint32_t slot;
+
+    if (_free.empty())
+    {
+        slot = static_cast<uint32_t>(_slots.size());
+        _slots.push_back(cell);
+    }
+    else
+    {
+        slot = _free.back();
+        _free.pop_back();
+        _slots[slot] = cell;
+    }
+
+    _dirty.push_back(slot);
+    return slot;
+}
+
+// Packs the live cells into the front slots in row-major order, which rewrites all of them
+void tomway::cell_slots::_compact(live_cell_list const& live_cells)
+{
+    ZoneScoped;
+    _slots = live_cells;
+    _free.clear();
+
+    for (uint32_t i = 0; i < _cell_slots.size(); i++)
+    {
+        _cell_slots[i] = i;
+    }
+
+    mark_all_dirty();
+}
+
+void tomway::cell_slots::_merge_dirty_ranges()
+{
+    _dirty_ranges.clear();
+    if (_dirty.empty()) return;
+    std::sort(_dirty.begin(), _dirty.end());
+    dirty_range range = { _dirty[0], 1 };
+
+    for (size_t i = 1; i < _dirty.size(); i++)
+    {
+        uint32_t const end = range.first_slot + range.slot_count;
+        // A slot can die and be reborn in one update, it only needs writing once
+        if (_dirty[i] < end) continue;
+
+        if (_dirty[i] - end <= MAX_RANGE_GAP)
+        {
+            range.slot_count = _dirty[i] + 1 - range.first_slot;
+            continue;
+        }
+
+        _dirty_ranges.push_back(range);
+        range = { _dirty[i], 1 };
+    }
+
+    _dirty_ranges.push_back(range);
+}
\ No newline at end of file
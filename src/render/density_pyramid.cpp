@@ -0,0 +1,124 @@
+#include "render/density_pyramid.h"
+
+#include "Tracy.hpp"
+
+size_t tomway::density_pyramid::get_block_size(size_t const level)
+{
+    return BLOCK_SIZE << level;
+}
+
+size_t tomway::density_pyramid::get_blocks_per_side(size_t const level) const
+{
+    return _sides[level];
+}
+
+size_t tomway::density_pyramid::get_changed_blocks() const
+{
+    return _changed_blocks;
+}
+
+uint32_t tomway::density_pyramid::get_count(size_t const level, size_t const x, size_t const y) const
+{
+    return _levels[level][y * _sides[level] + x];
+}
+
+size_t tomway::density_pyramid::get_level_count() const
+{
+    return _levels.size();
+}
+
+void tomway::density_pyramid::update(size_t const grid_size, live_cell_list const& live_cells)
+{
+    ZoneScoped;
+    if (_levels.empty() or grid_size != _grid_size) _resize(grid_size);
+
+    std::vector<uint32_t>& counts = _levels[0];
+    size_t const side = _sides[0];
+    _next_counts.assign(counts.size(), 0);
+
+    for (cell_coord const& cell : live_cells)
+    {
+        _next_counts[cell.y / BLOCK_SIZE * side + cell.x / BLOCK_SIZE]++;
+    }
+
+    _changed_blocks = 0;
+
+    for (size_t i = 0; i < counts.size(); i++)
+    {
+        if (_next_counts[i] != counts[i]) _changed_blocks++;
+    }
+
+    // Carrying a change up costs a step per level, past this point summing every level again is cheaper
+    if (_changed_blocks * (_levels.size() - 1) > counts.size())
+    {
+        counts.swap(_next_counts);
+        _sum_levels();
+        return;
+    }
+
+    for (size_t i = 0; i < counts.size() and _changed_blocks > 0; i++)
+    {
+        if (_next_counts[i] == counts[i]) continue;
+
+        // Unsigned wraparound makes adding the difference work for decreases too
+        uint32_t const delta = _next_counts[i] - counts[i];
+        size_t x = i % side;
+        size_t y = i / side;
+
+        for (size_t level = 1; level < _levels.size(); level++)
+        {
+            x /= 2;
+            y /= 2;
+            _levels[level][y * _sides[level] + x] += delta;
+        }
+    }
+
+    counts.swap(_next_counts);
+}
+
+void tomway::density_pyramid::_resize(size_t const grid_size)
+{
+    _grid_size = grid_size;
+    _levels.clear();
+    _sides.clear();
+    size_t side = (grid_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    while (true)
+    {
+        _sides.push_back(side);
+        _levels.emplace_back(side * side, 0);
+        if (side <= 1) break;
+        side = (side + 1) / 2;
+    }
+}
+
+void tomway::density_pyramid::_sum_levels()
+{
+    ZoneScoped;
+
+    for (size_t level = 1; level < _levels.size(); level++)
+    {
+        std::vector<uint32_t> const& below = _levels[level - 1];
+        size_t const below_side = _sides[level - 1];
+        size_t const side = _sides[level];
+
+        for (size_t y = 0; y < side; y++)
+        {
+            for (size_t x = 0; x < side; x++)
+            {
+                uint32_t sum = 0;
+
+                // The level below can have an odd side, its last row and column have no neighbour to pair with
+                for (size_t by = y * 2; by < y * 2 + 2 and by < below_side; by++)
+                {
+                    for (size_t bx = x * 2; bx < x * 2 + 2 and bx < below_side; bx++)
+                    {
+                        sum += below[by * below_side + bx];
+                    }
+                }
+
+                _levels[level][y * side + x] = sum;
+            }
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#include "render/frustum.h"
+
+// Gribb and Hartmann's plane extraction. The near plane is taken as -w <= z, which is exact for an OpenGL style
+// projection and a little loose for a Vulkan one, either way nothing visible is culled.
+tomway::frustum::frustum(glm::mat4 const& view_projection)
+{
+    glm::mat4 const m = glm::transpose(view_projection);
+    _planes[0] = m[3] + m[0]; // Left
+    _planes[1] = m[3] - m[0]; // Right
+    _planes[2] = m[3] + m[1]; // Bottom
+    _planes[3] = m[3] - m[1]; // Top
+    _planes[4] = m[3] + m[2]; // Near
+    _planes[5] = m[3] - m[2]; // Far
+}
+
+bool tomway::frustum::intersects(glm::vec3 const& min, glm::vec3 const& max) const
+{
+    for (auto const& plane : _planes)
+    {
+        // The corner furthest along the plane's normal, if that's outside then the whole box is
+        glm::vec3 const corner(
+            plane.x >= 0.0f ? max.x : min.x,
+            plane.y >= 0.0f ? max.y : min.y,
+            plane.z >= 0.0f ? max.z : min.z);
+
+        if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) return false;
+    }
+
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,271 @@
+#include "render/gpu_allocator.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include "SDL_log.h"
+#include "tomway_utility.h"
+#include "Tracy.hpp"
+
+namespace
+{
+    // The first block of each memory type, unless its heap is small
+    vk::DeviceSize constexpr INITIAL_BLOCK_SIZE = 64ull * 1024 * 1024;
+    // Keeps small heaps, like the mappable window of video memory without resizable BAR, from going to one block
+    vk::DeviceSize constexpr MIN_BLOCKS_PER_HEAP = 8;
+
+    // First fit within one block. The range's front padding stays free.
+    bool carve(tomway::gpu_block& block, vk::DeviceSize const size, vk::DeviceSize const alignment, vk::DeviceSize& offset)
+    {
+        if (block.size - block.used < size) return false;
+
+        for (auto range = block.free_ranges.begin(); range != block.free_ranges.end(); ++range)
+        {
+            vk::DeviceSize const range_start = range->first;
+            vk::DeviceSize const range_end = range->first + range->second;
+            vk::DeviceSize const aligned = (range_start + alignment - 1) / alignment * alignment;
+            if (aligned + size > range_end) continue;
+
+            block.free_ranges.erase(range);
+            if (aligned > range_start) block.free_ranges[range_start] = aligned - range_start;
+            if (aligned + size < range_end) block.free_ranges[aligned + size] = range_end - aligned - size;
+            block.used += size;
+            offset = aligned;
+            return true;
+        }
+
+        return false;
+    }
+}
+
+tomway::gpu_memory::gpu_memory(
+    gpu_allocator* allocator,
+    gpu_block* block,
+    vk::DeviceSize const offset,
+    vk::DeviceSize const size)
+    : _allocator(allocator),
+    _block(block),
+    _offset(offset),
+    _size(size)
+{
+}
+
+tomway::gpu_memory::~gpu_memory()
+{
+    reset();
+}
+
+tomway::gpu_memory::gpu_memory(gpu_memory&& other) noexcept
+    : _allocator(other._allocator),
+    _block(other._block),
+    _offset(other._offset),
+    _size(other._size)
+{
+    other._allocator = nullptr;
+    other._block = nullptr;
+}
+
+tomway::gpu_memory& tomway::gpu_memory::operator=(gpu_memory&& other) noexcept
+{
+    if (this == &other) return *this;
+    reset();
+    _allocator = other._allocator;
+    _block = other._block;
+    _offset = other._offset;
+    _size = other._size;
+    other._allocator = nullptr;
+    other._block = nullptr;
+    return *this;
+}
+
+tomway::gpu_memory::operator bool() const
+{
+    return _block != nullptr;
+}
+
+void* tomway::gpu_memory::get_mapped() const
+{
+    if (_block == nullptr or _block->mapped == nullptr) return nullptr;
+    return static_cast<char*>(_block->mapped) + _offset;
+}
+
+vk::DeviceMemory tomway::gpu_memory::get_memory() const
+{
+    return _block == nullptr ? vk::DeviceMemory() : *_block->memory_u;
+}
+
+vk::DeviceSize tomway::gpu_memory::get_offset() const
+{
+    return _offset;
+}
+
+vk::DeviceSize tomway::gpu_memory::get_size() const
+{
+    return _size;
+}
+
+void tomway::gpu_memory::reset()
+{
+    if (_allocator != nullptr) _allocator->_free(_block, _offset, _size);
+    _allocator = nullptr;
+    _block = nullptr;
+    _offset = 0;
+    _size = 0;
+}
+
+tomway::gpu_memory tomway::gpu_allocator::allocate(vk::MemoryRequirements const& requirements, uint32_t const memory_type)
+{
+    ZoneScoped;
+    vk::DeviceSize const alignment = requirements.alignment ? requirements.alignment : 1;
+    vk::DeviceSize offset = 0;
+
+    // Newest blocks first, they're the biggest
+    for (auto block = _blocks.rbegin(); block != _blocks.rend(); ++block)
+    {
+        if ((*block)->memory_type != memory_type) continue;
+        if (carve(**block, requirements.size, alignment, offset)) return { this, block->get(), offset, requirements.size };
+    }
+
+    gpu_block* block = _create_block(memory_type, requirements.size);
+    carve(*block, requirements.size, alignment, offset);
+    return { this, block, offset, requirements.size };
+}
+
+std::vector<tomway::gpu_allocator::heap_usage> tomway::gpu_allocator::get_heap_usage() const
+{
+    vk::PhysicalDeviceMemoryBudgetPropertiesEXT budget;
+
+    if (_has_memory_budget)
+    {
+        vk::PhysicalDeviceMemoryProperties2 properties2;
+        properties2.pNext = &budget;
+        _physical_device.getMemoryProperties2(&properties2);
+    }
+
+    std::vector<heap_usage> ret(_memory_properties.memoryHeapCount);
+
+    for (uint32_t i = 0; i < _memory_properties.memoryHeapCount; i++)
+    {
+        auto const& heap = _memory_properties.memoryHeaps[i];
+        ret[i].device_local = static_cast<bool>(heap.flags & vk::MemoryHeapFlagBits::eDeviceLocal);
+        ret[i].heap_size = heap.size;
+        ret[i].budget = _has_memory_budget ? budget.heapBudget[i] : heap.size;
+        ret[i].usage = _has_memory_budget ? budget.heapUsage[i] : 0;
+        ret[i].block_count = 0;
+        ret[i].block_bytes = 0;
+        ret[i].used_bytes = 0;
+    }
+
+    for (auto const& block : _blocks)
+    {
+        auto& usage = ret[_memory_properties.memoryTypes[block->memory_type].heapIndex];
+        usage.block_count++;
+        usage.block_bytes += block->size;
+        usage.used_bytes += block->used;
+    }
+
+    if (not _has_memory_budget)
+    {
+        for (auto& usage : ret)
+        {
+            usage.usage = usage.block_bytes;
+        }
+    }
+
+    return ret;
+}
+
+bool tomway::gpu_allocator::has_memory_budget() const
+{
+    return _has_memory_budget;
+}
+
+void tomway::gpu_allocator::init(
+    vk::PhysicalDevice const physical_device,
+    vk::Device const device,
+    size_t const max_allocation_size,
+    bool const has_memory_budget)
+{
+    _device = device;
+    _has_memory_budget = has_memory_budget;
+    _max_allocation_size = max_allocation_size;
+    _memory_properties = physical_device.getMemoryProperties();
+    _next_block_sizes.assign(_memory_properties.memoryTypeCount, INITIAL_BLOCK_SIZE);
+    _physical_device = physical_device;
+}
+
+tomway::gpu_block* tomway::gpu_allocator::_create_block(uint32_t const memory_type, vk::DeviceSize const min_size)
+{
+    ZoneScoped;
+    auto const& type = _memory_properties.memoryTypes[memory_type];
+    vk::DeviceSize const heap_size = _memory_properties.memoryHeaps[type.heapIndex].size;
+    vk::DeviceSize size = std::min(_next_block_sizes[memory_type], heap_size / MIN_BLOCKS_PER_HEAP);
+    size = std::max(std::min(size, _max_allocation_size), min_size);
+    vk::UniqueDeviceMemory memory_u;
+
+    try
+    {
+        memory_u = _device.allocateMemoryUnique({ size, memory_type }); // Size, memory type
+    }
+    catch (vk::OutOfDeviceMemoryError const&)
+    {
+        if (size == min_size) throw;
+        // No room for a bigger block, settle for what was asked for
+        size = min_size;
+        memory_u = _device.allocateMemoryUnique({ size, memory_type }); // Size, memory type
+    }
+
+    _next_block_sizes[memory_type] = std::max(_next_block_sizes[memory_type], std::min(size * 2, _max_allocation_size));
+    auto block = std::make_unique<gpu_block>();
+    block->memory_u = std::move(memory_u);
+    block->size = size;
+    block->memory_type = memory_type;
+    block->used = 0;
+    block->free_ranges[0] = size;
+    bool const host_visible = static_cast<bool>(type.propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible);
+    block->mapped = host_visible ? _device.mapMemory(*block->memory_u, 0, VK_WHOLE_SIZE) : nullptr;
+    _blocks.push_back(std::move(block));
+    LOG_INFO("Allocated a %.1f MB block of GPU memory type %u.", size / (1024.0 * 1024.0), memory_type);
+    return _blocks.back().get();
+}
+
+void tomway::gpu_allocator::_free(gpu_block* block, vk::DeviceSize const offset, vk::DeviceSize const size)
+{
+    vk::DeviceSize start = offset;
+    vk::DeviceSize end = offset + size;
+    auto next = block->free_ranges.lower_bound(offset);
+
+    if (next != block->free_ranges.begin())
+    {
+        auto const prev = std::prev(next);
+
+        if (prev->first + prev->second == start)
+        {
+            start = prev->first;
+            block->free_ranges.erase(prev);
+        }
+    }
+
+    if (next != block->free_ranges.end() and next->first == end)
+    {
+        end = next->first + next->second;
+        block->free_ranges.erase(next);
+    }
+
+    block->free_ranges[start] = end - start;
+    block->used -= size;
+    if (block->used) return;
+
+    // One empty block of each type is kept for the next allocation, the smaller of any two goes back to the driver
+    for (auto spare = _blocks.begin(); spare != _blocks.end(); ++spare)
+    {
+        if (spare->get() == block or (*spare)->memory_type != block->memory_type or (*spare)->used) continue;
+        gpu_block* const smaller = (*spare)->size < block->size ? spare->get() : block;
+
+        _blocks.erase(std::find_if(_blocks.begin(), _blocks.end(), [smaller](std::unique_ptr<gpu_block> const& b) {
+            return b.get() == smaller;
+        }));
+
+        return;
+    }
+}
\ No newline at end of file
@@ -0,0 +1,295 @@
+#include "render/gpu_profiler.h"
+
+#include <algorithm>
+#include <fstream>
+#include <numeric>
+
+#include "SDL_log.h"
+#include "tomway_utility.h"
+#include "Tracy.hpp"
+
+namespace
+{
+    // Results come back in bit order, vertex invocations first
+    vk::QueryPipelineStatisticFlags constexpr STATISTIC_FLAGS =
+        vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations
+        | vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations;
+
+    size_t constexpr STATISTIC_COUNT = 2;
+
+    tomway::gpu_profiler::pass_summary summarize(std::vector<double>& samples)
+    {
+        if (samples.empty()) return { 0.0, 0.0 };
+
+        double const average = std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+        // The smallest sample that at least 99% of the samples are at or below
+        size_t const p99_index = (samples.size() * 99 + 99) / 100 - 1;
+        std::nth_element(samples.begin(), samples.begin() + p99_index, samples.end());
+        return { average, samples[p99_index] };
+    }
+}
+
+char const* tomway::to_string(gpu_pass const pass)
+{
+    switch (pass)
+    {
+    case gpu_pass::UPLOAD:
+        return "upload";
+    case gpu_pass::CELLS:
+        return "cells";
+    case gpu_pass::UI:
+        return "ui";
+    default:
+        return "unknown";
+    }
+}
+
+void tomway::gpu_profiler::begin_frame(vk::CommandBuffer const& command_buffer, unsigned const frame)
+{
+    auto& queries = _frames[frame];
+    queries.frame_number = ++_recorded_frames;
+    queries.recorded = true;
+    queries.has_statistics = false;
+
+    if (_timestamp_pool_u)
+    {
+        command_buffer.resetQueryPool(
+            *_timestamp_pool_u,
+            static_cast<uint32_t>(frame * GPU_TIMESTAMP_COUNT),
+            static_cast<uint32_t>(GPU_TIMESTAMP_COUNT));
+    }
+
+    if (_statistics_pool_u) command_buffer.resetQueryPool(*_statistics_pool_u, frame, 1);
+}
+
+void tomway::gpu_profiler::begin_statistics(
+    vk::CommandBuffer const& command_buffer,
+    unsigned const frame,
+    bool const executes_secondaries)
+{
+    if (not _statistics_pool_u or (executes_secondaries and not _inherited_queries)) return;
+    command_buffer.beginQuery(*_statistics_pool_u, frame, {});
+    _frames[frame].has_statistics = true;
+}
+
+void tomway::gpu_profiler::end_statistics(vk::CommandBuffer const& command_buffer, unsigned const frame)
+{
+    if (_frames[frame].has_statistics) command_buffer.endQuery(*_statistics_pool_u, frame);
+}
+
+void tomway::gpu_profiler::collect(unsigned const frame)
+{
+    ZoneScoped;
+    auto& queries = _frames[frame];
+    if (not queries.recorded) return;
+    queries.recorded = false;
+    if (not _timestamp_pool_u and not queries.has_statistics) return;
+
+    gpu_frame_timings timings = {};
+    timings.frame = queries.frame_number;
+
+    // No wait flag, the frame's fence has already been waited on. A result that still isn't ready is dropped rather
+    // than waited for.
+    if (_timestamp_pool_u)
+    {
+        std::array<uint64_t, GPU_TIMESTAMP_COUNT> stamps;
+
+        auto const result = _device.getQueryPoolResults(
+            *_timestamp_pool_u,
+            static_cast<uint32_t>(frame * GPU_TIMESTAMP_COUNT), // First query
+            static_cast<uint32_t>(GPU_TIMESTAMP_COUNT), // Query count
+            sizeof(stamps),
+            stamps.data(),
+            sizeof(uint64_t), // Stride
+            vk::QueryResultFlagBits::e64);
+
+        if (result != vk::Result::eSuccess) return;
+
+        auto const elapsed_ms = [this, &stamps](size_t const first, size_t const last)
+        {
+            return ((stamps[last] - stamps[first]) & _timestamp_mask) * _timestamp_period / 1e6;
+        };
+
+        for (size_t pass = 0; pass < GPU_PASS_COUNT; pass++)
+        {
+            timings.pass_ms[pass] = elapsed_ms(pass, pass + 1);
+        }
+
+        timings.frame_ms = elapsed_ms(0, GPU_TIMESTAMP_COUNT - 1);
+    }
+
+    if (queries.has_statistics)
+    {
+        std::array<uint64_t, STATISTIC_COUNT> counts;
+
+        auto const result = _device.getQueryPoolResults(
+            *_statistics_pool_u,
+            frame, // First query
+            1, // Query count
+            sizeof(counts),
+            counts.data(),
+            sizeof(counts), // Stride
+            vk::QueryResultFlagBits::e64);
+
+        timings.has_statistics = result == vk::Result::eSuccess;
+        timings.vertex_invocations = timings.has_statistics ? counts[0] : 0;
+        timings.fragment_invocations = timings.has_statistics ? counts[1] : 0;
+    }
+
+    _history.push_back(timings);
+    if (_history.size() > HISTORY_FRAMES) _history.pop_front();
+}
+
+bool tomway::gpu_profiler::export_csv(std::string const& path) const
+{
+    ZoneScoped;
+    std::ofstream file(path, std::ios::trunc);
+
+    if (not file)
+    {
+        LOG_ERROR("Could not save GPU timings to %s.", path.c_str());
+        return false;
+    }
+
+    file << "frame,upload_ms,cells_ms,ui_ms,frame_ms,vertex_invocations,fragment_invocations\n";
+
+    for (auto const& timings : _history)
+    {
+        file << string_format(
+            "%llu,%.4f,%.4f,%.4f,%.4f,",
+            static_cast<unsigned long long>(timings.frame),
+            timings.pass_ms[static_cast<size_t>(gpu_pass::UPLOAD)],
+            timings.pass_ms[static_cast<size_t>(gpu_pass::CELLS)],
+            timings.pass_ms[static_cast<size_t>(gpu_pass::UI)],
+            timings.frame_ms);
+
+        // Left empty for frames the device couldn't count
+        if (timings.has_statistics)
+        {
+            file << string_format(
+                "%llu,%llu",
+                static_cast<unsigned long long>(timings.vertex_invocations),
+                static_cast<unsigned long long>(timings.fragment_invocations));
+        }
+        else
+        {
+            file << ",";
+        }
+
+        file << "\n";
+    }
+
+    if (not file)
+    {
+        LOG_ERROR("Could not save GPU timings to %s.", path.c_str());
+        return false;
+    }
+
+    LOG_INFO("GPU timings for %zu frames saved to %s.", _history.size(), path.c_str());
+    return true;
+}
+
+std::deque<tomway::gpu_frame_timings> const& tomway::gpu_profiler::get_history() const
+{
+    return _history;
+}
+
+vk::QueryPipelineStatisticFlags tomway::gpu_profiler::get_inherited_statistics() const
+{
+    return _inherited_queries ? STATISTIC_FLAGS : vk::QueryPipelineStatisticFlags();
+}
+
+tomway::gpu_profiler::pass_summary tomway::gpu_profiler::get_frame_summary() const
+{
+    std::vector<double> samples;
+    samples.reserve(_history.size());
+
+    for (auto const& timings : _history)
+    {
+        samples.push_back(timings.frame_ms);
+    }
+
+    return summarize(samples);
+}
+
+tomway::gpu_profiler::pass_summary tomway::gpu_profiler::get_pass_summary(gpu_pass const pass) const
+{
+    std::vector<double> samples;
+    samples.reserve(_history.size());
+
+    for (auto const& timings : _history)
+    {
+        samples.push_back(timings.pass_ms[static_cast<size_t>(pass)]);
+    }
+
+    return summarize(samples);
+}
+
+bool tomway::gpu_profiler::has_statistics() const
+{
+    return static_cast<bool>(_statistics_pool_u);
+}
+
+bool tomway::gpu_profiler::has_timestamps() const
+{
+    return static_cast<bool>(_timestamp_pool_u);
+}
+
+void tomway::gpu_profiler::init(
+    vk::PhysicalDevice const physical_device,
+    vk::Device const device,
+    uint32_t const queue_family,
+    unsigned const frames_in_flight,
+    bool const pipeline_statistics,
+    bool const inherited_queries)
+{
+    _device = device;
+    _frames.assign(frames_in_flight, {});
+    _inherited_queries = pipeline_statistics and inherited_queries;
+
+    // Queue families that can't write timestamps report no valid bits
+    uint32_t const valid_bits = physical_device.getQueueFamilyProperties()[queue_family].timestampValidBits;
+
+    if (valid_bits)
+    {
+        _timestamp_mask = valid_bits >= 64 ? ~uint64_t(0) : (uint64_t(1) << valid_bits) - 1;
+        _timestamp_period = physical_device.getProperties().limits.timestampPeriod;
+
+        _timestamp_pool_u = device.createQueryPoolUnique({
+            {}, // Flags
+            vk::QueryType::eTimestamp,
+            static_cast<uint32_t>(frames_in_flight * GPU_TIMESTAMP_COUNT) }); // Query count
+    }
+
+    if (pipeline_statistics)
+    {
+        _statistics_pool_u = device.createQueryPoolUnique({
+            {}, // Flags
+            vk::QueryType::ePipelineStatistics,
+            frames_in_flight, // Query count
+            STATISTIC_FLAGS });
+    }
+
+    LOG_INFO(
+        "GPU timestamps %s, pipeline statistics %s.",
+        valid_bits ? "available" : "not available",
+        not pipeline_statistics ? "not available" : _inherited_queries ? "available" : "available outside secondaries");
+}
+
+void tomway::gpu_profiler::write_timestamp(
+    vk::CommandBuffer const& command_buffer,
+    unsigned const frame,
+    gpu_timestamp const timestamp)
+{
+    if (not _timestamp_pool_u) return;
+
+    // The first stamp is taken as soon as the frame starts, the rest once everything before them has finished
+    vk::PipelineStageFlagBits const stage = timestamp == gpu_timestamp::FRAME_START
+        ? vk::PipelineStageFlagBits::eTopOfPipe
+        : vk::PipelineStageFlagBits::eBottomOfPipe;
+
+    command_buffer.writeTimestamp(
+        stage,
+        *_timestamp_pool_u,
+        static_cast<uint32_t>(frame * GPU_TIMESTAMP_COUNT + static_cast<size_t>(timestamp)));
+}
\ No newline at end of file
@@ -0,0 +1,56 @@
+#include "render/render_mode.h"
+
+tomway::render_mode tomway::next_render_mode(render_mode const mode)
+{
+    switch (mode)
+    {
+    case render_mode::VERTEX:
+        return render_mode::INSTANCED;
+    case render_mode::INSTANCED:
+        return render_mode::INCREMENTAL;
+    case render_mode::INCREMENTAL:
+        return render_mode::GPU_COMPACT;
+    case render_mode::GPU_COMPACT:
+        return render_mode::RAYCAST;
+    default:
+        return render_mode::VERTEX;
+    }
+}
+
+char const* tomway::to_string(render_mode const mode)
+{
+    switch (mode)
+    {
+    case render_mode::VERTEX:
+        return "vertex";
+    case render_mode::INSTANCED:
+        return "instanced";
+    case render_mode::INCREMENTAL:
+        return "incremental";
+    case render_mode::GPU_COMPACT:
+        return "gpu_compact";
+    case render_mode::RAYCAST:
+        return "raycast";
+    default:
+        return "unknown";
+    }
+}
+
+bool tomway::to_render_mode(std::string const& name, render_mode& mode)
+{
+    for (auto const candidate : {
+        render_mode::VERTEX,
+        render_mode::INSTANCED,
+        render_mode::INCREMENTAL,
+        render_mode::GPU_COMPACT,
+        render_mode::RAYCAST })
+    {
+        if (name == to_string(candidate))
+        {
+            mode = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -1,16 +1,132 @@
 #include <algorithm>
+#include <array>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <vector>
 
 #include "tomway_constants.h"
 #include "tomway_utility.h"
+#include "render/frustum.h"
 #include "render/render_system.h"
+#include "ui_system.h"
 
 #include "imgui_impl_vulkan.h"
+#include "SDL_filesystem.h"
 #include "Tracy.hpp"
 
+namespace
+{
+	// Room for this many live cells before the instance buffers have to grow
+	size_t constexpr INITIAL_INSTANCE_CAPACITY = 4096;
+	// Must match local_size_x in compact.comp
+	uint32_t constexpr COMPACTION_GROUP_SIZE = 64;
+	// Workgroups per dispatch dimension that every device supports
+	uint32_t constexpr MAX_DISPATCH_GROUPS = 65535;
+	// Tiles whose nearest cell would come out smaller than this many pixels are drawn as density quads
+	float constexpr DENSITY_CELL_PIXELS = 1.0f;
+	// Density quads are drawn from the coarsest pyramid level whose blocks are at most this many pixels across
+	float constexpr DENSITY_QUAD_PIXELS = 8.0f;
+	// The generation being drawn and the one uploading behind it
+	size_t constexpr VERTEX_BUFFER_SET_COUNT = 2;
+	size_t constexpr NO_VERTEX_SET = SIZE_MAX;
+	// Tiles on a side of a draw group, each group is drawn from its own secondary command buffer
+	uint32_t constexpr DRAW_GROUP_TILES = 8;
+	// Fewer tiles than this to record per part and handing the parts out costs more than it saves
+	size_t constexpr MIN_TILES_PER_WORKER = 64;
+
+	// The header every pipeline cache starts with, VkPipelineCacheHeaderVersionOne
+	struct pipeline_cache_header
+	{
+		uint32_t header_size;
+		uint32_t header_version;
+		uint32_t vendor_id;
+		uint32_t device_id;
+		uint8_t cache_uuid[VK_UUID_SIZE];
+	};
+
+	// In SDL's per-user preference folder rather than next to the executable, which may not be writable
+	std::string get_pipeline_cache_path()
+	{
+		char* const pref_path = SDL_GetPrefPath("tomway", "tomway");
+		std::string ret = pref_path ? pref_path : "";
+		SDL_free(pref_path);
+		return ret + "pipeline_cache.bin";
+	}
+
+	uint8_t face_bit(tomway::cell_face const face)
+	{
+		return static_cast<uint8_t>(1 << static_cast<uint8_t>(face));
+	}
+
+	// A face can only be seen from in front of its plane. The tile's bounds stand in for its cells, which keeps this
+	// conservative. Bottoms are only visible from under the board.
+	uint8_t get_visible_faces(tomway::cell_tile const& tile, glm::vec3 const& camera)
+	{
+		uint8_t faces = 0;
+		if (camera.z > tile.max.z) faces |= face_bit(tomway::cell_face::TOP);
+		if (camera.z < tile.min.z) faces |= face_bit(tomway::cell_face::BOTTOM);
+		if (camera.y < tile.max.y) faces |= face_bit(tomway::cell_face::BACK);
+		if (camera.y > tile.min.y) faces |= face_bit(tomway::cell_face::FRONT);
+		if (camera.x < tile.max.x) faces |= face_bit(tomway::cell_face::LEFT);
+		if (camera.x > tile.min.x) faces |= face_bit(tomway::cell_face::RIGHT);
+		return faces;
+	}
+
+	// Calls draw_range(first face, face count) for each run of consecutive visible faces, so neighbouring faces go
+	// out in one draw
+	template <typename F>
+	void for_each_face_range(uint8_t const faces, F const& draw_range)
+	{
+		uint8_t face = 0;
+
+		while (face < tomway::CELL_FACE_COUNT) {
+			if (not (faces >> face & 1)) {
+				face++;
+				continue;
+			}
+
+			uint8_t end = face;
+			while (end < tomway::CELL_FACE_COUNT and faces >> end & 1) end++;
+			draw_range(face, static_cast<uint8_t>(end - face));
+			face = end;
+		}
+	}
+
+	// Appends everything a tile's draws are recorded from, so an unchanged key means its recorded draws still hold
+	void append_tile_key(std::vector<uint64_t>& key, tomway::visible_tile const& visible)
+	{
+		tomway::cell_tile const& tile = *visible.tile;
+		uint32_t min_x;
+		uint32_t min_y;
+		memcpy(&min_x, &tile.min.x, sizeof(min_x));
+		memcpy(&min_y, &tile.min.y, sizeof(min_y));
+		key.push_back(uint64_t(tile.first_vertex) << 32 | tile.first_instance);
+		key.push_back(uint64_t(tile.cell_count) << 32 | uint64_t(tile.chunk) << 8 | visible.faces);
+		key.push_back(uint64_t(min_x) << 32 | min_y);
+	}
+
+	// Coarsest pyramid level whose blocks stay within DENSITY_QUAD_PIXELS and still line up with the tile's edges
+	size_t get_density_level(
+		tomway::cell_tile const& tile,
+		float const cell_pixels,
+		tomway::density_pyramid const& pyramid)
+	{
+		size_t level = 0;
+
+		while (level + 1 < pyramid.get_level_count()) {
+			size_t const block_size = tomway::density_pyramid::get_block_size(level + 1);
+			if (block_size * cell_pixels > DENSITY_QUAD_PIXELS or tile.size % block_size != 0) break;
+			level++;
+		}
+
+		return level;
+	}
+}
+
 static void check_vk_result(VkResult err)
 {
 	if (err == 0)
@@ -20,13 +136,18 @@ static void check_vk_result(VkResult err)
 		abort();
 }
 
-tomway::render_system::render_system(window_system& window_system, cell_geometry& cell_geometry, unsigned max_frames_in_flight)
+tomway::render_system::render_system(
+	window_system& window_system,
+	cell_geometry& cell_geometry,
+	worker_pool& workers,
+	unsigned max_frames_in_flight)
 	: _cell_geometry(cell_geometry),
 	  _curr_frame(0),
 	  _max_frames_in_flight(max_frames_in_flight),
 	  _queue_indices(),
 	  _swapchain_format(),
-	  _window_system(window_system)
+	  _window_system(window_system),
+	  _workers(workers)
 {
 	try {
 		create_vk_instance();
@@ -34,7 +155,8 @@ tomway::render_system::render_system(window_system& window_system, cell_geometry
 		_surface_u = _window_system.create_vulkan_surface(*_instance_u);
 		pick_physical_device();
 		create_logical_device();
-		create_swapchain();
+		create_pipeline_cache();
+		create_swapchain(nullptr);
 		create_image_views();
 		_render_pass_u = create_render_pass(_physical_device, *_device_u, _swapchain_format, vk::SampleCountFlagBits::e1);
 		create_descriptor_set_layout();
@@ -47,6 +169,9 @@ tomway::render_system::render_system(window_system& window_system, cell_geometry
 		create_uniform_buffers();
 		create_descriptor_pools();
 		create_descriptor_sets();
+		create_compaction_pipeline();
+		create_raycast_pipeline();
+		create_instance_buffers(INITIAL_INSTANCE_CAPACITY);
 	}
 	catch (std::exception const& e) {
 		LOG_ERROR("Failed to initialize render system with error: %s", e.what());
@@ -68,7 +193,7 @@ tomway::render_system::render_system(window_system& window_system, cell_geometry
 		static_cast<uint32_t>(_images.size()),
 		static_cast<uint32_t>(_images.size()),
 		static_cast<VkSampleCountFlagBits>(_msaa_samples),
-		{}, // Pipeline cache
+		*_pipeline_cache_u, // Pipeline cache
 		0, // Subpass
 		false, // Use dynamic rendering
 		{}, // Pipeline rendering create info
@@ -93,6 +218,9 @@ tomway::render_system::render_system(window_system& window_system, cell_geometry
 }
 
 tomway::render_system::~render_system() {
+	// Uploads on the transfer queue can still be running
+	_device_u->waitIdle();
+	save_pipeline_cache();
 	ImGui_ImplVulkan_Shutdown();
 
 	for (auto const ctx : _tracy_contexts) {
@@ -111,29 +239,157 @@ void tomway::copy_buffer(
 	command_buffer.copyBuffer(src, dst, copy_region);
 }
 
+// Secondaries continue the frame's render pass. They're recorded without a framebuffer so they can be executed against
+// any swapchain image, and they don't inherit any of the primary's state.
+void tomway::render_system::begin_secondary(vk::CommandBuffer const& command_buffer) {
+	vk::CommandBufferInheritanceInfo const inheritance_info(
+		*_render_pass_u,
+		0, // Subpass
+		nullptr, // Framebuffer
+		false, // Occlusion query enable
+		{}, // Query flags
+		_gpu_profiler.get_inherited_statistics()); // Pipeline statistics
+
+	command_buffer.begin({
+		vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+		&inheritance_info });
+
+	record_draw_state(command_buffer);
+}
+
+// Frustum culls the tiles, drops the faces the camera is behind, and sorts what's left front to back so early depth
+// testing rejects as much as it can. Tiles far enough away that their cells would be smaller than a pixel are drawn
+// from the density pyramid instead.
+void tomway::render_system::cull_tiles(transform const& transform) {
+	ZoneScoped;
+	_visible_tiles.clear();
+	_density_quads.clear();
+	_density_tile_count = 0;
+	_tile_count = 0;
+	if (_render_mode != render_mode::VERTEX and _render_mode != render_mode::INSTANCED) return;
+	std::vector<cell_tile> const* tiles_drawn = &_cell_geometry.get_tiles();
+
+	// The vertex path draws the last generation that finished uploading, which can be behind the geometry
+	if (_render_mode == render_mode::VERTEX) {
+		if (_drawn_vertex_set == NO_VERTEX_SET) return;
+		tiles_drawn = &_vertex_buffer_sets[_drawn_vertex_set].tiles;
+	}
+
+	auto const& tiles = *tiles_drawn;
+	_tile_count = tiles.size();
+	glm::mat4 const model_view = transform.view * transform.model;
+	frustum const view_frustum(transform.projection * model_view);
+	glm::vec3 const camera(glm::inverse(model_view)[3]);
+	auto const& pyramid = _cell_geometry.get_density_pyramid();
+	// Pixels covered by one world unit at a distance of one
+	float const focal_pixels = std::abs(transform.projection[1][1]) * _swapchain_extent.height / 2.0f;
+	float const spacing = cell_geometry::get_cell_spacing();
+
+	for (auto const& tile : tiles) {
+		if (not view_frustum.intersects(tile.min, tile.max)) continue;
+		float const distance = glm::length(camera - glm::clamp(camera, tile.min, tile.max));
+
+		if (spacing * focal_pixels < DENSITY_CELL_PIXELS * distance) {
+			float const cell_pixels = spacing * focal_pixels / distance;
+			_cell_geometry.append_density_quads(tile, get_density_level(tile, cell_pixels, pyramid), _density_quads);
+			_density_tile_count++;
+			continue;
+		}
+
+		uint8_t const faces = get_visible_faces(tile, camera);
+		if (not faces) continue;
+		glm::vec3 const to_center = (tile.min + tile.max) * 0.5f - camera;
+		_visible_tiles.push_back({ &tile, faces, glm::dot(to_center, to_center) });
+	}
+
+	std::sort(_visible_tiles.begin(), _visible_tiles.end(), [](visible_tile const& lhs, visible_tile const& rhs) {
+		return lhs.distance_sq < rhs.distance_sq;
+	});
+}
+
+// The bit-packed board as the simulation stores it, uploaded through each frame's board staging buffer
+void tomway::render_system::create_board_buffers(size_t const size) {
+	ZoneScoped;
+
+	create_buffer(
+		size,
+		vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+		vk::SharingMode::eExclusive,
+		vk::MemoryPropertyFlagBits::eDeviceLocal,
+		_board_buffer_u,
+		_board_buffer_memory_u);
+
+	_board_capacity_bytes = size;
+	update_compaction_descriptor_set();
+	update_raycast_descriptor_set();
+	LOG_INFO("Board buffers created with %zu bytes.", size);
+}
+
 void tomway::render_system::create_buffer(
 	size_t const size,
 	vk::BufferUsageFlags const usage_flags,
 	vk::SharingMode const sharing_mode,
 	vk::MemoryPropertyFlags const memory_property_flags,
 	vk::UniqueBuffer& buffer_u,
-	vk::UniqueDeviceMemory& buffer_memory_u)
+	gpu_memory& buffer_memory_u)
 {
-	vk::BufferCreateInfo const buffer_info(
+	vk::BufferCreateInfo buffer_info(
 		{}, // Flags
 		size,
 		usage_flags,
 		sharing_mode);
 
+	// Concurrent buffers are shared by the graphics and transfer queue families
+	if (sharing_mode == vk::SharingMode::eConcurrent) buffer_info.setQueueFamilyIndices(_upload_queue_families);
+
 	buffer_u = _device_u->createBufferUnique(buffer_info);
 	auto const mem_requirements = _device_u->getBufferMemoryRequirements(*buffer_u);
 
-	vk::MemoryAllocateInfo const allocate_info(
-		mem_requirements.size,
+	buffer_memory_u = _allocator.allocate(
+		mem_requirements,
 		find_memory_type(mem_requirements.memoryTypeBits, memory_property_flags));
-	
-	buffer_memory_u = _device_u->allocateMemoryUnique(allocate_info);
-	_device_u->bindBufferMemory(*buffer_u, *buffer_memory_u, 0);
+
+	_device_u->bindBufferMemory(*buffer_u, buffer_memory_u.get_memory(), buffer_memory_u.get_offset());
+}
+
+// The shared cube every instance draws, followed by the background quad for the current grid size. It's tiny and
+// only rebuilt when the grid size changes, so it goes through a one-off staging buffer.
+void tomway::render_system::create_cell_mesh_buffer() {
+	ZoneScoped;
+	auto const& cell_mesh = cell_geometry::get_cell_mesh();
+	auto const background = _cell_geometry.get_background_vertices();
+	size_t const mesh_bytes = cell_mesh.size() * sizeof(vertex);
+	size_t const buffer_size = mesh_bytes + background.size() * sizeof(vertex);
+
+	vk::UniqueBuffer staging_buffer_u;
+	gpu_memory staging_buffer_memory_u;
+
+	create_buffer(
+		buffer_size,
+		vk::BufferUsageFlagBits::eTransferSrc,
+		vk::SharingMode::eExclusive,
+		vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+		staging_buffer_u,
+		staging_buffer_memory_u);
+
+	auto const staging_memory = static_cast<char*>(staging_buffer_memory_u.get_mapped());
+	memcpy(staging_memory, cell_mesh.data(), mesh_bytes);
+	memcpy(staging_memory + mesh_bytes, background.data(), background.size() * sizeof(vertex));
+
+	create_buffer(
+		buffer_size,
+		vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
+		vk::SharingMode::eExclusive,
+		vk::MemoryPropertyFlagBits::eDeviceLocal,
+		_cell_mesh_buffer_u,
+		_cell_mesh_buffer_memory_u);
+
+	submit_one_time_commands([&](vk::CommandBuffer const& command_buffer) {
+		copy_buffer(command_buffer, *staging_buffer_u, *_cell_mesh_buffer_u, buffer_size);
+	});
+
+	_instance_buffer_generation++;
+	LOG_INFO("Cell mesh buffer created.");
 }
 
 void tomway::render_system::create_command_buffer() {
@@ -142,6 +398,22 @@ void tomway::render_system::create_command_buffer() {
 		vk::CommandBufferLevel::ePrimary,
 		_max_frames_in_flight });
 
+	_main_command_buffers_u = _device_u->allocateCommandBuffersUnique({
+		*_command_pool_u,
+		vk::CommandBufferLevel::eSecondary,
+		_max_frames_in_flight });
+
+	_vertex_buffer_sets.resize(VERTEX_BUFFER_SET_COUNT);
+
+	for (auto& set : _vertex_buffer_sets) {
+		auto upload_command_buffers_u = _device_u->allocateCommandBuffersUnique({
+			*_transfer_command_pool_u,
+			vk::CommandBufferLevel::ePrimary,
+			1 });
+
+		set.upload_command_buffer_u = std::move(upload_command_buffers_u[0]);
+	}
+
 	LOG_INFO("Command buffer created.");
 }
 
@@ -153,9 +425,73 @@ void tomway::render_system::create_command_pool() {
 		queue_fam_indices.graphics_family
 	});
 
+	_transfer_command_pool_u = _device_u->createCommandPoolUnique({
+		vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient,
+		queue_fam_indices.transfer_family
+	});
+
 	LOG_INFO("Command pool created.");
 }
 
+// Compute pipeline that turns the board's bits into instances, plus the indirect draw command it fills in
+void tomway::render_system::create_compaction_pipeline() {
+	std::array<vk::DescriptorSetLayoutBinding, 3> bindings;
+
+	for (uint32_t i = 0; i < bindings.size(); i++) {
+		bindings[i] = vk::DescriptorSetLayoutBinding(
+			i, // Binding
+			vk::DescriptorType::eStorageBuffer,
+			1, // Descriptor count
+			vk::ShaderStageFlagBits::eCompute,
+			nullptr); // Immutable samplers
+	}
+
+	vk::DescriptorSetLayoutCreateInfo const layout_info({}, bindings); // Flags, bindings
+	_compaction_descriptor_set_layout_u = _device_u->createDescriptorSetLayoutUnique(layout_info);
+
+	vk::PushConstantRange const push_constant_range(
+		vk::ShaderStageFlagBits::eCompute,
+		0, // Offset
+		sizeof(board_layout_push_constants));
+
+	vk::PipelineLayoutCreateInfo const pipeline_layout_info(
+		{}, // Flags
+		*_compaction_descriptor_set_layout_u, // Descriptor set layouts
+		push_constant_range); // Push constant ranges
+
+	_compaction_pipeline_layout_u = _device_u->createPipelineLayoutUnique(pipeline_layout_info);
+
+	vk::UniqueShaderModule comp_shader_module_u = create_shader_module(*_device_u, COMPACT_COMP_SHADER);
+	vk::PipelineShaderStageCreateInfo comp_stage_create_info({}, vk::ShaderStageFlagBits::eCompute, *comp_shader_module_u, "main");
+
+	vk::ComputePipelineCreateInfo const pipeline_create_info(
+		{}, // Flags
+		comp_stage_create_info,
+		*_compaction_pipeline_layout_u);
+
+	_compaction_pipeline_u = _device_u->createComputePipelineUnique(*_pipeline_cache_u, pipeline_create_info).value;
+
+	vk::DescriptorPoolSize const pool_size(vk::DescriptorType::eStorageBuffer, static_cast<uint32_t>(bindings.size()));
+	vk::DescriptorPoolCreateInfo const pool_info(
+		{}, // Flags
+		1, // Max sets
+		pool_size); // Pool sizes array
+
+	_descriptor_pool_compaction_u = _device_u->createDescriptorPoolUnique(pool_info);
+	vk::DescriptorSetAllocateInfo const allocate_info(*_descriptor_pool_compaction_u, *_compaction_descriptor_set_layout_u);
+	_compaction_descriptor_set = _device_u->allocateDescriptorSets(allocate_info)[0];
+
+	create_buffer(
+		sizeof(vk::DrawIndirectCommand),
+		vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst,
+		vk::SharingMode::eExclusive,
+		vk::MemoryPropertyFlagBits::eDeviceLocal,
+		_draw_command_buffer_u,
+		_draw_command_buffer_memory_u);
+
+	LOG_INFO("Compaction pipeline created.");
+}
+
 void tomway::render_system::create_depth_resources()
 {
 	vk::Format const depth_format = find_depth_format(_physical_device);
@@ -266,12 +602,215 @@ void tomway::render_system::create_framebuffers() {
 }
 
 void tomway::render_system::create_graphics_pipeline() {
-	// TODO - make this configurable, probably a list of shaders to create or something
-	std::vector<char> frag_shader_bytes = read_shader_bytes("shaders/frag.spv");
-	std::vector<char> vert_shader_bytes = read_shader_bytes("shaders/vert.spv");
+	vk::PushConstantRange const push_constant_range(
+		vk::ShaderStageFlagBits::eVertex,
+		0, // Offset
+		sizeof(cell_grid_push_constants));
+
+	vk::PipelineLayoutCreateInfo pipeline_layout_info(
+		{}, // Flags
+		*_descriptor_set_layout_u, // Descriptor set layouts
+		push_constant_range); // Push constant ranges
+
+	_pipeline_layout_u = _device_u->createPipelineLayoutUnique(pipeline_layout_info);
+
+	// Vertex input descriptions
+	auto binding_desc = vertex::get_binding_description();
+	auto attribute_desc = vertex::get_attribute_descriptions();
+
+	// How we pass input to the vertex shader
+	vk::PipelineVertexInputStateCreateInfo vertex_input_state(
+		{}, // Flags
+		binding_desc,
+		attribute_desc);
+
+	_graphics_pipeline_u = create_pipeline(VERT_SHADER, FRAG_SHADER, vertex_input_state, *_pipeline_layout_u);
+
+	// The instanced pipeline reads the shared mesh from binding 0 and one cell coordinate per instance from binding 1
+	std::array<vk::VertexInputBindingDescription, 2> const instanced_binding_desc {
+		binding_desc,
+		vk::VertexInputBindingDescription(1, sizeof(cell_coord), vk::VertexInputRate::eInstance) // Binding, stride, rate
+	};
+
+	std::array<vk::VertexInputAttributeDescription, 2> const instanced_attribute_desc {
+		attribute_desc[0],
+		vk::VertexInputAttributeDescription(1, 1, vk::Format::eR32G32Uint, offsetof(cell_coord, x)) // Location, binding, format, offset
+	};
+
+	vk::PipelineVertexInputStateCreateInfo instanced_vertex_input_state(
+		{}, // Flags
+		instanced_binding_desc,
+		instanced_attribute_desc);
+
+	_instanced_pipeline_u = create_pipeline(
+		INSTANCED_VERT_SHADER,
+		FRAG_SHADER,
+		instanced_vertex_input_state,
+		*_pipeline_layout_u);
+
+	// The density pipeline reads one quad per instance, the corners come from the vertex index
+	vk::VertexInputBindingDescription const density_binding_desc(0, sizeof(density_quad), vk::VertexInputRate::eInstance); // Binding, stride, rate
+
+	std::array<vk::VertexInputAttributeDescription, 3> const density_attribute_desc {
+		vk::VertexInputAttributeDescription(0, 0, vk::Format::eR32G32B32Sfloat, offsetof(density_quad, min)), // Location, binding, format, offset
+		vk::VertexInputAttributeDescription(1, 0, vk::Format::eR32Sfloat, offsetof(density_quad, coverage)),
+		vk::VertexInputAttributeDescription(2, 0, vk::Format::eR32G32Sfloat, offsetof(density_quad, size))
+	};
+
+	vk::PipelineVertexInputStateCreateInfo density_vertex_input_state(
+		{}, // Flags
+		density_binding_desc,
+		density_attribute_desc);
+
+	_density_pipeline_u = create_pipeline(
+		DENSITY_VERT_SHADER,
+		FRAG_SHADER,
+		density_vertex_input_state,
+		*_pipeline_layout_u);
+
+	LOG_INFO("Graphics pipelines created.");
+}
+		
+void tomway::render_system::create_image_u(uint32_t width,uint32_t height, vk::Format image_format, vk::ImageTiling tiling_flags,
+	vk::ImageUsageFlagBits image_usage_flags, vk::MemoryPropertyFlagBits memory_property_flags,
+	vk::UniqueImage& image_u, vk::UniqueDeviceMemory& memory_u)
+{
+	vk::ImageCreateInfo const image_create_info {
+		{}, // Flags
+		vk::ImageType::e2D,
+		image_format,
+		{ width, height, 1 }, // Extent3D(width, height, depth)
+		1, // mip levels
+		1, // array layers
+		vk::SampleCountFlagBits::e1,
+		tiling_flags,
+		image_usage_flags,
+		vk::SharingMode::eExclusive,
+		{}, // Queue family index count
+		{}, // Queue family indices
+		vk::ImageLayout::eUndefined, // Initial image layout
+	};
+
+	image_u = _device_u->createImageUnique(image_create_info);
+	vk::MemoryRequirements const memory_requirements = _device_u->getImageMemoryRequirements(*image_u);
+	uint32_t const memory_type = find_memory_type(memory_requirements.memoryTypeBits, memory_property_flags);
+
+	vk::MemoryAllocateInfo const alloc_info {
+		memory_requirements.size,
+		memory_type
+	};
+
+	memory_u = _device_u->allocateMemoryUnique(alloc_info, nullptr);
+	_device_u->bindImageMemory(*image_u, *memory_u, 0);
+}
+
+void tomway::render_system::create_image_views() {
+	_image_views_u.clear();
+
+	for (auto image : _images) {
+		_image_views_u.push_back(create_image_view(_device_u.get(), image, _swapchain_format, vk::ImageAspectFlagBits::eColor, 1));
+	}
+
+	LOG_INFO("Image views created.");
+}
+
+void tomway::render_system::create_instance_buffers(size_t const capacity) {
+	ZoneScoped;
+	size_t const buffer_size = std::min(capacity * sizeof(cell_coord), _max_mem_allocation_size);
+
+	create_buffer(
+		buffer_size,
+		vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst,
+		vk::SharingMode::eExclusive,
+		vk::MemoryPropertyFlagBits::eDeviceLocal,
+		_instance_buffer_u,
+		_instance_buffer_memory_u);
+
+	_instance_capacity = buffer_size / sizeof(cell_coord);
+	_instance_buffer_generation++;
+	update_compaction_descriptor_set();
+	LOG_INFO("Instance buffers created with room for %zu cells.", _instance_capacity);
+}
+
+void tomway::render_system::create_logical_device() {
+	if (_validation_layers.size() > 0 && !check_validation_layer_support(_validation_layers)) {
+		throw new std::runtime_error("Requested validation layers not available!");
+	}
+
+	auto const supported_features = _physical_device.getFeatures();
+	vk::PhysicalDeviceFeatures deviceFeatures{};
+	deviceFeatures.samplerAnisotropy = supported_features.samplerAnisotropy;
+	// Optional, for the profiler's invocation counts. Inherited queries let the count cover the tile secondaries.
+	deviceFeatures.pipelineStatisticsQuery = supported_features.pipelineStatisticsQuery;
+	deviceFeatures.inheritedQueries = supported_features.inheritedQueries;
+
+	std::vector<unsigned> queueFams = { _queue_indices.graphics_family };
+
+	if (_queue_indices.graphics_family != _queue_indices.present_family) {
+		queueFams.push_back(_queue_indices.present_family);
+	}
 
-	vk::UniqueShaderModule frag_shader_module_u = create_shader_module(*_device_u, frag_shader_bytes);
-	vk::UniqueShaderModule vert_shader_module_u = create_shader_module(*_device_u, vert_shader_bytes);
+	bool const separate_transfer = _queue_indices.transfer_family != _queue_indices.graphics_family;
+
+	if (separate_transfer and _queue_indices.transfer_family != _queue_indices.present_family) {
+		queueFams.push_back(_queue_indices.transfer_family);
+	}
+
+	// Uploads are tracked with timeline semaphores, core since Vulkan 1.2
+	vk::PhysicalDeviceVulkan12Features features12;
+	features12.timelineSemaphore = vk::True;
+
+	// Optional, the allocator reports the driver's budget for each heap when it's there
+	std::vector<const char*> extensions = _required_device_extensions;
+	bool const has_memory_budget = check_device_extension_support(_physical_device, { vk::EXTMemoryBudgetExtensionName });
+	if (has_memory_budget) extensions.push_back(vk::EXTMemoryBudgetExtensionName);
+
+	std::vector<vk::DeviceQueueCreateInfo> createInfos(queueFams.size());
+	float queuePriority = 1.0f;
+
+	for (int i = 0; i < createInfos.size(); i++) {
+		createInfos[i].queueFamilyIndex = queueFams[i];
+		createInfos[i].queueCount = 1;
+		createInfos[i].pQueuePriorities = &queuePriority;
+	}
+
+	vk::DeviceCreateInfo deviceCreateInfo(
+		{}, // Flags
+		(uint32_t)createInfos.size(), createInfos.data(), // Queue create infos
+		(uint32_t)_validation_layers.size(), _validation_layers.data(), // Enabled layers
+		(uint32_t)extensions.size(), extensions.data(), // Extensions
+		&deviceFeatures, // Device features
+		&features12); // pNext
+
+	_device_u = _physical_device.createDeviceUnique(deviceCreateInfo);
+	_graphics_queue = _device_u->getQueue(_queue_indices.graphics_family, 0);
+	_present_queue = _device_u->getQueue(_queue_indices.present_family, 0);
+	_transfer_queue = _device_u->getQueue(_queue_indices.transfer_family, 0);
+	_allocator.init(_physical_device, *_device_u, _max_mem_allocation_size, has_memory_budget);
+
+	_gpu_profiler.init(
+		_physical_device,
+		*_device_u,
+		_queue_indices.graphics_family,
+		_max_frames_in_flight,
+		supported_features.pipelineStatisticsQuery,
+		supported_features.inheritedQueries);
+
+	_upload_queue_families = { _queue_indices.graphics_family };
+	if (separate_transfer) _upload_queue_families.push_back(_queue_indices.transfer_family);
+	LOG_INFO("Logical device created.");
+	LOG_INFO("Memory budget %s.", has_memory_budget ? "reported by the driver" : "not available");
+	LOG_INFO("Uploads use queue family %u%s.", _queue_indices.transfer_family, separate_transfer ? ", a dedicated transfer family" : ", shared with graphics");
+}
+
+vk::UniquePipeline tomway::render_system::create_pipeline(
+	shader_code const& vert_shader,
+	shader_code const& frag_shader,
+	vk::PipelineVertexInputStateCreateInfo const& vertex_input_state,
+	vk::PipelineLayout const& pipeline_layout)
+{
+	vk::UniqueShaderModule frag_shader_module_u = create_shader_module(*_device_u, frag_shader);
+	vk::UniqueShaderModule vert_shader_module_u = create_shader_module(*_device_u, vert_shader);
 
 	vk::PipelineShaderStageCreateInfo frag_stage_create_info({}, vk::ShaderStageFlagBits::eFragment, *frag_shader_module_u, "main");
 	vk::PipelineShaderStageCreateInfo vert_stage_create_info({}, vk::ShaderStageFlagBits::eVertex, *vert_shader_module_u, "main");
@@ -285,16 +824,6 @@ void tomway::render_system::create_graphics_pipeline() {
 
 	vk::PipelineDynamicStateCreateInfo dynamic_state({}, dynamic_states);
 
-	// Vertex input descriptions
-	auto binding_desc = vertex::get_binding_description();
-	auto attribute_desc = vertex::get_attribute_descriptions();
-
-	// How we pass input to the vertex shader
-	vk::PipelineVertexInputStateCreateInfo vertex_input_state(
-		{}, // Flags
-		binding_desc,
-		attribute_desc);
-
 	vk::PipelineInputAssemblyStateCreateInfo input_assembly(
 		{}, // Flags
 		vk::PrimitiveTopology::eTriangleList, //Topology
@@ -345,13 +874,6 @@ void tomway::render_system::create_graphics_pipeline() {
 		color_blend_attachment, // Attachments
 		{ 0.0f, 0.0f, 0.0f, 0.0f }); // Blend constants
 
-	vk::PipelineLayoutCreateInfo pipeline_layout_info(
-		{}, // Flags
-		*_descriptor_set_layout_u, // Descriptor set layouts
-		nullptr); // Push constant ranges
-
-	_pipeline_layout_u = _device_u->createPipelineLayoutUnique(pipeline_layout_info);
-
 	vk::PipelineDepthStencilStateCreateInfo depth_stencil_create_info {
 		{}, // Flags
 		vk::True, // Depth test enable
@@ -378,97 +900,98 @@ void tomway::render_system::create_graphics_pipeline() {
 		&depth_stencil_create_info,
 		&color_blending,
 		&dynamic_state,
-		*_pipeline_layout_u,
+		pipeline_layout,
 		*_render_pass_u,
 		0, // Subpass
 		nullptr, // Base pipeline handle
 		-1); // Base pipeline index
 
-	_graphics_pipeline_u = _device_u->createGraphicsPipelineUnique(nullptr, pipeline_create_info).value;
-	LOG_INFO("Graphics pipeline created.");
+	return _device_u->createGraphicsPipelineUnique(*_pipeline_cache_u, pipeline_create_info).value;
 }
-		
-void tomway::render_system::create_image_u(uint32_t width,uint32_t height, vk::Format image_format, vk::ImageTiling tiling_flags,
-	vk::ImageUsageFlagBits image_usage_flags, vk::MemoryPropertyFlagBits memory_property_flags,
-	vk::UniqueImage& image_u, vk::UniqueDeviceMemory& memory_u)
-{
-	vk::ImageCreateInfo const image_create_info {
-		{}, // Flags
-		vk::ImageType::e2D,
-		image_format,
-		{ width, height, 1 }, // Extent3D(width, height, depth)
-		1, // mip levels
-		1, // array layers
-		vk::SampleCountFlagBits::e1,
-		tiling_flags,
-		image_usage_flags,
-		vk::SharingMode::eExclusive,
-		{}, // Queue family index count
-		{}, // Queue family indices
-		vk::ImageLayout::eUndefined, // Initial image layout
-	};
 
-	image_u = _device_u->createImageUnique(image_create_info);
-	vk::MemoryRequirements const memory_requirements = _device_u->getImageMemoryRequirements(*image_u);
-	uint32_t const memory_type = find_memory_type(memory_requirements.memoryTypeBits, memory_property_flags);
-
-	vk::MemoryAllocateInfo const alloc_info {
-		memory_requirements.size,
-		memory_type
-	};
+// Seeded from the last run's cache when it was written by this device and driver. Drivers are supposed to reject a
+// cache that isn't theirs, but not all of them do it gracefully, so the header is checked here first.
+void tomway::render_system::create_pipeline_cache() {
+	ZoneScoped;
+	std::string const path = get_pipeline_cache_path();
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+	std::vector<char> data;
+
+	if (file.is_open()) {
+		data.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(data.data(), static_cast<std::streamsize>(data.size()));
+		if (not file) data.clear();
+	}
 
-	memory_u = _device_u->allocateMemoryUnique(alloc_info, nullptr);
-	_device_u->bindImageMemory(*image_u, *memory_u, 0);
-}
+	auto const properties = _physical_device.getProperties();
+	pipeline_cache_header header = {};
+	bool valid = data.size() >= sizeof(header);
+	if (valid) memcpy(&header, data.data(), sizeof(header));
 
-void tomway::render_system::create_image_views() {
-	_image_views_u.clear();
+	valid = valid
+		and header.header_size >= sizeof(header)
+		and header.header_version == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		and header.vendor_id == properties.vendorID
+		and header.device_id == properties.deviceID
+		and memcmp(header.cache_uuid, properties.pipelineCacheUUID.data(), VK_UUID_SIZE) == 0;
 
-	for (auto image : _images) {
-		_image_views_u.push_back(create_image_view(_device_u.get(), image, _swapchain_format, vk::ImageAspectFlagBits::eColor, 1));
+	if (not valid and not data.empty()) {
+		LOG_INFO("Pipeline cache at %s is from another device or driver, starting a new one.", path.c_str());
 	}
 
-	LOG_INFO("Image views created.");
+	if (not valid) data.clear();
+	vk::PipelineCacheCreateInfo const create_info({}, data.size(), data.data()); // Flags, initial data size, initial data
+	_pipeline_cache_u = _device_u->createPipelineCacheUnique(create_info);
+	LOG_INFO("Pipeline cache created with %zu bytes from the last run.", data.size());
 }
 
-void tomway::render_system::create_logical_device() {
-	if (_validation_layers.size() > 0 && !check_validation_layer_support(_validation_layers)) {
-		throw new std::runtime_error("Requested validation layers not available!");
-	}
+// Full screen pass that raycasts the board's bits, it reads the same board buffer the compaction pass does
+void tomway::render_system::create_raycast_pipeline() {
+	vk::DescriptorSetLayoutBinding const binding(
+		0, // Binding
+		vk::DescriptorType::eStorageBuffer,
+		1, // Descriptor count
+		vk::ShaderStageFlagBits::eFragment,
+		nullptr); // Immutable samplers
 
-	vk::PhysicalDeviceFeatures deviceFeatures{};
-	deviceFeatures.samplerAnisotropy = true;
+	vk::DescriptorSetLayoutCreateInfo const layout_info({}, binding); // Flags, bindings
+	_raycast_descriptor_set_layout_u = _device_u->createDescriptorSetLayoutUnique(layout_info);
 
-	std::vector<unsigned> queueFams = { _queue_indices.graphics_family };
+	vk::PushConstantRange const push_constant_range(
+		vk::ShaderStageFlagBits::eFragment,
+		0, // Offset
+		sizeof(raycast_push_constants));
 
-	if (_queue_indices.graphics_family != _queue_indices.present_family) {
-		queueFams.push_back(_queue_indices.present_family);
-	}
+	vk::PipelineLayoutCreateInfo const pipeline_layout_info(
+		{}, // Flags
+		*_raycast_descriptor_set_layout_u, // Descriptor set layouts
+		push_constant_range); // Push constant ranges
 
-	std::vector<vk::DeviceQueueCreateInfo> createInfos(queueFams.size());
-	float queuePriority = 1.0f;
+	_raycast_pipeline_layout_u = _device_u->createPipelineLayoutUnique(pipeline_layout_info);
 
-	for (int i = 0; i < createInfos.size(); i++) {
-		createInfos[i].queueFamilyIndex = queueFams[i];
-		createInfos[i].queueCount = 1;
-		createInfos[i].pQueuePriorities = &queuePriority;
-	}
+	// The full screen triangle comes from the vertex index, there's nothing to read
+	vk::PipelineVertexInputStateCreateInfo const vertex_input_state;
 
-	vk::DeviceCreateInfo deviceCreateInfo(
+	_raycast_pipeline_u = create_pipeline(
+		RAYCAST_VERT_SHADER,
+		RAYCAST_FRAG_SHADER,
+		vertex_input_state,
+		*_raycast_pipeline_layout_u);
+
+	vk::DescriptorPoolSize const pool_size(vk::DescriptorType::eStorageBuffer, 1);
+	vk::DescriptorPoolCreateInfo const pool_info(
 		{}, // Flags
-		(uint32_t)createInfos.size(), createInfos.data(), // Queue create infos
-		(uint32_t)_validation_layers.size(), _validation_layers.data(), // Enabled layers
-		(uint32_t)_required_device_extensions.size(), _required_device_extensions.data(), // Extensions
-		&deviceFeatures, // Device features
-		NULL); // pNext
+		1, // Max sets
+		pool_size); // Pool sizes array
 
-	_device_u = _physical_device.createDeviceUnique(deviceCreateInfo);
-	_graphics_queue = _device_u->getQueue(_queue_indices.graphics_family, 0);
-	_present_queue = _device_u->getQueue(_queue_indices.present_family, 0);
-	LOG_INFO("Logical device created.");
+	_descriptor_pool_raycast_u = _device_u->createDescriptorPoolUnique(pool_info);
+	vk::DescriptorSetAllocateInfo const allocate_info(*_descriptor_pool_raycast_u, *_raycast_descriptor_set_layout_u);
+	_raycast_descriptor_set = _device_u->allocateDescriptorSets(allocate_info)[0];
+	LOG_INFO("Raycast pipeline created.");
 }
 
-void tomway::render_system::create_swapchain() {
+void tomway::render_system::create_swapchain(vk::SwapchainKHR const old_swapchain) {
 	SwapchainSupportDetails details = {
 		_physical_device.getSurfaceCapabilitiesKHR(*_surface_u),
 		_physical_device.getSurfaceFormatsKHR(*_surface_u),
@@ -508,7 +1031,7 @@ void tomway::render_system::create_swapchain() {
 		, vk::CompositeAlphaFlagBitsKHR::eOpaque
 		, presentMode
 		, true // clipped
-		, *_swapchain_u); // Old swapchain
+		, old_swapchain); // Old swapchain
 
 	_swapchain_u = _device_u->createSwapchainKHRUnique(createInfo);
 	_images = _device_u->getSwapchainImagesKHR(*_swapchain_u);
@@ -528,6 +1051,11 @@ void tomway::render_system::create_sync_objects() {
 		_in_flight_fences_u[i] = _device_u->createFenceUnique({ vk::FenceCreateFlagBits::eSignaled });
 	}
 
+	// Each counts up once per submission, graphics for frames and transfer for vertex uploads
+	vk::SemaphoreTypeCreateInfo timeline_info(vk::SemaphoreType::eTimeline, 0); // Type, initial value
+	_frame_timeline_u = _device_u->createSemaphoreUnique({ {}, &timeline_info }); // Flags, pNext
+	_transfer_timeline_u = _device_u->createSemaphoreUnique({ {}, &timeline_info }); // Flags, pNext
+
 	LOG_INFO("Synchronization objects created.");
 }
 
@@ -546,26 +1074,27 @@ void tomway::render_system::create_uniform_buffers() {
 			_uniform_buffers_u[i],
 			_uniform_buffers_memory_u[i]);
 
-		_uniform_buffers_mapped[i] = _device_u->mapMemory(*_uniform_buffers_memory_u[i], 0, buffer_size);
+		_uniform_buffers_mapped[i] = _uniform_buffers_memory_u[i].get_mapped();
 	}
 	
 	LOG_INFO("Uniform buffers created.");
 }
 
-void tomway::render_system::create_vertex_buffers(std::vector<vertex_chunk> const& chunks) {
+// Only called for a set that no frame in flight or upload is using
+void tomway::render_system::create_vertex_buffers(vertex_buffer_set& set, std::vector<vertex_chunk> const& chunks) {
 	ZoneScoped;
 
 	{
 		ZoneScopedN("tomway::render_system::create_vertex_buffers | Cleanup old vertex buffers");
-		_vertex_buffers_u.clear();
-		_vertex_buffers_u.resize(chunks.size());
-		_vertex_buffers_memory_u.clear();
-		_vertex_buffers_memory_u.resize(chunks.size());
-		_vertex_staging_buffers_u.clear();
-		_vertex_staging_buffers_u.resize(chunks.size());
-		_vertex_staging_buffers_memory_u.clear();
-		_vertex_staging_buffers_memory_u.resize(chunks.size());
-		_vertex_staging_memory.resize(chunks.size());
+		set.buffers_u.clear();
+		set.buffers_u.resize(chunks.size());
+		set.buffers_memory_u.clear();
+		set.buffers_memory_u.resize(chunks.size());
+		set.staging_buffers_u.clear();
+		set.staging_buffers_u.resize(chunks.size());
+		set.staging_buffers_memory_u.clear();
+		set.staging_buffers_memory_u.resize(chunks.size());
+		set.mapped.resize(chunks.size());
 	}
 
 	{
@@ -573,26 +1102,42 @@ void tomway::render_system::create_vertex_buffers(std::vector<vertex_chunk> cons
 		
 		for (size_t i = 0; i < chunks.size(); i++)
 		{
+			if (_vertex_upload_strategy == vertex_upload_strategy::DIRECT)
+			{
+				create_buffer(
+					chunks[i].max_size_bytes,
+					vk::BufferUsageFlagBits::eVertexBuffer,
+					vk::SharingMode::eExclusive,
+					vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+					set.buffers_u[i],
+					set.buffers_memory_u[i]);
+
+				set.mapped[i] = set.buffers_memory_u[i].get_mapped();
+				continue;
+			}
+
 			create_buffer(
 				chunks[i].max_size_bytes,
 				vk::BufferUsageFlagBits::eTransferSrc,
 				vk::SharingMode::eExclusive,
 				vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-				_vertex_staging_buffers_u[i],
-				_vertex_staging_buffers_memory_u[i]);
+				set.staging_buffers_u[i],
+				set.staging_buffers_memory_u[i]);
 
-			_vertex_staging_memory[i] = _device_u->mapMemory(*_vertex_staging_buffers_memory_u[i], 0, chunks[i].max_size_bytes);
+			set.mapped[i] = set.staging_buffers_memory_u[i].get_mapped();
 
+			// Written by the transfer queue and read by the graphics queue
 			create_buffer(
 				chunks[i].max_size_bytes,
 				vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst,
-				vk::SharingMode::eExclusive,
+				_upload_queue_families.size() > 1 ? vk::SharingMode::eConcurrent : vk::SharingMode::eExclusive,
 				vk::MemoryPropertyFlagBits::eDeviceLocal,
-				_vertex_buffers_u[i],
-				_vertex_buffers_memory_u[i]);
+				set.buffers_u[i],
+				set.buffers_memory_u[i]);
 		}
 	}
 	
+	set.generation++;
 	LOG_INFO("Vertex buffers created.");
 }
 
@@ -630,26 +1175,31 @@ void tomway::render_system::draw_frame(transform const& transform)
 		_window_minimized = false;
 	}
 
-	if (_cell_geometry.is_dirty()) {
+	// The vertex path uploads on the transfer queue into buffers no frame is drawing from, so it can start before the
+	// fence wait. The other paths stage into this frame's buffers, which have to wait for it.
+	if (_render_mode == render_mode::VERTEX and (_cell_geometry.get_version() != _uploaded_version or _render_mode != _uploaded_mode)) {
 		ZoneScopedN("tomway::render_system::draw_frame | Vertex transfer");
-	
-		auto const& vertex_chunks = _cell_geometry.get_vertices(_max_mem_allocation_size);
+		update_cell_grid(_cell_geometry.get_grid_size());
 
-		if (vertex_chunks.size() and need_bigger_chunk_alloc(_vertex_chunks, vertex_chunks))
-		{
-			create_vertex_buffers(vertex_chunks);
+		// When there's nowhere free to upload to the version stays stale and a later frame tries again
+		if (start_vertex_upload()) {
+			_uploaded_version = _cell_geometry.get_version();
+			_uploaded_mode = _render_mode;
 		}
-		
-		// TODO - transfer all chunks
-		_vertex_chunks = vertex_chunks;
-		transfer_vertices(vertex_chunks);
-		_cell_buffer_dirty = true;
 	}
 
+	poll_vertex_upload();
+
+	cull_tiles(transform);
+
 	{
 		ZoneScopedN("tomway::render_system::draw_frame | Fence wait");
 		_device_u->waitForFences(*_in_flight_fences_u[_curr_frame], vk::True, UINT64_MAX);
 	}
+
+	release_retired_swapchains();
+	// The fence says this frame's last queries are done, so reading them can't stall
+	_gpu_profiler.collect(_curr_frame);
 	
 	vk::Result result;
 	uint32_t imageIndex;
@@ -676,21 +1226,58 @@ void tomway::render_system::draw_frame(transform const& transform)
 		_device_u->resetFences(*_in_flight_fences_u[_curr_frame]);
 		_command_buffers_u[_curr_frame]->reset();
 	}
-	
+
+	// Staged after the image is acquired, so the copy is always recorded into the command buffer of the frame whose
+	// staging buffer was written
+	if (_render_mode != render_mode::VERTEX and (_cell_geometry.get_version() != _uploaded_version or _render_mode != _uploaded_mode)) {
+		if (_render_mode == render_mode::GPU_COMPACT or _render_mode == render_mode::RAYCAST) {
+			ZoneScopedN("tomway::render_system::draw_frame | Board transfer");
+			transfer_board();
+		}
+		else if (_render_mode == render_mode::INSTANCED) {
+			ZoneScopedN("tomway::render_system::draw_frame | Instance transfer");
+			transfer_instances();
+		}
+		else {
+			ZoneScopedN("tomway::render_system::draw_frame | Slot transfer");
+			transfer_slots();
+		}
+
+		_uploaded_version = _cell_geometry.get_version();
+		_uploaded_mode = _render_mode;
+		_cell_buffer_dirty = true;
+	}
+
+	update_raycast_constants(transform);
 	update_uniform_buffer(transform);
+	transfer_density_quads();
 	record_command_buffer(*_command_buffers_u[_curr_frame], imageIndex);
 	vk::Flags<vk::PipelineStageFlagBits> waitDstStage = vk::PipelineStageFlagBits::eColorAttachmentOutput;
 
 	{
 		ZoneScopedN("tomway::render_system::draw_frame | Submit");
 		
-		vk::SubmitInfo submitInfo({
-			*_image_available_sems_u[_curr_frame],
-			waitDstStage,
+		bool const drawing_vertices = _render_mode == render_mode::VERTEX and _drawn_vertex_set != NO_VERTEX_SET;
+		// The upload has already been seen to finish, waiting on it as well makes its writes visible to this queue
+		uint64_t const upload_value = drawing_vertices ? _vertex_buffer_sets[_drawn_vertex_set].upload_value : 0;
+		_frame_number++;
+
+		std::array<vk::Semaphore, 2> const wait_sems = { *_image_available_sems_u[_curr_frame], *_transfer_timeline_u };
+		std::array<vk::PipelineStageFlags, 2> const wait_stages = { waitDstStage, vk::PipelineStageFlagBits::eVertexInput };
+		std::array<uint64_t, 2> const wait_values = { 0, upload_value }; // Binary semaphores ignore their value
+		std::array<vk::Semaphore, 2> const signal_sems = { *_render_finished_sems_u[_curr_frame], *_frame_timeline_u };
+		std::array<uint64_t, 2> const signal_values = { 0, _frame_number };
+		vk::TimelineSemaphoreSubmitInfo const timeline_info(wait_values, signal_values);
+
+		vk::SubmitInfo submitInfo(
+			wait_sems,
+			wait_stages,
 			*_command_buffers_u[_curr_frame],
-			*_render_finished_sems_u[_curr_frame]});
+			signal_sems,
+			&timeline_info);
 
 		_graphics_queue.submit(submitInfo, *_in_flight_fences_u[_curr_frame]);
+		if (drawing_vertices) _vertex_buffer_sets[_drawn_vertex_set].last_drawn_frame = _frame_number;
 	}
 
 	{
@@ -730,6 +1317,21 @@ uint32_t tomway::render_system::find_memory_type(uint32_t type_filter, vk::Memor
 	throw std::runtime_error("Failed to find a suitable memory type!");
 }
 
+bool tomway::render_system::export_gpu_timings(std::string const& path) const {
+	return _gpu_profiler.export_csv(path);
+}
+
+tomway::render_mode tomway::render_system::get_render_mode() const {
+	return _render_mode;
+}
+
+bool tomway::render_system::has_pending_work() const {
+	return _cell_geometry.get_version() != _uploaded_version
+		or _render_mode != _uploaded_mode
+		or _uploading_vertex_set != NO_VERTEX_SET
+		or not _retired_swapchains.empty();
+}
+
 void tomway::render_system::minimized() {
 	_window_minimized = true;
 }
@@ -737,6 +1339,71 @@ void tomway::render_system::minimized() {
 void tomway::render_system::new_frame()
 {
 	TracyVkCollect(_tracy_contexts[_curr_frame], *_command_buffers_u[_curr_frame]);
+	ui_system::add_debug_text(string_format("Renderer: %s", to_string(_render_mode)));
+	ui_system::add_debug_text(string_format("Cell upload: %.2f MB", _cell_upload_bytes / (1024.0 * 1024.0)));
+
+	if (_render_mode == render_mode::INCREMENTAL) {
+		ui_system::add_debug_text(string_format("Births / deaths: %zu / %zu", _slot_births, _slot_deaths));
+		ui_system::add_debug_text(string_format("Slot copy regions: %zu", _slot_copy_regions.size()));
+	}
+
+	if (_render_mode == render_mode::VERTEX or _render_mode == render_mode::INSTANCED) {
+		ui_system::add_debug_text(string_format(
+			"Tiles drawn: %zu / %zu, %zu as density",
+			_visible_tiles.size() + _density_tile_count,
+			_tile_count,
+			_density_tile_count));
+
+		ui_system::add_debug_text(string_format(
+			"Draw groups: %zu, %zu recorded",
+			_draw_groups_drawn,
+			_draw_groups_recorded));
+	}
+
+	if (_gpu_profiler.has_timestamps()) {
+		for (size_t pass = 0; pass < GPU_PASS_COUNT; pass++) {
+			auto const summary = _gpu_profiler.get_pass_summary(static_cast<gpu_pass>(pass));
+
+			ui_system::add_debug_text(string_format(
+				"GPU %s: %.3f ms avg, %.3f ms p99",
+				to_string(static_cast<gpu_pass>(pass)),
+				summary.average_ms,
+				summary.p99_ms));
+		}
+
+		auto const frame_summary = _gpu_profiler.get_frame_summary();
+		ui_system::add_debug_text(string_format("GPU frame: %.3f ms avg, %.3f ms p99", frame_summary.average_ms, frame_summary.p99_ms));
+	}
+	else {
+		ui_system::add_debug_text("GPU timings: not supported by the graphics queue");
+	}
+
+	auto const& gpu_history = _gpu_profiler.get_history();
+
+	if (not gpu_history.empty() and gpu_history.back().has_statistics) {
+		ui_system::add_debug_text(string_format(
+			"Invocations: %llu vertex, %llu fragment",
+			static_cast<unsigned long long>(gpu_history.back().vertex_invocations),
+			static_cast<unsigned long long>(gpu_history.back().fragment_invocations)));
+	}
+
+	double constexpr MB = 1024.0 * 1024.0;
+
+	for (auto const& heap : _allocator.get_heap_usage()) {
+		if (not heap.device_local) continue;
+
+		ui_system::add_debug_text(string_format(
+			"VRAM: %.0f / %.0f MB%s",
+			heap.usage / MB,
+			heap.budget / MB,
+			_allocator.has_memory_budget() ? "" : " (no budget, heap size)"));
+
+		ui_system::add_debug_text(string_format(
+			"Blocks: %zu, %.1f / %.1f MB used",
+			heap.block_count,
+			heap.used_bytes / MB,
+			heap.block_bytes / MB));
+	}
 }
 
 void tomway::render_system::pick_physical_device() {
@@ -746,35 +1413,175 @@ void tomway::render_system::pick_physical_device() {
 		throw std::runtime_error("Failed to find a GPU with Vulkan support!");
 	}
 
+	// Discrete GPUs first, but anything that can render and run compute will do. That includes software
+	// implementations like lavapipe, which is what runs on machines without a GPU.
+	int best_rank = -1;
+
 	for (auto physical_device : physical_devices) {
-		if (is_device_suitable(physical_device, *_surface_u, _required_device_extensions)) {
+		if (not is_device_suitable(physical_device, *_surface_u, _required_device_extensions)) continue;
+		auto const device_type = physical_device.getProperties().deviceType;
+
+		int const rank = device_type == vk::PhysicalDeviceType::eDiscreteGpu ? 2
+			: device_type == vk::PhysicalDeviceType::eIntegratedGpu ? 1
+			: 0;
+
+		if (rank > best_rank) {
+			best_rank = rank;
 			_physical_device = physical_device;
-			// _msaa_samples = get_max_usable_sample_count(device);
-			_queue_indices = find_queue_families(physical_device, *_surface_u);
-			_max_mem_allocation_size = get_max_memory_allocation(physical_device);
-			LOG_INFO("Physical device selected.");
-			return;
 		}
 	}
 
-	throw new std::runtime_error("Could not find a suitable GPU!");
+	if (best_rank < 0) {
+		throw new std::runtime_error("Could not find a suitable GPU!");
+	}
+
+	// _msaa_samples = get_max_usable_sample_count(device);
+	_queue_indices = find_queue_families(_physical_device, *_surface_u);
+	_max_mem_allocation_size = get_max_memory_allocation(_physical_device);
+	_vertex_upload_strategy = choose_vertex_upload_strategy(_physical_device);
+	LOG_INFO("Physical device selected: %s", _physical_device.getProperties().deviceName.data());
+
+	LOG_INFO(
+		"Vertex upload strategy: %s",
+		_vertex_upload_strategy == vertex_upload_strategy::DIRECT
+			? "direct, vertices are written into mapped device local memory"
+			: "staged, vertices are written into mapped staging buffers and copied on the GPU");
+}
+
+// Switches the vertex path over to the set that was uploading once the transfer timeline says it's done
+void tomway::render_system::poll_vertex_upload() {
+	if (_uploading_vertex_set == NO_VERTEX_SET) return;
+	uint64_t const completed = _device_u->getSemaphoreCounterValue(*_transfer_timeline_u);
+	if (completed < _vertex_buffer_sets[_uploading_vertex_set].upload_value) return;
+	_drawn_vertex_set = _uploading_vertex_set;
+	_uploading_vertex_set = NO_VERTEX_SET;
+}
+
+// A plain quad under the board. The vertex path keeps it at the start of the first chunk, the instanced paths after the
+// cube in the mesh buffer.
+void tomway::render_system::record_background_draw(vk::CommandBuffer const& command_buffer) {
+	uint32_t first_vertex = 0;
+
+	if (_render_mode == render_mode::VERTEX) {
+		if (_drawn_vertex_set == NO_VERTEX_SET) return;
+		auto const& set = _vertex_buffer_sets[_drawn_vertex_set];
+		if (set.chunks.empty()) return;
+		command_buffer.bindVertexBuffers(0, *set.buffers_u[0], { 0 }); // First binding, buffer, offsets
+	}
+	else {
+		if (_instance_grid_size == 0) return;
+		first_vertex = static_cast<uint32_t>(cell_geometry::get_cell_mesh().size());
+		command_buffer.bindVertexBuffers(0, *_cell_mesh_buffer_u, { 0 }); // First binding, buffer, offsets
+	}
+
+	command_buffer.pushConstants<cell_grid_push_constants>(
+		*_pipeline_layout_u,
+		vk::ShaderStageFlagBits::eVertex,
+		0, // Offset
+		_background_constants);
+
+	command_buffer.draw(cell_geometry::BACKGROUND_VERT_COUNT, 1, first_vertex, 0); // Vertex count, instance count, first vertex, first instance
+}
+
+void tomway::render_system::record_board_compaction(vk::CommandBuffer& command_buffer) {
+	if (_board_layout_constants.uint_count == 0) return;
+
+	// The compaction pass counts instances up from zero
+	vk::DrawIndirectCommand const draw_command(
+		static_cast<uint32_t>(cell_geometry::get_cell_mesh().size()), // Vertex count
+		0, // Instance count
+		0, // First vertex
+		0); // First instance
+
+	command_buffer.updateBuffer<vk::DrawIndirectCommand>(*_draw_command_buffer_u, 0, draw_command);
+
+	vk::MemoryBarrier const transfer_barrier(
+		vk::AccessFlagBits::eTransferWrite, // Src access
+		vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite); // Dst access
+
+	command_buffer.pipelineBarrier(
+		vk::PipelineStageFlagBits::eTransfer, // Src stage
+		vk::PipelineStageFlagBits::eComputeShader, // Dst stage
+		{}, // Dependency flags
+		transfer_barrier, // Memory barriers
+		nullptr, // Buffer memory barriers
+		nullptr); // Image memory barriers
+
+	command_buffer.bindPipeline(vk::PipelineBindPoint::eCompute, *_compaction_pipeline_u);
+
+	command_buffer.bindDescriptorSets(
+		vk::PipelineBindPoint::eCompute,
+		*_compaction_pipeline_layout_u,
+		0, // First set
+		_compaction_descriptor_set,
+		nullptr); // Dynamic offsets
+
+	command_buffer.pushConstants<board_layout_push_constants>(
+		*_compaction_pipeline_layout_u,
+		vk::ShaderStageFlagBits::eCompute,
+		0, // Offset
+		_board_layout_constants);
+
+	// Big boards are folded into a second dimension to stay under the per-dimension workgroup limit
+	uint32_t const groups = (_board_layout_constants.uint_count + COMPACTION_GROUP_SIZE - 1) / COMPACTION_GROUP_SIZE;
+	uint32_t const groups_x = std::min(groups, MAX_DISPATCH_GROUPS);
+	command_buffer.dispatch(groups_x, (groups + groups_x - 1) / groups_x, 1);
 }
 
 void tomway::render_system::record_command_buffer(vk::CommandBuffer& command_buffer, uint32_t image_index) {
 	ZoneScoped;
 	vk::CommandBufferBeginInfo beginInfo;
 	command_buffer.begin(beginInfo);
+	_gpu_profiler.begin_frame(command_buffer, _curr_frame);
+	_gpu_profiler.write_timestamp(command_buffer, _curr_frame, gpu_timestamp::FRAME_START);
 
 	if (_cell_buffer_dirty)
 	{
-		for (size_t i = 0; i < _vertex_chunks.size(); i++)
+		// The device local buffers are shared by every frame in flight, so the copies and compaction wait for earlier
+		// frames to finish with them and the draws below wait for the results
+		command_buffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eFragmentShader, // Src stage
+			vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader, // Dst stage
+			{}, // Dependency flags
+			nullptr, // Memory barriers
+			nullptr, // Buffer memory barriers
+			nullptr); // Image memory barriers
+
+		if (_render_mode == render_mode::GPU_COMPACT or _render_mode == render_mode::RAYCAST)
+		{
+			if (_board_layout_constants.uint_count) {
+				copy_buffer(
+					command_buffer,
+					*_board_staging_buffers[_curr_frame].buffer_u,
+					*_board_buffer_u,
+					_board_layout_constants.uint_count * sizeof(uint32_t));
+			}
+
+			if (_render_mode == render_mode::GPU_COMPACT) record_board_compaction(command_buffer);
+		}
+		else if (_render_mode == render_mode::INSTANCED)
 		{
-			copy_buffer(
-				*_command_buffers_u[_curr_frame],
-				*_vertex_staging_buffers_u[i],
-				*_vertex_buffers_u[i],
-				_vertex_chunks[i].max_size_bytes);
+			record_instance_transfer(command_buffer);
 		}
+		else if (_render_mode == render_mode::INCREMENTAL)
+		{
+			// Every changed run of slots in one copy
+			if (not _slot_copy_regions.empty()) {
+				command_buffer.copyBuffer(*_instance_staging_buffers[_curr_frame].buffer_u, *_instance_buffer_u, _slot_copy_regions);
+			}
+		}
+
+		vk::MemoryBarrier const transfer_barrier(
+			vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderWrite, // Src access
+			vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eShaderRead); // Dst access
+
+		command_buffer.pipelineBarrier(
+			vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader, // Src stage
+			vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eFragmentShader, // Dst stage
+			{}, // Dependency flags
+			transfer_barrier, // Memory barriers
+			nullptr, // Buffer memory barriers
+			nullptr); // Image memory barriers
 		
 		_cell_buffer_dirty = false;
 	}
@@ -794,7 +1601,202 @@ void tomway::render_system::record_command_buffer(vk::CommandBuffer& command_buf
 		clear_values
 	});
 
+	// The tile paths draw from secondaries, which can't be mixed with inline commands in the same subpass
+	bool const tiled = _render_mode == render_mode::VERTEX or _render_mode == render_mode::INSTANCED;
+	_gpu_profiler.write_timestamp(command_buffer, _curr_frame, gpu_timestamp::UPLOAD_END);
+	_gpu_profiler.begin_statistics(command_buffer, _curr_frame, tiled);
+
+	if (tiled)
+	{
+		{
+			// Nothing can be recorded into the primary inside a subpass that executes secondaries, Tracy's timestamps
+			// included, so the whole render pass is one zone
+			TracyVkZone(_tracy_contexts[_curr_frame], *_command_buffers_u[_curr_frame], "Draw Tiles, Background, Density and ImGui");
+			command_buffer.beginRenderPass(render_pass, vk::SubpassContents::eSecondaryCommandBuffers);
+			auto const group_command_buffers = record_draw_groups();
+			if (not group_command_buffers.empty()) command_buffer.executeCommands(group_command_buffers);
+
+			auto const& main_command_buffer = *_main_command_buffers_u[_curr_frame];
+			begin_secondary(main_command_buffer);
+			// After the cubes, which cover most of it
+			record_background_draw(main_command_buffer);
+			record_density_draws(main_command_buffer);
+			// The primary can only execute secondaries in this subpass, so the stamp between the passes goes here
+			_gpu_profiler.write_timestamp(main_command_buffer, _curr_frame, gpu_timestamp::CELLS_END);
+			ImGui::Render();
+			ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), main_command_buffer, nullptr);
+			main_command_buffer.end();
+			command_buffer.executeCommands(main_command_buffer);
+			command_buffer.endRenderPass();
+		}
+
+		_gpu_profiler.end_statistics(command_buffer, _curr_frame);
+		_gpu_profiler.write_timestamp(command_buffer, _curr_frame, gpu_timestamp::FRAME_END);
+		command_buffer.end();
+		return;
+	}
+
 	command_buffer.beginRenderPass(render_pass, vk::SubpassContents::eInline);
+	record_draw_state(command_buffer);
+
+	if (_render_mode == render_mode::RAYCAST)
+	{
+		TracyVkZone(_tracy_contexts[_curr_frame], *_command_buffers_u[_curr_frame], "Draw Raycast");
+		record_raycast_draw(command_buffer);
+	}
+	else
+	{
+		TracyVkZone(_tracy_contexts[_curr_frame], *_command_buffers_u[_curr_frame], "Draw Instances");
+		record_instanced_draws(command_buffer);
+	}
+
+	_gpu_profiler.write_timestamp(command_buffer, _curr_frame, gpu_timestamp::CELLS_END);
+
+	{
+		TracyVkZone(_tracy_contexts[_curr_frame], *_command_buffers_u[_curr_frame], "Draw ImGui");
+		ImGui::Render();
+		auto const draw_data = ImGui::GetDrawData();
+		ImGui_ImplVulkan_RenderDrawData(draw_data, command_buffer, nullptr);
+	}
+	
+	command_buffer.endRenderPass();
+	_gpu_profiler.end_statistics(command_buffer, _curr_frame);
+	_gpu_profiler.write_timestamp(command_buffer, _curr_frame, gpu_timestamp::FRAME_END);
+	command_buffer.end();
+}
+
+// Drawn after the cubes, they're further away
+void tomway::render_system::record_density_draws(vk::CommandBuffer const& command_buffer) {
+	if (_density_quads.empty()) return;
+	command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *_density_pipeline_u);
+	command_buffer.bindVertexBuffers(0, *_density_buffers_u[_curr_frame], { 0 }); // First binding, buffer, offsets
+	command_buffer.draw(6, static_cast<uint32_t>(_density_quads.size()), 0, 0); // Vertex count, instance count, first vertex, first instance
+}
+
+// Sorts the visible tiles into draw groups and records the groups whose secondaries for this frame are out of date,
+// split between worker threads. Returns the secondaries to execute, ordered by each group's nearest tile.
+std::vector<vk::CommandBuffer> tomway::render_system::record_draw_groups() {
+	ZoneScoped;
+	std::vector<vk::CommandBuffer> ret;
+	_draw_groups_drawn = 0;
+	_draw_groups_recorded = 0;
+	if (_visible_tiles.empty()) return ret;
+
+	// Everything the draws depend on besides the tiles themselves
+	uint64_t constants[2];
+	static_assert(sizeof(constants) == sizeof(cell_grid_push_constants), "Push constants must fit the key");
+	memcpy(constants, &_cell_grid_constants, sizeof(constants));
+
+	std::vector<uint64_t> header = {
+		static_cast<uint64_t>(_render_mode),
+		uint64_t(_swapchain_extent.width) << 32 | _swapchain_extent.height,
+		constants[0],
+		constants[1] };
+
+	if (_render_mode == render_mode::VERTEX) {
+		// Uploads only change what's in the buffers, the generation changes when the buffers themselves do
+		header.push_back(_drawn_vertex_set);
+		header.push_back(_vertex_buffer_sets[_drawn_vertex_set].generation);
+	}
+	else {
+		// A handle value can be handed out again once its buffer is destroyed, the generation can't
+		header.push_back(_instance_buffer_generation);
+		header.push_back(_instance_count);
+		header.push_back(_instance_grid_size);
+	}
+
+	// Groups in the order of their nearest tile, the tiles are already sorted
+	std::vector<size_t> order;
+	uint32_t const group_cells = _visible_tiles.front().tile->size * DRAW_GROUP_TILES;
+
+	for (auto const& visible : _visible_tiles) {
+		uint64_t const group_key = uint64_t(visible.tile->y / group_cells) << 32 | visible.tile->x / group_cells;
+		auto found = _draw_group_indices.find(group_key);
+
+		if (found == _draw_group_indices.end()) {
+			draw_group group;
+
+			group.command_pool_u = _device_u->createCommandPoolUnique({
+				vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+				_queue_indices.graphics_family
+			});
+
+			group.command_buffers_u = _device_u->allocateCommandBuffersUnique({
+				*group.command_pool_u,
+				vk::CommandBufferLevel::eSecondary,
+				_max_frames_in_flight });
+
+			group.recorded_keys.resize(_max_frames_in_flight);
+			found = _draw_group_indices.emplace(group_key, _draw_groups.size()).first;
+			_draw_groups.push_back(std::move(group));
+		}
+
+		draw_group& group = _draw_groups[found->second];
+		if (group.tiles.empty()) order.push_back(found->second);
+		group.tiles.push_back(visible);
+	}
+
+	std::vector<size_t> dirty;
+	size_t dirty_tiles = 0;
+
+	for (size_t const index : order) {
+		draw_group& group = _draw_groups[index];
+		group.key = header;
+		for (auto const& visible : group.tiles) append_tile_key(group.key, visible);
+		ret.push_back(*group.command_buffers_u[_curr_frame]);
+		if (group.key == group.recorded_keys[_curr_frame]) continue;
+		dirty.push_back(index);
+		dirty_tiles += group.tiles.size();
+	}
+
+	// Each group has its own pool, so groups can be recorded on any thread as long as no two threads share one
+	auto const record = [this, &dirty](size_t const first, size_t const end) {
+		ZoneScopedN("tomway::render_system::record_draw_groups | Record");
+
+		for (size_t i = first; i < end; i++) {
+			draw_group& group = _draw_groups[dirty[i]];
+			auto const& command_buffer = *group.command_buffers_u[_curr_frame];
+			begin_secondary(command_buffer);
+			record_tile_draws(command_buffer, group.tiles);
+			command_buffer.end();
+			group.recorded_keys[_curr_frame].swap(group.key);
+		}
+	};
+
+	size_t const max_parts = std::max<size_t>(dirty_tiles / MIN_TILES_PER_WORKER, 1);
+	size_t const part_count = std::min(_workers.get_concurrency(), std::min(max_parts, dirty.size()));
+	std::vector<size_t> first_groups = { 0 };
+	size_t tiles_assigned = 0;
+
+	// Groups are handed out in runs of roughly equal tile counts
+	for (size_t part = 0; part + 1 < part_count; part++) {
+		size_t const target = dirty_tiles * (part + 1) / part_count;
+		size_t end_group = first_groups.back();
+
+		while (end_group < dirty.size() and tiles_assigned < target) {
+			tiles_assigned += _draw_groups[dirty[end_group++]].tiles.size();
+		}
+
+		first_groups.push_back(end_group);
+	}
+
+	first_groups.push_back(dirty.size());
+
+	_workers.run(part_count, [&record, &first_groups](size_t const part) {
+		record(first_groups[part], first_groups[part + 1]);
+	});
+
+	for (size_t const index : order) {
+		_draw_groups[index].tiles.clear();
+	}
+
+	_draw_groups_drawn = order.size();
+	_draw_groups_recorded = dirty.size();
+	return ret;
+}
+
+// The pipeline, viewport, scissor and transform that the scene's draws start from
+void tomway::render_system::record_draw_state(vk::CommandBuffer const& command_buffer) {
 	command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *_graphics_pipeline_u);
 
 	vk::Viewport viewport {
@@ -815,26 +1817,118 @@ void tomway::render_system::record_command_buffer(vk::CommandBuffer& command_buf
 		0, // First set
 		_descriptor_sets[_curr_frame],
 		nullptr); // Dynamic offsets
+}
 
-	{
-		TracyVkZone(_tracy_contexts[_curr_frame], *_command_buffers_u[_curr_frame], "Draw Verts");
-		
-		for (size_t i = 0; i < _vertex_chunks.size(); i++)
-		{
-			command_buffer.bindVertexBuffers(0, *_vertex_buffers_u[i], { 0 }); // First binding, buffer, offsets
-			command_buffer.draw(static_cast<uint32_t>(_vertex_chunks[i].vertex_count), 1, 0, 0); // Vertex count, instance count, first vertex, first instance
+void tomway::render_system::record_instance_bindings(vk::CommandBuffer const& command_buffer) {
+	command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *_instanced_pipeline_u);
+	command_buffer.pushConstants<cell_grid_push_constants>(
+		*_pipeline_layout_u,
+		vk::ShaderStageFlagBits::eVertex,
+		0, // Offset
+		_cell_grid_constants);
+
+	std::array<vk::Buffer, 2> const buffers { *_cell_mesh_buffer_u, *_instance_buffer_u };
+	std::array<vk::DeviceSize, 2> const offsets { 0, 0 };
+	command_buffer.bindVertexBuffers(0, buffers, offsets); // First binding, buffers, offsets
+}
+
+// The untiled instanced paths, which draw every instance at once
+void tomway::render_system::record_instanced_draws(vk::CommandBuffer& command_buffer) {
+	if (_instance_grid_size == 0) return;
+	record_background_draw(command_buffer);
+	if (_instance_count == 0) return;
+	record_instance_bindings(command_buffer);
+
+	if (_render_mode == render_mode::INCREMENTAL) {
+		// Dead slots are drawn too, the vertex shader throws them away
+		auto const mesh_vert_count = static_cast<uint32_t>(cell_geometry::get_cell_mesh().size());
+		command_buffer.draw(mesh_vert_count, _instance_count, 0, 0); // Vertex count, instance count, first vertex, first instance
+		return;
+	}
+
+	// The instance count was written by the compaction pass
+	command_buffer.drawIndirect(*_draw_command_buffer_u, 0, 1, sizeof(vk::DrawIndirectCommand)); // Buffer, offset, draw count, stride
+}
+
+void tomway::render_system::record_raycast_draw(vk::CommandBuffer& command_buffer) {
+	if (_board_layout_constants.uint_count == 0) return;
+	command_buffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *_raycast_pipeline_u);
+
+	command_buffer.bindDescriptorSets(
+		vk::PipelineBindPoint::eGraphics,
+		*_raycast_pipeline_layout_u,
+		0, // First set
+		_raycast_descriptor_set,
+		nullptr); // Dynamic offsets
+
+	command_buffer.pushConstants<raycast_push_constants>(
+		*_raycast_pipeline_layout_u,
+		vk::ShaderStageFlagBits::eFragment,
+		0, // Offset
+		_raycast_constants);
+
+	command_buffer.draw(3, 1, 0, 0); // Vertex count, instance count, first vertex, first instance
+}
+
+// Each tile's vertices or instances are laid out face by face, so a draw covers some faces of one tile
+void tomway::render_system::record_tile_draws(vk::CommandBuffer const& command_buffer, std::vector<visible_tile> const& tiles) {
+	if (_render_mode == render_mode::INSTANCED) {
+		if (_instance_grid_size == 0 or _instance_count == 0) return;
+		record_instance_bindings(command_buffer);
+
+		// The instances are grouped by tile
+		for (auto const& visible : tiles) {
+			cell_tile const& tile = *visible.tile;
+			if (tile.first_instance + tile.cell_count > _instance_count) continue;
+
+			for_each_face_range(visible.faces, [&](uint8_t const first_face, uint8_t const face_count) {
+				command_buffer.draw(
+					face_count * VERTS_PER_FACE, // Vertex count
+					tile.cell_count, // Instance count
+					first_face * VERTS_PER_FACE, // First vertex
+					tile.first_instance); // First instance
+			});
 		}
+
+		return;
 	}
 
-	{
-		TracyVkZone(_tracy_contexts[_curr_frame], *_command_buffers_u[_curr_frame], "Draw ImGui");
-		ImGui::Render();
-		auto const draw_data = ImGui::GetDrawData();
-		ImGui_ImplVulkan_RenderDrawData(draw_data, command_buffer, nullptr);
+	auto const& set = _vertex_buffer_sets[_drawn_vertex_set];
+	size_t bound_chunk = SIZE_MAX;
+
+	for (auto const& visible : tiles) {
+		cell_tile const& tile = *visible.tile;
+
+		// Vertex positions are relative to their tile's corner
+		cell_grid_push_constants const tile_constants {
+			{ tile.min.x, tile.min.y },
+			_cell_grid_constants.spacing,
+			_cell_grid_constants.position_scale };
+
+		command_buffer.pushConstants<cell_grid_push_constants>(
+			*_pipeline_layout_u,
+			vk::ShaderStageFlagBits::eVertex,
+			0, // Offset
+			tile_constants);
+
+		if (tile.chunk != bound_chunk) {
+			command_buffer.bindVertexBuffers(0, *set.buffers_u[tile.chunk], { 0 }); // First binding, buffer, offsets
+			bound_chunk = tile.chunk;
+		}
+
+		for_each_face_range(visible.faces, [&](uint8_t const first_face, uint8_t const face_count) {
+			command_buffer.draw(
+				face_count * VERTS_PER_FACE * tile.cell_count, // Vertex count
+				1, // Instance count
+				tile.first_vertex + first_face * VERTS_PER_FACE * tile.cell_count, // First vertex
+				0); // First instance
+		});
 	}
-	
-	command_buffer.endRenderPass();
-	command_buffer.end();
+}
+
+void tomway::render_system::record_instance_transfer(vk::CommandBuffer& command_buffer) {
+	if (_instance_count == 0) return;
+	copy_buffer(command_buffer, *_instance_staging_buffers[_curr_frame].buffer_u, *_instance_buffer_u, _instance_count * sizeof(cell_coord));
 }
 
 void tomway::render_system::recreate_swapchain() {
@@ -844,30 +1938,388 @@ void tomway::render_system::recreate_swapchain() {
 	_framebuffer_resized = false;
 	_window_minimized = false;
 
-	_device_u->waitIdle();
-
-	// TODO - try recreating the swap chain while the old one is in-flight!
-
-	create_swapchain();
+	// Frames already submitted keep rendering into the old images. Presents queued on the old swapchain go ahead of
+	// the first frame on the new one, so once that frame finishes the old resources can go.
+	retired_swapchain retired;
+	retired.swapchain_u = std::move(_swapchain_u);
+	retired.image_views_u = std::move(_image_views_u);
+	retired.depth_image_u = std::move(_depth_image_u);
+	retired.depth_image_memory_u = std::move(_depth_image_memory_u);
+	retired.depth_image_view_u = std::move(_depth_image_view_u);
+	retired.framebuffers_u = std::move(_framebuffers_u);
+	retired.retire_frame = _frame_number + 1;
+	_framebuffers_u.clear();
+
+	create_swapchain(*retired.swapchain_u);
 	create_image_views();
 	create_depth_resources();
 	create_framebuffers();
+	_retired_swapchains.push_back(std::move(retired));
+}
+
+void tomway::render_system::release_retired_swapchains() {
+	if (_retired_swapchains.empty()) return;
+	uint64_t const completed = _device_u->getSemaphoreCounterValue(*_frame_timeline_u);
+
+	while (not _retired_swapchains.empty() and _retired_swapchains.front().retire_frame <= completed) {
+		_retired_swapchains.pop_front();
+	}
+}
+
+// Each frame in flight stages through a buffer of its own that's only written after the frame's fence wait, so no
+// earlier frame can still be copying out of it. They grow to fit and are kept for later generations.
+void* tomway::render_system::reserve_staging_buffer(std::vector<staging_buffer>& buffers, size_t const size) {
+	if (buffers.size() != _max_frames_in_flight) buffers.resize(_max_frames_in_flight);
+	staging_buffer& buffer = buffers[_curr_frame];
+
+	if (size > buffer.capacity) {
+		ZoneScoped;
+		size_t const capacity = std::min(std::max(size, buffer.capacity * 2), _max_mem_allocation_size);
+
+		create_buffer(
+			capacity,
+			vk::BufferUsageFlagBits::eTransferSrc,
+			vk::SharingMode::eExclusive,
+			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+			buffer.buffer_u,
+			buffer.memory_u);
+
+		buffer.mapped = buffer.memory_u.get_mapped();
+		buffer.capacity = capacity;
+	}
+
+	return buffer.mapped;
 }
 
 inline void tomway::render_system::resize_framebuffer() {
 	_framebuffer_resized = true;
 }
 
-// TODO - use a different queue family for transfer operations
-// https://docs.vulkan.org/tutorial/latest/00_Introduction.html
-void tomway::render_system::transfer_vertices(std::vector<vertex_chunk> const& vertex_chunks) const
+// Written to a temporary file first, so a crash part way through never leaves a torn cache behind
+void tomway::render_system::save_pipeline_cache() {
+	ZoneScoped;
+	auto const data = _device_u->getPipelineCacheData(*_pipeline_cache_u);
+	std::string const path = get_pipeline_cache_path();
+	std::string const temp_path = path + ".tmp";
+
+	{
+		std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+		file.write(reinterpret_cast<char const*>(data.data()), static_cast<std::streamsize>(data.size()));
+
+		if (not file) {
+			LOG_ERROR("Could not save the pipeline cache to %s.", temp_path.c_str());
+			return;
+		}
+	}
+
+	std::remove(path.c_str());
+
+	if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+		LOG_ERROR("Could not save the pipeline cache to %s.", path.c_str());
+		return;
+	}
+
+	LOG_INFO("Pipeline cache saved with %zu bytes.", data.size());
+}
+
+void tomway::render_system::set_render_mode(render_mode const mode) {
+	if (mode == _render_mode) return;
+	_render_mode = mode;
+	LOG_INFO("Renderer set to %s.", to_string(mode));
+}
+
+// The instance buffer is clamped to the largest single allocation, so once it's that big there's no point rebuilding
+// it and the cells past the end just aren't drawn
+bool tomway::render_system::should_grow_instances(size_t const count) const {
+	return count > _instance_capacity and _instance_capacity < _max_mem_allocation_size / sizeof(cell_coord);
+}
+
+// Writes the current generation's vertices into the set that isn't being drawn and copies them to its vertex buffers on
+// the transfer queue. The renderer keeps drawing the previous generation until the copy signals the transfer
+// timeline. Returns false without doing anything when an upload is already running or frames in flight still draw
+// from the free set, the generation is picked up on a later frame rather than stalling this one.
+bool tomway::render_system::start_vertex_upload() {
+	ZoneScoped;
+	if (_uploading_vertex_set != NO_VERTEX_SET) return false;
+	size_t const set_index = _drawn_vertex_set == 0 ? 1 : 0;
+	auto& set = _vertex_buffer_sets[set_index];
+	if (_device_u->getSemaphoreCounterValue(*_frame_timeline_u) < set.last_drawn_frame) return false;
+
+	auto const& chunks = _cell_geometry.get_vertex_layout(_max_mem_allocation_size);
+	if (chunks.size() and need_bigger_chunk_alloc(set.chunks, chunks)) create_vertex_buffers(set, chunks);
+	set.chunks = chunks;
+	set.tiles = _cell_geometry.get_tiles();
+	_cell_geometry.write_vertices(set.mapped);
+	_cell_upload_bytes = 0;
+
+	for (auto const& chunk : set.chunks) {
+		_cell_upload_bytes += chunk.data_size_bytes;
+	}
+
+	_uploading_vertex_set = set_index;
+
+	// Written straight into the vertex buffers, there's nothing to copy and the set can be drawn right away
+	if (_vertex_upload_strategy == vertex_upload_strategy::DIRECT or set.chunks.empty()) {
+		set.upload_value = _transfer_value;
+		return true;
+	}
+
+	vk::CommandBuffer const& command_buffer = *set.upload_command_buffer_u;
+	command_buffer.reset();
+	command_buffer.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+
+	// Only the part of each chunk that was written
+	for (size_t i = 0; i < set.chunks.size(); i++) {
+		copy_buffer(command_buffer, *set.staging_buffers_u[i], *set.buffers_u[i], set.chunks[i].data_size_bytes);
+	}
+
+	command_buffer.end();
+	set.upload_value = ++_transfer_value;
+	vk::TimelineSemaphoreSubmitInfo const timeline_info(nullptr, set.upload_value); // Wait values, signal values
+
+	vk::SubmitInfo const submit_info(
+		nullptr, // Wait semaphores
+		nullptr, // Wait stages
+		command_buffer,
+		*_transfer_timeline_u, // Signal semaphores
+		&timeline_info);
+
+	_transfer_queue.submit(submit_info);
+	return true;
+}
+
+void tomway::render_system::submit_one_time_commands(std::function<void(vk::CommandBuffer const&)> const& record) {
+	auto command_buffers_u = _device_u->allocateCommandBuffersUnique({
+		*_command_pool_u,
+		vk::CommandBufferLevel::ePrimary,
+		1 });
+
+	vk::CommandBuffer const& command_buffer = *command_buffers_u[0];
+	command_buffer.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+	record(command_buffer);
+	command_buffer.end();
+
+	vk::SubmitInfo const submit_info(nullptr, nullptr, command_buffer); // Wait semaphores, wait stages, command buffers
+	_graphics_queue.submit(submit_info);
+	_graphics_queue.waitIdle();
+}
+
+// The only CPU work per generation is a copy of the board's words, the compaction pass does the rest
+void tomway::render_system::transfer_board()
+{
+	ZoneScoped;
+	cell_container const board = _cell_geometry.get_board();
+	size_t const board_bytes = board.grid_size() * board.words_per_row() * sizeof(cell_container::word);
+
+	if (board_bytes > _max_mem_allocation_size)
+	{
+		LOG_ERROR("Board is too big for a single allocation, switching to the instanced renderer.");
+		_render_mode = render_mode::INSTANCED;
+		transfer_instances();
+		return;
+	}
+
+	update_cell_grid(board.grid_size());
+	// The raycaster reads the board directly, only compaction needs room for the instances
+	size_t const population = _render_mode == render_mode::GPU_COMPACT ? board.get_population() : 0;
+
+	bool const grow_instances = should_grow_instances(population);
+
+	if (board_bytes > _board_capacity_bytes or grow_instances)
+	{
+		// The old buffers may still be in use by a frame in flight
+		_device_u->waitIdle();
+		if (board_bytes > _board_capacity_bytes) create_board_buffers(board_bytes);
+		if (grow_instances) create_instance_buffers(std::max(population, _instance_capacity * 2));
+	}
+
+	_instance_count = static_cast<uint32_t>(std::min(population, _instance_capacity));
+	_board_layout_constants = {
+		static_cast<uint32_t>(board.words_per_row() * 2),
+		static_cast<uint32_t>(board_bytes / sizeof(uint32_t)),
+		static_cast<uint32_t>(_instance_capacity) };
+
+	if (board_bytes) memcpy(reserve_staging_buffer(_board_staging_buffers, board_bytes), board.words(), board_bytes);
+	_cell_upload_bytes = board_bytes;
+}
+
+// The quads change whenever the camera moves, so each frame in flight has a host visible buffer of its own that the
+// draw reads from directly. Called after the frame's fence wait, when nothing is reading this frame's buffer.
+void tomway::render_system::transfer_density_quads()
+{
+	ZoneScoped;
+	if (_density_quads.empty()) return;
+
+	if (_density_buffers_u.size() != _max_frames_in_flight) {
+		_density_buffers_u.resize(_max_frames_in_flight);
+		_density_buffers_memory_u.resize(_max_frames_in_flight);
+		_density_buffers_mapped.resize(_max_frames_in_flight, nullptr);
+		_density_buffer_capacities.resize(_max_frames_in_flight, 0);
+	}
+
+	if (_density_quads.size() > _density_buffer_capacities[_curr_frame]) {
+		size_t const max_quads = _max_mem_allocation_size / sizeof(density_quad);
+		size_t const capacity = std::min(std::max(_density_quads.size(), _density_buffer_capacities[_curr_frame] * 2), max_quads);
+
+		create_buffer(
+			capacity * sizeof(density_quad),
+			vk::BufferUsageFlagBits::eVertexBuffer,
+			vk::SharingMode::eExclusive,
+			vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+			_density_buffers_u[_curr_frame],
+			_density_buffers_memory_u[_curr_frame]);
+
+		_density_buffers_mapped[_curr_frame] = _density_buffers_memory_u[_curr_frame].get_mapped();
+		_density_buffer_capacities[_curr_frame] = capacity;
+	}
+
+	if (_density_quads.size() > _density_buffer_capacities[_curr_frame]) _density_quads.resize(_density_buffer_capacities[_curr_frame]);
+	memcpy(_density_buffers_mapped[_curr_frame], _density_quads.data(), _density_quads.size() * sizeof(density_quad));
+}
+
+// Instances are the live cell coordinates exactly as the step kernel wrote them, 8 bytes a cell against 36 vertices
+// of 8 bytes each for the vertex path
+void tomway::render_system::transfer_instances()
+{
+	ZoneScoped;
+	auto const& instances = _cell_geometry.get_instances();
+	update_cell_grid(_cell_geometry.get_grid_size());
+
+	if (should_grow_instances(instances.size()))
+	{
+		// The old buffers may still be in use by a frame in flight
+		_device_u->waitIdle();
+		create_instance_buffers(std::max(instances.size(), _instance_capacity * 2));
+	}
+
+	_instance_count = static_cast<uint32_t>(std::min(instances.size(), _instance_capacity));
+	_cell_upload_bytes = _instance_count * sizeof(cell_coord);
+	if (_instance_count) memcpy(reserve_staging_buffer(_instance_staging_buffers, _cell_upload_bytes), instances.data(), _cell_upload_bytes);
+}
+
+// Only the slots that changed since the last upload are staged, packed one run after another, along with the copy
+// regions that put each run back where it belongs
+void tomway::render_system::transfer_slots()
 {
 	ZoneScoped;
+	cell_slots& slots = _cell_geometry.get_slots();
+	update_cell_grid(_cell_geometry.get_grid_size());
+
+	if (should_grow_instances(slots.get_slot_count()))
+	{
+		// The old buffers may still be in use by a frame in flight
+		_device_u->waitIdle();
+		create_instance_buffers(std::max(slots.get_slot_count(), _instance_capacity * 2));
+		slots.mark_all_dirty();
+	}
+	else if (_uploaded_mode != render_mode::INCREMENTAL or _cell_buffer_dirty)
+	{
+		// The other modes share the instance buffer, whatever was in the slots is gone. A copy that was staged but
+		// never recorded is gone too, and every later delta would build on it.
+		slots.mark_all_dirty();
+	}
+
+	_slot_copy_regions.clear();
+	size_t staged_bytes = 0;
 
-	for (size_t i = 0; i < vertex_chunks.size(); i++)
+	// Slots past the capacity aren't drawn. A run that crosses it is cut short rather than skipped, so the slots below
+	// it still arrive.
+	for (auto const& range : slots.get_dirty_ranges())
 	{
-		memcpy(_vertex_staging_memory[i], vertex_chunks[i].vertices, vertex_chunks[i].data_size_bytes);
+		if (range.first_slot >= _instance_capacity) break;
+		size_t const range_bytes = std::min<size_t>(range.slot_count, _instance_capacity - range.first_slot) * sizeof(cell_coord);
+		_slot_copy_regions.emplace_back(staged_bytes, range.first_slot * sizeof(cell_coord), range_bytes); // Src offset, dst offset, size
+		staged_bytes += range_bytes;
+	}
+
+	if (staged_bytes)
+	{
+		auto const staging = static_cast<char*>(reserve_staging_buffer(_instance_staging_buffers, staged_bytes));
+		auto const slot_data = reinterpret_cast<char const*>(slots.get_slots().data());
+
+		for (auto const& region : _slot_copy_regions)
+		{
+			memcpy(staging + region.srcOffset, slot_data + region.dstOffset, region.size);
+		}
+	}
+
+	_instance_count = static_cast<uint32_t>(std::min(slots.get_slot_count(), _instance_capacity));
+	_cell_upload_bytes = staged_bytes;
+	_slot_births = slots.get_births();
+	_slot_deaths = slots.get_deaths();
+}
+
+void tomway::render_system::update_cell_grid(size_t const grid_size) {
+	if (grid_size == _instance_grid_size) return;
+	// The mesh and background vertices don't depend on the board, only the push constants do
+	if (grid_size and not _cell_mesh_buffer_u) create_cell_mesh_buffer();
+	_instance_grid_size = grid_size;
+	_cell_grid_constants = { _cell_geometry.get_grid_origin(), cell_geometry::get_cell_spacing(), cell_geometry::get_position_scale() };
+	_background_constants = { _cell_geometry.get_grid_origin(), 0.0f, _cell_geometry.get_background_scale() };
+}
+
+// Only called right after one of the buffers was recreated, when nothing in flight is using the descriptor set
+void tomway::render_system::update_compaction_descriptor_set() {
+	if (not _board_buffer_u or not _instance_buffer_u) return;
+
+	std::array<vk::DescriptorBufferInfo, 3> const buffer_infos {
+		vk::DescriptorBufferInfo(*_board_buffer_u, 0, VK_WHOLE_SIZE), // Buffer, offset, range/size
+		vk::DescriptorBufferInfo(*_instance_buffer_u, 0, VK_WHOLE_SIZE),
+		vk::DescriptorBufferInfo(*_draw_command_buffer_u, 0, VK_WHOLE_SIZE)
+	};
+
+	std::array<vk::WriteDescriptorSet, 3> descriptor_writes;
+
+	for (uint32_t i = 0; i < descriptor_writes.size(); i++) {
+		descriptor_writes[i] = vk::WriteDescriptorSet(
+			_compaction_descriptor_set,
+			i, // Binding
+			0, // Array element
+			vk::DescriptorType::eStorageBuffer,
+			nullptr, // Image info
+			buffer_infos[i],
+			nullptr); // Texel buffer view
 	}
+
+	_device_u->updateDescriptorSets(descriptor_writes, nullptr);
+}
+
+void tomway::render_system::update_raycast_constants(transform const& transform) {
+	if (_render_mode != render_mode::RAYCAST) return;
+
+	// The projection is flipped back before it's uploaded, the inverse has to undo what the GPU actually used
+	glm::mat4 projection = transform.projection;
+	projection[1][1] *= -1;
+	glm::mat4 const model_view = transform.view * transform.model;
+	glm::vec2 const cell_extent = cell_geometry::get_cell_extent();
+
+	_raycast_constants = {
+		glm::inverse(projection * model_view),
+		glm::inverse(model_view)[3],
+		_cell_geometry.get_grid_origin(),
+		{ static_cast<float>(_swapchain_extent.width), static_cast<float>(_swapchain_extent.height) },
+		cell_geometry::get_cell_spacing(),
+		static_cast<uint32_t>(_instance_grid_size),
+		_board_layout_constants.uints_per_row,
+		cell_extent.x,
+		cell_extent.y,
+		static_cast<uint32_t>(2 * _instance_grid_size + 2) };
+}
+
+// Only called right after the board buffer was recreated, when nothing in flight is using the descriptor set
+void tomway::render_system::update_raycast_descriptor_set() {
+	vk::DescriptorBufferInfo const buffer_info(*_board_buffer_u, 0, VK_WHOLE_SIZE); // Buffer, offset, range/size
+
+	vk::WriteDescriptorSet const descriptor_write(
+		_raycast_descriptor_set,
+		0, // Binding
+		0, // Array element
+		vk::DescriptorType::eStorageBuffer,
+		nullptr, // Image info
+		buffer_info,
+		nullptr); // Texel buffer view
+
+	_device_u->updateDescriptorSets(descriptor_write, nullptr);
 }
 
 void tomway::render_system::update_uniform_buffer(transform transform) {
@@ -973,6 +2425,28 @@ static vk::SurfaceFormatKHR tomway::choose_swap_surface_format(const std::vector
 	return formats[0];
 }
 
+static tomway::vertex_upload_strategy tomway::choose_vertex_upload_strategy(const vk::PhysicalDevice& physical_device) {
+	auto const mem_properties = physical_device.getMemoryProperties();
+	vk::MemoryPropertyFlags const direct_flags =
+		vk::MemoryPropertyFlagBits::eDeviceLocal | vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+	vk::DeviceSize largest_device_heap = 0;
+
+	for (uint32_t i = 0; i < mem_properties.memoryHeapCount; i++) {
+		if (not (mem_properties.memoryHeaps[i].flags & vk::MemoryHeapFlagBits::eDeviceLocal)) continue;
+		largest_device_heap = std::max(largest_device_heap, mem_properties.memoryHeaps[i].size);
+	}
+
+	// find_memory_type takes the first match, so that's the type whose heap counts. Without resizable BAR a discrete
+	// GPU only lets the CPU see a small window of its memory, too little to hold a big board's vertices.
+	for (uint32_t i = 0; i < mem_properties.memoryTypeCount; i++) {
+		if ((mem_properties.memoryTypes[i].propertyFlags & direct_flags) != direct_flags) continue;
+		uint32_t const heap = mem_properties.memoryTypes[i].heapIndex;
+		return mem_properties.memoryHeaps[heap].size >= largest_device_heap ? vertex_upload_strategy::DIRECT : vertex_upload_strategy::STAGED;
+	}
+
+	return vertex_upload_strategy::STAGED;
+}
+
 static vk::UniqueImageView tomway::create_image_view(const vk::Device& device, const vk::Image& image, vk::Format format, vk::ImageAspectFlags aspect_mask, uint32_t mip_levels) {
 	vk::ComponentMapping components(
 		vk::ComponentSwizzle::eIdentity,
@@ -1089,8 +2563,8 @@ vk::UniqueRenderPass tomway::create_render_pass(const vk::PhysicalDevice& physic
 	return device.createRenderPassUnique(create_info);
 }
 
-static vk::UniqueShaderModule tomway::create_shader_module(const vk::Device& device, const std::vector<char>& bytes) {
-	vk::ShaderModuleCreateInfo createInfo({}, bytes.size(), reinterpret_cast<const uint32_t*>(bytes.data()), nullptr);
+static vk::UniqueShaderModule tomway::create_shader_module(const vk::Device& device, const shader_code& code) {
+	vk::ShaderModuleCreateInfo createInfo({}, code.size_bytes, code.words, nullptr);
 	return device.createShaderModuleUnique(createInfo);
 }
 
@@ -1126,7 +2600,10 @@ static tomway::QueueFamilyIndices tomway::find_queue_families(const vk::Physical
 	auto queueFamilyProperties = physical_device.getQueueFamilyProperties();
 
 	for (int i = 0; i < queueFamilyProperties.size() && !is_queue_family_complete(deviceIndices); i++) {
-		if (queueFamilyProperties[i].queueFlags & vk::QueueFlagBits::eGraphics) {
+		// The compaction pass runs on the graphics queue, so it has to do compute as well
+		vk::QueueFlags const graphics_and_compute = vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute;
+
+		if ((queueFamilyProperties[i].queueFlags & graphics_and_compute) == graphics_and_compute) {
 			deviceIndices.graphics_family = i;
 			deviceIndices.graphics_avail = true;
 		}
@@ -1137,6 +2614,22 @@ static tomway::QueueFamilyIndices tomway::find_queue_families(const vk::Physical
 		}
 	}
 
+	// A family without graphics that can transfer is usually a copy engine that runs alongside the graphics queue.
+	// One without compute either is the most likely to be a dedicated one.
+	deviceIndices.transfer_family = deviceIndices.graphics_family;
+	int transfer_rank = 0;
+
+	for (int i = 0; i < queueFamilyProperties.size(); i++) {
+		vk::QueueFlags const flags = queueFamilyProperties[i].queueFlags;
+		if (not (flags & vk::QueueFlagBits::eTransfer) or (flags & vk::QueueFlagBits::eGraphics)) continue;
+		int const rank = flags & vk::QueueFlagBits::eCompute ? 1 : 2;
+
+		if (rank > transfer_rank) {
+			transfer_rank = rank;
+			deviceIndices.transfer_family = i;
+		}
+	}
+
 	return deviceIndices;
 }
 
@@ -1169,9 +2662,6 @@ static vk::SampleCountFlagBits tomway::get_max_usable_sample_count(const vk::Phy
 
 static bool tomway::is_device_suitable(const vk::PhysicalDevice& device, const vk::SurfaceKHR& surface, const std::vector<const char*>& required_device_extensions) {
 	QueueFamilyIndices deviceIndices = tomway::find_queue_families(device, surface);
-	auto deviceProperties = device.getProperties();
-	auto deviceFeatures = device.getFeatures();
-
 	bool extensionsSupported = tomway::check_device_extension_support(device, required_device_extensions);
 	bool swapchainAdequate = false;
 
@@ -1185,13 +2675,18 @@ static bool tomway::is_device_suitable(const vk::PhysicalDevice& device, const v
 		swapchainAdequate = details.formats.size() > 0 && details.present_modes.size() > 0;
 	}
 
+	// Vertex uploads are tracked with timeline semaphores
+	vk::PhysicalDeviceVulkan12Features features12;
+	vk::PhysicalDeviceFeatures2 features2;
+	features2.pNext = &features12;
+	device.getFeatures2(&features2);
+
+	// Any device type will do, pick_physical_device prefers discrete GPUs when there's a choice
 	return (
-		(deviceProperties.deviceType == vk::PhysicalDeviceType::eDiscreteGpu)
-		&& deviceFeatures.geometryShader
-		&& deviceFeatures.samplerAnisotropy
-		&& tomway::is_queue_family_complete(deviceIndices)
+		tomway::is_queue_family_complete(deviceIndices)
 		&& extensionsSupported
 		&& swapchainAdequate
+		&& features12.timelineSemaphore
 	);
 }
 
@@ -1199,27 +2694,11 @@ static bool tomway::is_queue_family_complete(const tomway::QueueFamilyIndices& i
 	return indices.graphics_avail && indices.present_avail;
 }
 
-static std::vector<char> tomway::read_shader_bytes(const std::string& file_path) {
-	std::ifstream file(file_path, std::ios::ate | std::ios::binary);
-
-	if (!file.is_open()) {
-		throw std::runtime_error("Cannot find file to read!\n");
-	}
-
-	size_t fileSize = (size_t)file.tellg();
-	std::vector<char> bytes(fileSize);
-	file.seekg(0);
-	file.read(reinterpret_cast<char*>(bytes.data()), fileSize);
-	file.close();
-
-	return bytes;
-}
-
 inline bool tomway::need_bigger_chunk_alloc(std::vector<vertex_chunk> const& curr_chunks, std::vector<vertex_chunk> const& new_chunks)
 {
 	if (curr_chunks.size() < new_chunks.size()) return true;
 
-	for (size_t i = 0; i < curr_chunks.size(); i++)
+	for (size_t i = 0; i < new_chunks.size(); i++)
 	{
 		if (curr_chunks[i].max_size_bytes < new_chunks[i].max_size_bytes) return true;
 	}
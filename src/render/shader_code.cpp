@@ -0,0 +1,41 @@
+#include "render/shader_code.h"
+
+namespace
+{
+    // Each include is the output of glslc -mfmt=num, the shader's words as a comma separated list
+    uint32_t const COMPACT_COMP[] = {
+        #include "shaders/compact_comp.spv.inc"
+    };
+
+    uint32_t const DENSITY_VERT[] = {
+        #include "shaders/density_vert.spv.inc"
+    };
+
+    uint32_t const FRAG[] = {
+        #include "shaders/frag.spv.inc"
+    };
+
+    uint32_t const INSTANCED_VERT[] = {
+        #include "shaders/instanced_vert.spv.inc"
+    };
+
+    uint32_t const RAYCAST_FRAG[] = {
+        #include "shaders/raycast_frag.spv.inc"
+    };
+
+    uint32_t const RAYCAST_VERT[] = {
+        #include "shaders/raycast_vert.spv.inc"
+    };
+
+    uint32_t const VERT[] = {
+        #include "shaders/vert.spv.inc"
+    };
+}
+
+tomway::shader_code const tomway::COMPACT_COMP_SHADER = { COMPACT_COMP, sizeof(COMPACT_COMP) };
+tomway::shader_code const tomway::DENSITY_VERT_SHADER = { DENSITY_VERT, sizeof(DENSITY_VERT) };
+tomway::shader_code const tomway::FRAG_SHADER = { FRAG, sizeof(FRAG) };
+tomway::shader_code const tomway::INSTANCED_VERT_SHADER = { INSTANCED_VERT, sizeof(INSTANCED_VERT) };
+tomway::shader_code const tomway::RAYCAST_FRAG_SHADER = { RAYCAST_FRAG, sizeof(RAYCAST_FRAG) };
+tomway::shader_code const tomway::RAYCAST_VERT_SHADER = { RAYCAST_VERT, sizeof(RAYCAST_VERT) };
+tomway::shader_code const tomway::VERT_SHADER = { VERT, sizeof(VERT) };
\ No newline at end of file
@@ -1,12 +1,10 @@
 #include "render/vertex.h"
 
-std::array<vk::VertexInputAttributeDescription, 3> tomway::vertex::get_attribute_descriptions() {
-	std::array<vk::VertexInputAttributeDescription, 3> ret{};
-
-	ret[0] = { 0, 0, vk::Format::eR32G32B32Sfloat, offsetof(vertex, pos) }; // Location, binding, format, offset
-	ret[1] = { 1, 0, vk::Format::eR32G32B32Sfloat, offsetof(vertex, normal) }; // Location, binding, format, offset
-	ret[2] = { 2, 0, vk::Format::eR32G32B32Sfloat, offsetof(vertex, color) }; // Location, binding, format, offset
-
+// One attribute for the whole vertex, the shaders unpack the normal and color from the fourth component. Four 16-bit
+// components is a format every device can read vertices in, three isn't.
+std::array<vk::VertexInputAttributeDescription, 1> tomway::vertex::get_attribute_descriptions() {
+	std::array<vk::VertexInputAttributeDescription, 1> ret{};
+	ret[0] = { 0, 0, vk::Format::eR16G16B16A16Uint, offsetof(vertex, x) }; // Location, binding, format, offset
 	return ret;
 }
 
@@ -0,0 +1,247 @@
+#include "simulation/board_file.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "SDL_log.h"
+#include "tomway_utility.h"
+#include "Tracy.hpp"
+
+namespace
+{
+    char constexpr MAGIC[8] = { 'T', 'O', 'M', 'W', 'A', 'Y', 'B', 'D' };
+    size_t constexpr TILE_BYTES = tomway::board_file::TILE_SIZE * sizeof(uint64_t);
+    // Tiles between progress reports
+    size_t constexpr PROGRESS_INTERVAL = 1024;
+
+    // Mask of the bits in [first, end) of a word
+    uint64_t bit_range(size_t const first, size_t const end)
+    {
+        uint64_t const below_end = end >= 64 ? ~uint64_t(0) : (uint64_t(1) << end) - 1;
+        return below_end & ~((uint64_t(1) << first) - 1);
+    }
+}
+
+bool tomway::board_file::is_board_file(std::string const& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    char magic[sizeof(MAGIC)] = {};
+    file.read(magic, sizeof(magic));
+    return file and memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+bool tomway::board_file::write(
+    std::string const& path,
+    cell_container const& cells,
+    uint64_t const generation,
+    progress_fn const& progress)
+{
+    ZoneScoped;
+    size_t const grid_size = cells.grid_size();
+    size_t const tiles_per_side = cells.words_per_row();
+    std::vector<board_file_tile> tiles;
+
+    for (size_t tile_y = 0; tile_y < tiles_per_side; tile_y++)
+    {
+        size_t const first_row = tile_y * TILE_SIZE;
+        size_t const end_row = std::min(first_row + TILE_SIZE, grid_size);
+        size_t population = 0;
+
+        for (size_t y = first_row; y < end_row; y++) population += cells.get_row_population(y);
+        if (population == 0) continue;
+
+        for (size_t tile_x = 0; tile_x < tiles_per_side; tile_x++)
+        {
+            bool empty = true;
+
+            for (size_t y = first_row; y < end_row and empty; y++)
+            {
+                empty = cells.get_word(y, tile_x) == 0;
+            }
+
+            if (not empty)
+            {
+                tiles.push_back({ static_cast<uint32_t>(tile_x), static_cast<uint32_t>(tile_y), 0 });
+            }
+        }
+    }
+
+    board_file_header header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.tile_size = TILE_SIZE;
+    header.grid_size = grid_size;
+    header.generation = generation;
+    header.birth_mask = CONWAY_BIRTH_MASK;
+    header.survive_mask = CONWAY_SURVIVE_MASK;
+    header.tile_count = static_cast<uint32_t>(tiles.size());
+    header.index_offset = sizeof(board_file_header);
+
+    uint64_t const data_offset = header.index_offset + tiles.size() * sizeof(board_file_tile);
+
+    for (size_t i = 0; i < tiles.size(); i++)
+    {
+        tiles[i].offset = data_offset + i * TILE_BYTES;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+
+    if (not file)
+    {
+        LOG_ERROR("Could not save file: %s", path.c_str());
+        return false;
+    }
+
+    file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    file.write(reinterpret_cast<char const*>(tiles.data()), static_cast<std::streamsize>(tiles.size() * sizeof(board_file_tile)));
+
+    uint64_t tile_words[TILE_SIZE];
+
+    for (size_t i = 0; i < tiles.size(); i++)
+    {
+        auto const& tile = tiles[i];
+        size_t const first_row = tile.tile_y * TILE_SIZE;
+        if (progress and i % PROGRESS_INTERVAL == 0) progress(static_cast<float>(i) / tiles.size());
+
+        for (size_t row = 0; row < TILE_SIZE; row++)
+        {
+            size_t const y = first_row + row;
+            tile_words[row] = y < grid_size ? cells.get_word(y, tile.tile_x) : 0;
+        }
+
+        file.write(reinterpret_cast<char const*>(tile_words), sizeof(tile_words));
+    }
+
+    if (not file)
+    {
+        LOG_ERROR("Could not save file: %s", path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+tomway::board_file_header const& tomway::board_file::get_header() const
+{
+    return _header;
+}
+
+bool tomway::board_file::open(std::string const& path)
+{
+    ZoneScoped;
+    _tiles = nullptr;
+    _tiles_per_side = 0;
+
+    if (not _file.open(path))
+    {
+        LOG_ERROR("Could not load file: %s", path.c_str());
+        return false;
+    }
+
+    size_t const size = _file.get_size();
+
+    if (size < sizeof(board_file_header))
+    {
+        LOG_ERROR("Malformed board file: file is smaller than the header.");
+        return false;
+    }
+
+    memcpy(&_header, _file.get_data(), sizeof(_header));
+
+    if (memcmp(_header.magic, MAGIC, sizeof(MAGIC)) != 0)
+    {
+        LOG_ERROR("Malformed board file: bad magic.");
+        return false;
+    }
+
+    if (_header.version != VERSION)
+    {
+        LOG_ERROR("Unsupported board file version %u, expected %u.", _header.version, VERSION);
+        return false;
+    }
+
+    if (_header.tile_size != TILE_SIZE)
+    {
+        LOG_ERROR("Unsupported board file tile size %u.", _header.tile_size);
+        return false;
+    }
+
+    if (_header.birth_mask != CONWAY_BIRTH_MASK or _header.survive_mask != CONWAY_SURVIVE_MASK)
+    {
+        LOG_ERROR("Unsupported board file rule, only B3/S23 is supported.");
+        return false;
+    }
+
+    if (_header.grid_size > cell_container::MAX_GRID_SIZE)
+    {
+        LOG_ERROR("Malformed board file: grid_size is too large.");
+        return false;
+    }
+
+    _tiles_per_side = (_header.grid_size + TILE_SIZE - 1) / TILE_SIZE;
+
+    // Compared by subtracting from size, adding to offsets that came from the file could wrap around
+    if (_header.index_offset % sizeof(uint64_t) != 0 or _header.index_offset < sizeof(board_file_header) or
+        _header.index_offset > size or _header.tile_count > (size - _header.index_offset) / sizeof(board_file_tile))
+    {
+        LOG_ERROR("Malformed board file: tile index is outside of the file.");
+        return false;
+    }
+
+    uint64_t const index_end = _header.index_offset + uint64_t(_header.tile_count) * sizeof(board_file_tile);
+
+    auto const tiles = reinterpret_cast<board_file_tile const*>(_file.get_data() + _header.index_offset);
+
+    for (uint32_t i = 0; i < _header.tile_count; i++)
+    {
+        auto const& tile = tiles[i];
+
+        if (tile.tile_x >= _tiles_per_side or tile.tile_y >= _tiles_per_side)
+        {
+            LOG_ERROR("Malformed board file: tile %u is outside of grid_size.", i);
+            return false;
+        }
+
+        if (tile.offset % sizeof(uint64_t) != 0 or tile.offset < index_end or size < TILE_BYTES or
+            tile.offset > size - TILE_BYTES)
+        {
+            LOG_ERROR("Malformed board file: tile %u data is outside of the file.", i);
+            return false;
+        }
+    }
+
+    _tiles = tiles;
+    return true;
+}
+
+void tomway::board_file::read(cell_container& cells, progress_fn const& progress) const
+{
+    ZoneScoped;
+    size_t const grid_size = _header.grid_size;
+    cells = cell_container(grid_size);
+
+    // Bits past the end of the last word of a row have to stay clear
+    uint64_t const last_word_mask = bit_range(0, grid_size - (_tiles_per_side - 1) * TILE_SIZE);
+
+    for (uint32_t i = 0; i < _header.tile_count; i++)
+    {
+        auto const& tile = _tiles[i];
+        uint64_t const* words = _get_tile_words(tile);
+        if (progress and i % PROGRESS_INTERVAL == 0) progress(static_cast<float>(i) / _header.tile_count);
+        uint64_t const mask = tile.tile_x + 1 == _tiles_per_side ? last_word_mask : ~uint64_t(0);
+        size_t const first_row = tile.tile_y * TILE_SIZE;
+        size_t const rows = std::min<size_t>(TILE_SIZE, grid_size - first_row);
+
+        for (size_t row = 0; row < rows; row++)
+        {
+            cells.set_word(first_row + row, tile.tile_x, words[row] & mask);
+        }
+    }
+}
+
+uint64_t const* tomway::board_file::_get_tile_words(board_file_tile const& tile) const
+{
+    return reinterpret_cast<uint64_t const*>(_file.get_data() + tile.offset);
+}
@@ -0,0 +1,363 @@
+#include "simulation/board_json.h"
+
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "rapidjson/error/en.h"
+#include "rapidjson/istreamwrapper.h"
+#include "rapidjson/reader.h"
+#include "rapidjson/stringbuffer.h"
+#include "rapidjson/writer.h"
+#include "SDL_log.h"
+#include "tomway_utility.h"
+#include "Tracy.hpp"
+
+namespace
+{
+    size_t constexpr STREAM_BUFFER_SIZE = 1 << 16;
+    // Cells between progress reports
+    size_t constexpr PROGRESS_INTERVAL = 1 << 16;
+
+    // SAX handler for board files. Every event is checked against where we are in the document, so a malformed file
+    // is rejected at the first bad token and cells are set on the board as soon as they are read.
+    class board_json_handler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, board_json_handler>
+    {
+    public:
+        board_json_handler(
+            tomway::cell_container& cells,
+            rapidjson::IStreamWrapper const& stream,
+            size_t const file_size,
+            tomway::progress_fn const& progress)
+            : _cells(cells),
+            _file_size(file_size),
+            _progress(progress),
+            _stream(stream)
+        {
+        }
+
+        bool Default()
+        {
+            if (_state == state::SKIP) return _skip_value();
+            return _unexpected();
+        }
+
+        bool Uint(unsigned const value)
+        {
+            return Uint64(value);
+        }
+
+        bool Uint64(uint64_t const value)
+        {
+            switch (_state)
+            {
+            case state::GRID_SIZE:
+                if (value > tomway::cell_container::MAX_GRID_SIZE)
+                {
+                    return _error("Malformed save file: document[\"grid_size\"] is too large.");
+                }
+
+                _grid_size = value;
+                _has_grid_size = true;
+                _cells = tomway::cell_container(_grid_size);
+                _state = state::OBJECT;
+                return _flush_pending();
+            case state::CELL:
+                if (_value_count == 2) return _unexpected();
+                _values[_value_count++] = value;
+                return true;
+            case state::SKIP:
+                return _skip_value();
+            default:
+                return _unexpected();
+            }
+        }
+
+        bool StartObject()
+        {
+            switch (_state)
+            {
+            case state::DOCUMENT:
+                _state = state::OBJECT;
+                return true;
+            case state::SKIP:
+                _skip_depth++;
+                return true;
+            default:
+                return _unexpected();
+            }
+        }
+
+        bool Key(char const* str, rapidjson::SizeType const length, bool)
+        {
+            if (_state == state::SKIP) return true;
+            if (_state != state::OBJECT) return _unexpected();
+
+            if (length == 5 and strncmp(str, "cells", length) == 0)
+            {
+                if (_has_cells) return _error("Malformed save file: document[\"cells\"] present more than once.");
+                _state = state::CELLS;
+            }
+            else if (length == 9 and strncmp(str, "grid_size", length) == 0)
+            {
+                if (_has_grid_size) return _error("Malformed save file: document[\"grid_size\"] present more than once.");
+                _state = state::GRID_SIZE;
+            }
+            else
+            {
+                _state = state::SKIP;
+                _skip_depth = 0;
+            }
+
+            return true;
+        }
+
+        bool EndObject(rapidjson::SizeType)
+        {
+            switch (_state)
+            {
+            case state::OBJECT:
+                if (not _has_cells) return _error("Malformed save file: document[\"cells\"] not present or not array.");
+                if (not _has_grid_size) return _error("Malformed save file: document[\"grid_size\"] not present or not uint64.");
+                _state = state::DONE;
+                return true;
+            case state::SKIP:
+                _skip_depth--;
+                return _skip_depth == 0 ? _skip_value() : true;
+            default:
+                return _unexpected();
+            }
+        }
+
+        bool StartArray()
+        {
+            switch (_state)
+            {
+            case state::CELLS:
+                _state = state::CELL_ARRAY;
+                return true;
+            case state::CELL_ARRAY:
+                _state = state::CELL;
+                _value_count = 0;
+                return true;
+            case state::SKIP:
+                _skip_depth++;
+                return true;
+            default:
+                return _unexpected();
+            }
+        }
+
+        bool EndArray(rapidjson::SizeType)
+        {
+            switch (_state)
+            {
+            case state::CELL:
+                if (_value_count != 2) return _unexpected();
+                _state = state::CELL_ARRAY;
+                return _add_cell(_values[0], _values[1]);
+            case state::CELL_ARRAY:
+                _has_cells = true;
+                _state = state::OBJECT;
+                return true;
+            case state::SKIP:
+                _skip_depth--;
+                return _skip_depth == 0 ? _skip_value() : true;
+            default:
+                return _unexpected();
+            }
+        }
+
+        bool has_error() const
+        {
+            return _has_error;
+        }
+    private:
+        enum class state { DOCUMENT, OBJECT, GRID_SIZE, CELLS, CELL_ARRAY, CELL, SKIP, DONE };
+
+        bool _add_cell(uint64_t const x, uint64_t const y)
+        {
+            size_t const position = _cell_count++;
+
+            if (_progress and _file_size > 0 and position % PROGRESS_INTERVAL == 0)
+            {
+                _progress(static_cast<float>(_stream.Tell()) / _file_size);
+            }
+
+            if (not _has_grid_size)
+            {
+                // Coordinates that can't fit in 32 bits can't fit in any board we could allocate either
+                if (x > UINT32_MAX or y > UINT32_MAX) return _out_of_range(position);
+                _pending.push_back({ static_cast<uint32_t>(x), static_cast<uint32_t>(y) });
+                return true;
+            }
+
+            if (x >= _grid_size or y >= _grid_size) return _out_of_range(position);
+            _cells.set_alive(x, y, true);
+            return true;
+        }
+
+        bool _error(char const* msg)
+        {
+            LOG_ERROR("%s", msg);
+            _has_error = true;
+            return false;
+        }
+
+        bool _flush_pending()
+        {
+            for (size_t i = 0; i < _pending.size(); i++)
+            {
+                if (_pending[i].x >= _grid_size or _pending[i].y >= _grid_size) return _out_of_range(i);
+                _cells.set_alive(_pending[i].x, _pending[i].y, true);
+            }
+
+            tomway::live_cell_list().swap(_pending);
+            return true;
+        }
+
+        bool _out_of_range(size_t const position)
+        {
+            LOG_ERROR("Malformed save file: cell at position %zu is outside of grid_size.", position);
+            _has_error = true;
+            return false;
+        }
+
+        bool _skip_value()
+        {
+            if (_skip_depth == 0) _state = state::OBJECT;
+            return true;
+        }
+
+        // Reports the error that matches where the bad token showed up
+        bool _unexpected()
+        {
+            switch (_state)
+            {
+            case state::GRID_SIZE:
+                return _error("Malformed save file: document[\"grid_size\"] not present or not uint64.");
+            case state::CELLS:
+                return _error("Malformed save file: document[\"cells\"] not present or not array.");
+            case state::CELL_ARRAY:
+                LOG_ERROR("Cell at position %zu is not an array.", _cell_count);
+                break;
+            case state::CELL:
+                LOG_ERROR("Cell at position %zu does not have two uint64 members.", _cell_count);
+                break;
+            default:
+                LOG_ERROR("Malformed save file: document is not an object.");
+                break;
+            }
+
+            _has_error = true;
+            return false;
+        }
+
+        tomway::cell_container& _cells;
+        size_t _cell_count = 0;
+        size_t _file_size;
+        uint64_t _grid_size = 0;
+        bool _has_cells = false;
+        bool _has_error = false;
+        bool _has_grid_size = false;
+        tomway::live_cell_list _pending;
+        tomway::progress_fn const& _progress;
+        int _skip_depth = 0;
+        state _state = state::DOCUMENT;
+        rapidjson::IStreamWrapper const& _stream;
+        int _value_count = 0;
+        uint64_t _values[2] = {};
+    };
+}
+
+bool tomway::read_board_json(std::string const& path, cell_container& cells, progress_fn const& progress)
+{
+    ZoneScoped;
+    std::ifstream file(path, std::ios::binary);
+
+    if (not file)
+    {
+        LOG_ERROR("Could not load file: %s", path.c_str());
+        return false;
+    }
+
+    file.seekg(0, std::ios::end);
+    auto const file_size = static_cast<size_t>(file.tellg());
+    file.seekg(0, std::ios::beg);
+
+    std::vector<char> buffer(STREAM_BUFFER_SIZE);
+    rapidjson::IStreamWrapper stream(file, buffer.data(), buffer.size());
+    cell_container loaded(0);
+    board_json_handler handler(loaded, stream, file_size, progress);
+    rapidjson::Reader reader;
+    auto const result = reader.Parse(stream, handler);
+
+    if (result.IsError())
+    {
+        if (not handler.has_error())
+        {
+            LOG_ERROR(
+                "Malformed save file: %s (offset %zu)",
+                rapidjson::GetParseError_En(result.Code()),
+                result.Offset());
+        }
+
+        return false;
+    }
+
+    cells = std::move(loaded);
+    return true;
+}
+
+bool tomway::write_board_json(
+    std::string const& path,
+    size_t const grid_size,
+    live_cell_list const& live_cells,
+    progress_fn const& progress)
+{
+    ZoneScoped;
+    std::ofstream file(path, std::ios::binary);
+
+    if (not file)
+    {
+        LOG_ERROR("Could not save file: %s", path.c_str());
+        return false;
+    }
+
+    // The writer only keeps its nesting state, so the buffer can be drained to the file as it fills
+    rapidjson::StringBuffer sb(nullptr, STREAM_BUFFER_SIZE);
+    rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
+    writer.StartObject();
+    writer.Key("grid_size");
+    writer.Uint64(grid_size);
+    writer.Key("cells");
+    writer.StartArray();
+
+    for (size_t i = 0; i < live_cells.size(); i++)
+    {
+        writer.StartArray();
+        writer.Uint(live_cells[i].x);
+        writer.Uint(live_cells[i].y);
+        writer.EndArray();
+
+        if (progress and i % PROGRESS_INTERVAL == 0) progress(static_cast<float>(i) / live_cells.size());
+
+        if (sb.GetSize() >= STREAM_BUFFER_SIZE - 64)
+        {
+            file.write(sb.GetString(), static_cast<std::streamsize>(sb.GetSize()));
+            sb.Clear();
+        }
+    }
+
+    writer.EndArray();
+    writer.EndObject();
+    file.write(sb.GetString(), static_cast<std::streamsize>(sb.GetSize()));
+
+    if (not file)
+    {
+        LOG_ERROR("Could not save file: %s", path.c_str());
+        return false;
+    }
+
+    return true;
+}
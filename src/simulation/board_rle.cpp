@@ -0,0 +1,333 @@
+#include "simulation/board_rle.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+
+#include "mapped_file.h"
+#include "SDL_log.h"
+#include "tomway_utility.h"
+#include "Tracy.hpp"
+
+namespace
+{
+    size_t constexpr MAX_LINE_LENGTH = 70;
+    // Bytes of input between progress reports
+    size_t constexpr PROGRESS_INTERVAL = 1 << 20;
+    size_t constexpr WRITE_BUFFER_SIZE = 1 << 16;
+
+    // Accepts B3/S23 in either notation, plus anything after a colon such as a bounded grid suffix
+    bool is_conway_rule(std::string rule)
+    {
+        rule = rule.substr(0, rule.find(':'));
+        std::transform(rule.begin(), rule.end(), rule.begin(), [](char const c) { return static_cast<char>(toupper(c)); });
+        return rule.empty() or rule == "B3/S23" or rule == "23/3";
+    }
+
+    // Appends a count and tag, leaving the count off when it's one and wrapping lines the way other tools do
+    void append_token(std::string& out, size_t& line_length, size_t count, char const tag)
+    {
+        char token[24];
+        char* const token_end = token + sizeof(token);
+        char* first = token_end;
+        *--first = tag;
+
+        if (count > 1)
+        {
+            while (count > 0)
+            {
+                *--first = static_cast<char>('0' + count % 10);
+                count /= 10;
+            }
+        }
+
+        size_t const length = token_end - first;
+
+        if (line_length + length > MAX_LINE_LENGTH)
+        {
+            out += '\n';
+            line_length = 0;
+        }
+
+        out.append(first, length);
+        line_length += length;
+    }
+}
+
+size_t tomway::rle_pattern::get_height() const
+{
+    return _height;
+}
+
+size_t tomway::rle_pattern::get_population() const
+{
+    return _population;
+}
+
+size_t tomway::rle_pattern::get_width() const
+{
+    return _width;
+}
+
+bool tomway::rle_pattern::paste(cell_container& cells, size_t const x, size_t const y) const
+{
+    ZoneScoped;
+    size_t const grid_size = cells.grid_size();
+
+    if (_width > grid_size or _height > grid_size)
+    {
+        LOG_ERROR("Pattern is %zu x %zu, too big for a %zu x %zu board.", _width, _height, grid_size, grid_size);
+        return false;
+    }
+
+    // Sets a run that may wrap past the right edge of the board
+    auto const set_wrapped_run = [&cells, grid_size](size_t const row, size_t const first_x, size_t const length, bool const alive)
+    {
+        size_t const start = first_x % grid_size;
+        size_t const before_edge = std::min(length, grid_size - start);
+        cells.set_run(row, start, before_edge, alive);
+        cells.set_run(row, 0, length - before_edge, alive);
+    };
+
+    for (size_t row = 0; row < _height; row++)
+    {
+        set_wrapped_run((y + row) % grid_size, x, _width, false);
+    }
+
+    for (auto const& run : _runs)
+    {
+        set_wrapped_run((y + run.y) % grid_size, x + run.x, run.length, true);
+    }
+
+    return true;
+}
+
+bool tomway::rle_pattern::read(std::string const& path, progress_fn const& progress)
+{
+    ZoneScoped;
+    mapped_file file;
+
+    if (not file.open(path))
+    {
+        LOG_ERROR("Could not load file: %s", path.c_str());
+        return false;
+    }
+
+    char const* cursor = reinterpret_cast<char const*>(file.get_data());
+    char const* const begin = cursor;
+    char const* const end = cursor + file.get_size();
+    char const* next_report = begin;
+    bool has_header = false;
+    _runs.clear();
+    // Rough guess at the run count so that big patterns don't keep regrowing the vector
+    _runs.reserve(file.get_size() / 4);
+    _width = 0;
+    _height = 0;
+    _population = 0;
+
+    // Comment lines start with #, the first line that doesn't is the header
+    while (cursor < end and not has_header)
+    {
+        char const* const line_end = std::find(cursor, end, '\n');
+        std::string const line(cursor, line_end);
+        cursor = line_end == end ? end : line_end + 1;
+
+        size_t const first = line.find_first_not_of(" \t\r");
+        if (first == std::string::npos or line[first] == '#') continue;
+
+        // x = m, y = n[, rule = r]
+        size_t position = first;
+
+        while (position < line.size())
+        {
+            size_t const separator = line.find(',', position);
+            std::string const pair = line.substr(position, separator == std::string::npos ? std::string::npos : separator - position);
+            size_t const equals = pair.find('=');
+
+            if (equals == std::string::npos)
+            {
+                LOG_ERROR("Malformed RLE file: bad header \"%s\".", line.c_str());
+                return false;
+            }
+
+            auto const trim = [](std::string const& str)
+            {
+                size_t const str_first = str.find_first_not_of(" \t\r");
+                if (str_first == std::string::npos) return std::string();
+                return str.substr(str_first, str.find_last_not_of(" \t\r") - str_first + 1);
+            };
+
+            std::string const key = trim(pair.substr(0, equals));
+            std::string const value = trim(pair.substr(equals + 1));
+
+            if (key == "x") _width = strtoull(value.c_str(), nullptr, 10);
+            else if (key == "y") _height = strtoull(value.c_str(), nullptr, 10);
+            else if (key == "rule" and not is_conway_rule(value))
+            {
+                LOG_ERROR("Unsupported RLE rule %s, only B3/S23 is supported.", value.c_str());
+                return false;
+            }
+
+            if (separator == std::string::npos) break;
+            position = separator + 1;
+        }
+
+        has_header = true;
+    }
+
+    if (not has_header)
+    {
+        LOG_ERROR("Malformed RLE file: no header line.");
+        return false;
+    }
+
+    // Checked before any cells exist, a board this big can't be allocated and would throw on the loading thread
+    if (_width > cell_container::MAX_GRID_SIZE or _height > cell_container::MAX_GRID_SIZE)
+    {
+        LOG_ERROR("RLE pattern is %zux%zu, larger than the %zu cell limit.", _width, _height, cell_container::MAX_GRID_SIZE);
+        return false;
+    }
+
+    size_t count = 0;
+    size_t x = 0;
+    size_t y = 0;
+    size_t extent_x = 0;
+    bool finished = false;
+
+    for (; cursor < end and not finished; cursor++)
+    {
+        char const c = *cursor;
+
+        if (progress and cursor >= next_report)
+        {
+            progress(static_cast<float>(cursor - begin) / file.get_size());
+            next_report = cursor + PROGRESS_INTERVAL;
+        }
+
+        if (c >= '0' and c <= '9')
+        {
+            count = count * 10 + (c - '0');
+
+            if (count > UINT32_MAX)
+            {
+                LOG_ERROR("Malformed RLE file: run count is too large.");
+                return false;
+            }
+
+            continue;
+        }
+
+        size_t const length = count == 0 ? 1 : count;
+        count = 0;
+
+        switch (c)
+        {
+        case 'b':
+        case '.':
+            x += length;
+            break;
+        case 'o':
+        case 'A':
+            if (x + length > cell_container::MAX_GRID_SIZE or y >= cell_container::MAX_GRID_SIZE)
+            {
+                LOG_ERROR("Malformed RLE file: pattern is too large.");
+                return false;
+            }
+
+            _runs.push_back({ static_cast<uint32_t>(x), static_cast<uint32_t>(y), static_cast<uint32_t>(length) });
+            _population += length;
+            x += length;
+            extent_x = std::max(extent_x, x);
+            break;
+        case '$':
+            y += length;
+            x = 0;
+            break;
+        case '!':
+            finished = true;
+            break;
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            break;
+        default:
+            LOG_ERROR("Malformed RLE file: unsupported cell state '%c'.", c);
+            return false;
+        }
+    }
+
+    if (not finished)
+    {
+        LOG_ERROR("Malformed RLE file: pattern doesn't end with '!'.");
+        return false;
+    }
+
+    // Plenty of files in the wild understate their bounds, trust the cells over the header
+    _width = std::max(_width, extent_x);
+    if (not _runs.empty()) _height = std::max(_height, static_cast<size_t>(_runs.back().y) + 1);
+    return true;
+}
+
+bool tomway::write_board_rle(std::string const& path, cell_container const& cells, progress_fn const& progress)
+{
+    ZoneScoped;
+    std::ofstream file(path, std::ios::binary);
+
+    if (not file)
+    {
+        LOG_ERROR("Could not save file: %s", path.c_str());
+        return false;
+    }
+
+    size_t const grid_size = cells.grid_size();
+    std::string out = string_format("x = %zu, y = %zu, rule = B3/S23\n", grid_size, grid_size);
+    out.reserve(WRITE_BUFFER_SIZE + MAX_LINE_LENGTH);
+    size_t line_length = 0;
+    size_t pending_rows = 0;
+
+    for (size_t y = 0; y < grid_size; y++)
+    {
+        if (cells.get_row_population(y) > 0)
+        {
+            if (pending_rows > 0) append_token(out, line_length, pending_rows, '$');
+            pending_rows = 0;
+            size_t x = cells.find_next(y, 0, true);
+            if (x > 0) append_token(out, line_length, x, 'b');
+
+            while (x < grid_size)
+            {
+                size_t const dead = cells.find_next(y, x, false);
+                append_token(out, line_length, dead - x, 'o');
+                if (dead == grid_size) break;
+
+                // Dead cells at the end of a row are left off
+                size_t const next = cells.find_next(y, dead, true);
+                if (next == grid_size) break;
+                append_token(out, line_length, next - dead, 'b');
+                x = next;
+            }
+        }
+
+        pending_rows++;
+
+        if (out.size() >= WRITE_BUFFER_SIZE)
+        {
+            if (progress) progress(static_cast<float>(y) / grid_size);
+            file.write(out.data(), static_cast<std::streamsize>(out.size()));
+            out.clear();
+        }
+    }
+
+    out += "!\n";
+    file.write(out.data(), static_cast<std::streamsize>(out.size()));
+
+    if (not file)
+    {
+        LOG_ERROR("Could not save file: %s", path.c_str());
+        return false;
+    }
+
+    return true;
+}
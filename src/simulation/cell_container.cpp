@@ -1,42 +1,200 @@
 #include "simulation/cell_container.h"
 
+#include <atomic>
 #include <random>
+#include <stdexcept>
 
+#include "tomway_utility.h"
 
-tomway::cell_container::iterator::iterator(std::vector<cell>::iterator const& c)
-    : std::vector<cell>::iterator(c)
+tomway::cell_container::live_cell_iterator::live_cell_iterator(
+    cell_container const* cells,
+    size_t const row,
+    size_t const end_row)
+    : _cells(cells),
+    _end_row(end_row),
+    _row(row)
 {
-    
+    _load_row();
+    _advance();
 }
 
-tomway::cell_container::const_iterator::const_iterator(std::vector<cell>::const_iterator const& c)
-    : std::vector<cell>::const_iterator(c)
+tomway::cell_container::live_cell_iterator::reference tomway::cell_container::live_cell_iterator::operator*() const
 {
-    
+    return _current;
 }
 
-tomway::cell_container::cell_container(size_t grid_size)
-    : _grid_size(grid_size)
+tomway::cell_container::live_cell_iterator::pointer tomway::cell_container::live_cell_iterator::operator->() const
+{
+    return &_current;
+}
+
+tomway::cell_container::live_cell_iterator& tomway::cell_container::live_cell_iterator::operator++()
+{
+    _advance();
+    return *this;
+}
+
+tomway::cell_container::live_cell_iterator tomway::cell_container::live_cell_iterator::operator++(int)
+{
+    auto const ret = *this;
+    _advance();
+    return ret;
+}
+
+bool tomway::cell_container::live_cell_iterator::operator==(live_cell_iterator const& rhs) const
+{
+    return _row == rhs._row and _word_index == rhs._word_index and _word == rhs._word;
+}
+
+bool tomway::cell_container::live_cell_iterator::operator!=(live_cell_iterator const& rhs) const
+{
+    return not (*this == rhs);
+}
+
+void tomway::cell_container::live_cell_iterator::_advance()
+{
+    while (_row < _end_row)
+    {
+        if (_word)
+        {
+            unsigned const bit = count_trailing_zeros(_word);
+            _word &= _word - 1; // Clear the lowest set bit
+            _current = { static_cast<uint32_t>(_word_index * WORD_BITS + bit), static_cast<uint32_t>(_row) };
+            return;
+        }
+
+        _word_index++;
+
+        if (_word_index < _cells->_words_per_row)
+        {
+            _word = _cells->_words[_row * _cells->_words_per_row + _word_index];
+        }
+        else
+        {
+            _row++;
+            _load_row();
+        }
+    }
+}
+
+// Skips rows with no live cells and loads the first word of the next occupied one. Leaves the iterator equal to
+// end() when there are none left.
+void tomway::cell_container::live_cell_iterator::_load_row()
+{
+    while (_row < _end_row and _cells->_row_population[_row] == 0)
+    {
+        _row++;
+    }
+
+    _word_index = 0;
+    _word = _row < _end_row ? _cells->_words[_row * _cells->_words_per_row] : 0;
+    if (_row >= _end_row) _row = _end_row;
+}
+
+tomway::cell_container::live_cell_range::live_cell_range(
+    cell_container const* cells,
+    size_t const first_row,
+    size_t const end_row)
+    : _cells(cells),
+    _end_row(end_row),
+    _first_row(first_row)
 {
-    _cells.reserve(grid_size * grid_size);
-    
-    for (size_t y = 0; y < grid_size; y++)
+}
+
+void tomway::cell_container::live_cell_range::append_to(live_cell_list& out) const
+{
+    size_t count = out.size();
+    out.resize(count + population());
+    cell_coord* dst = out.data();
+    size_t const words_per_row = _cells->_words_per_row;
+
+    for (size_t y = _first_row; y < _end_row; y++)
     {
-        for (size_t x = 0; x < grid_size;x++)
+        if (_cells->_row_population[y] == 0) continue;
+        word const* row = _cells->_words + y * words_per_row;
+
+        for (size_t w = 0; w < words_per_row; w++)
         {
-            _cells.emplace_back(x, y, false);
+            word bits = row[w];
+
+            while (bits)
+            {
+                unsigned const bit = count_trailing_zeros(bits);
+                bits &= bits - 1;
+                dst[count++] = { static_cast<uint32_t>(w * WORD_BITS + bit), static_cast<uint32_t>(y) };
+            }
         }
     }
 }
 
-tomway::cell_container::iterator tomway::cell_container::begin()
+tomway::cell_container::live_cell_iterator tomway::cell_container::live_cell_range::begin() const
+{
+    return { _cells, _first_row, _end_row };
+}
+
+tomway::cell_container::live_cell_iterator tomway::cell_container::live_cell_range::end() const
+{
+    return { _cells, _end_row, _end_row };
+}
+
+size_t tomway::cell_container::live_cell_range::end_row() const
 {
-    return _cells.begin();
+    return _end_row;
 }
 
-tomway::cell_container::const_iterator tomway::cell_container::begin() const
+size_t tomway::cell_container::live_cell_range::first_row() const
 {
-    return _cells.cbegin();
+    return _first_row;
+}
+
+std::vector<tomway::cell_container::live_cell_range> tomway::cell_container::live_cell_range::partition(
+    size_t const partitions) const
+{
+    std::vector<live_cell_range> ret;
+    if (partitions == 0 or _first_row >= _end_row) return ret;
+
+    size_t const total = population();
+    size_t const target = total / partitions + 1;
+    size_t first_row = _first_row;
+    size_t acquired = 0;
+
+    for (size_t y = _first_row; y < _end_row and ret.size() + 1 < partitions; y++)
+    {
+        acquired += _cells->_row_population[y];
+
+        if (acquired >= target)
+        {
+            ret.emplace_back(_cells, first_row, y + 1);
+            first_row = y + 1;
+            acquired = 0;
+        }
+    }
+
+    if (first_row < _end_row) ret.emplace_back(_cells, first_row, _end_row);
+    return ret;
+}
+
+size_t tomway::cell_container::live_cell_range::population() const
+{
+    size_t ret = 0;
+
+    for (size_t y = _first_row; y < _end_row; y++)
+    {
+        ret += _cells->_row_population[y];
+    }
+
+    return ret;
+}
+
+tomway::cell_container::cell_container(size_t grid_size)
+    : _grid_size(grid_size),
+    _words_per_row((grid_size + WORD_BITS - 1) / WORD_BITS),
+    _storage(std::make_shared<storage>())
+{
+    _storage->row_population.assign(_grid_size, 0);
+    _storage->words.assign(_words_per_row * _grid_size, 0);
+    _row_population = _storage->row_population.data();
+    _words = _storage->words.data();
 }
 
 void tomway::cell_container::copy_from(cell_container const& other)
@@ -46,52 +204,166 @@ void tomway::cell_container::copy_from(cell_container const& other)
         throw std::invalid_argument("Cell container grid sizes must match to copy!");
     }
 
-    memcpy(_cells.data(), other._cells.data(), _cells.size() * sizeof(cell));
+    *this = other;
 }
 
-tomway::cell_container::iterator tomway::cell_container::end()
+size_t tomway::cell_container::find_next(size_t const y, size_t const x, bool const alive) const
 {
-    return _cells.end();
-}
+    if (x >= _grid_size) return _grid_size;
 
-tomway::cell_container::const_iterator tomway::cell_container::end() const
-{
-    return _cells.cend();
+    word const* row = _words + y * _words_per_row;
+    size_t word_index = x / WORD_BITS;
+    // Invert the words when looking for dead cells so that either search is a search for set bits
+    word const flip = alive ? 0 : ~word(0);
+    word bits = (row[word_index] ^ flip) & ~word(0) << (x % WORD_BITS);
+
+    while (not bits)
+    {
+        if (++word_index == _words_per_row) return _grid_size;
+        bits = row[word_index] ^ flip;
+    }
+
+    size_t const ret = word_index * WORD_BITS + count_trailing_zeros(bits);
+    // Padding past the end of the row reads as dead
+    return ret < _grid_size ? ret : _grid_size;
 }
 
 tomway::cell tomway::cell_container::get_cell(size_t x, size_t y) const
 {
-    return _cells[y * _grid_size + x];
+    return { x, y, get_alive(x, y) };
 }
 
 bool tomway::cell_container::get_alive(size_t x, size_t y) const
 {
-    return _cells[y * _grid_size + x].get_alive();
+    return _words[y * _words_per_row + x / WORD_BITS] >> (x % WORD_BITS) & 1;
+}
+
+size_t tomway::cell_container::get_population() const
+{
+    return live_cells().population();
 }
 
-void tomway::cell_container::randomize()
+size_t tomway::cell_container::get_row_population(size_t const y) const
+{
+    return _row_population[y];
+}
+
+tomway::cell_container::word tomway::cell_container::get_word(size_t const y, size_t const word_index) const
+{
+    return _words[y * _words_per_row + word_index];
+}
+
+tomway::cell_container::live_cell_range tomway::cell_container::live_cells() const
+{
+    return { this, 0, _grid_size };
+}
+
+tomway::cell_container::live_cell_range tomway::cell_container::live_cells(
+    size_t const first_row,
+    size_t const end_row) const
+{
+    return { this, first_row, end_row };
+}
+
+void tomway::cell_container::randomize(progress_fn const& progress)
 {
     std::random_device rd;
     std::mt19937 gen(rd());
     std::bernoulli_distribution dist(0.25f);
-    
-    for (auto & cell : _cells)
+    prepare_write();
+
+    for (size_t y = 0; y < _grid_size; y++)
     {
-        cell.set_alive(dist(gen));
+        for (size_t x = 0; x < _grid_size; x++)
+        {
+            set_alive_unchecked(x, y, dist(gen));
+        }
+
+        if (progress and y % 64 == 0) progress(static_cast<float>(y) / _grid_size);
+    }
+}
+
+void tomway::cell_container::prepare_write()
+{
+    if (_storage.use_count() == 1)
+    {
+        // Pairs with the release when the last other owner let go, so its reads finish before our writes start
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return;
     }
+
+    _detach();
 }
 
 void tomway::cell_container::set_alive(size_t x, size_t y, bool alive)
 {
-    _cells[y * _grid_size + x].set_alive(alive);
+    prepare_write();
+    set_alive_unchecked(x, y, alive);
+}
+
+void tomway::cell_container::set_alive_unchecked(size_t const x, size_t const y, bool const alive)
+{
+    word& w = _words[y * _words_per_row + x / WORD_BITS];
+    word const mask = word(1) << (x % WORD_BITS);
+    bool const was_alive = (w & mask) != 0;
+    if (was_alive == alive) return;
+
+    w ^= mask;
+    _row_population[y] += alive ? 1 : -1;
+}
+
+void tomway::cell_container::set_run(size_t const y, size_t const x, size_t const length, bool const alive)
+{
+    if (length == 0) return;
+
+    size_t const end = x + length;
+    size_t const first_word = x / WORD_BITS;
+    size_t const last_word = (end - 1) / WORD_BITS;
+
+    for (size_t word_index = first_word; word_index <= last_word; word_index++)
+    {
+        size_t const word_first_x = word_index * WORD_BITS;
+        size_t const first_bit = word_index == first_word ? x - word_first_x : 0;
+        size_t const end_bit = word_index == last_word ? end - word_first_x : WORD_BITS;
+        word const below_end = end_bit == WORD_BITS ? ~word(0) : (word(1) << end_bit) - 1;
+        word const mask = below_end & ~((word(1) << first_bit) - 1);
+        word const current = get_word(y, word_index);
+        set_word(y, word_index, alive ? current | mask : current & ~mask);
+    }
+}
+
+void tomway::cell_container::set_word(size_t const y, size_t const word_index, word const value)
+{
+    prepare_write();
+    word& w = _words[y * _words_per_row + word_index];
+    _row_population[y] += count_set_bits(value);
+    _row_population[y] -= count_set_bits(w);
+    w = value;
 }
 
 size_t tomway::cell_container::size() const
 {
-    return _cells.size();
+    return _grid_size * _grid_size;
 }
 
 size_t tomway::cell_container::grid_size() const
 {
     return _grid_size;
 }
+
+size_t tomway::cell_container::words_per_row() const
+{
+    return _words_per_row;
+}
+
+tomway::cell_container::word const* tomway::cell_container::words() const
+{
+    return _words;
+}
+
+void tomway::cell_container::_detach()
+{
+    _storage = std::make_shared<storage>(*_storage);
+    _row_population = _storage->row_population.data();
+    _words = _storage->words.data();
+}
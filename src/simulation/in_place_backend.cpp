@@ -0,0 +1,103 @@
+#include "simulation/in_place_backend.h"
+
+#include "Tracy.hpp"
+
+tomway::in_place_backend::in_place_backend()
+    : _cells(0)
+{
+}
+
+bool tomway::in_place_backend::get_alive(size_t const x, size_t const y) const
+{
+    return _cells.get_alive(x, y);
+}
+
+uint64_t tomway::in_place_backend::get_generation() const
+{
+    return _generation;
+}
+
+size_t tomway::in_place_backend::get_grid_size() const
+{
+    return _grid_size;
+}
+
+void tomway::in_place_backend::get_live_cells(live_cell_list& out) const
+{
+    ZoneScoped;
+    _cells.live_cells().append_to(out);
+}
+
+char const* tomway::in_place_backend::get_name() const
+{
+    return to_string(simulation_backend_type::IN_PLACE);
+}
+
+void tomway::in_place_backend::load(cell_container const& cells, uint64_t const generation)
+{
+    ZoneScoped;
+    _grid_size = cells.grid_size();
+    _generation = generation;
+    _cells = cells;
+    _curr_row.assign(_grid_size, 0);
+    _first_row.assign(_grid_size, 0);
+    _prev_row.assign(_grid_size, 0);
+}
+
+void tomway::in_place_backend::snapshot(cell_container& out) const
+{
+    ZoneScoped;
+    out = _cells;
+}
+
+void tomway::in_place_backend::step(live_cell_list* live_cells)
+{
+    ZoneScoped;
+    if (live_cells) live_cells->clear();
+    if (_grid_size == 0) return;
+
+    size_t const last = _grid_size - 1;
+    
+    // Row 0 is overwritten first but is the bottom row's lower neighbor, and the bottom row is row 0's upper
+    // neighbor. The bottom row is untouched until the very end, but saving it keeps the loop uniform.
+    _save_row(0, _first_row);
+    _save_row(last, _prev_row);
+    _cells.prepare_write();
+
+    for (size_t y = 0; y < _grid_size; y++)
+    {
+        _save_row(y, _curr_row);
+        size_t const yp1 = y == last ? 0 : y + 1;
+
+        for (size_t x = 0; x < _grid_size; x++)
+        {
+            size_t const xp1 = x == last ? 0 : x + 1;
+            size_t const xm1 = x == 0 ? last : x - 1;
+
+            // The row below is still the original generation in the board unless we wrapped around to row 0
+            int const below = y == last
+                ? _first_row[xm1] + _first_row[x] + _first_row[xp1]
+                : _cells.get_alive(xm1, yp1) + _cells.get_alive(x, yp1) + _cells.get_alive(xp1, yp1);
+            
+            int const neighbors_alive = _prev_row[xm1] + _prev_row[x] + _prev_row[xp1] // Upper Left, Up, Upper Right
+                + _curr_row[xm1] + _curr_row[xp1] // Left, Right
+                + below; // Lower Left, Down, Lower Right
+
+            bool const alive = (_curr_row[x] && neighbors_alive == 2) || neighbors_alive == 3;
+            _cells.set_alive_unchecked(x, y, alive);
+            if (live_cells and alive) live_cells->push_back({ static_cast<uint32_t>(x), static_cast<uint32_t>(y) });
+        }
+
+        _prev_row.swap(_curr_row);
+    }
+
+    _generation++;
+}
+
+void tomway::in_place_backend::_save_row(size_t const y, std::vector<uint8_t>& row) const
+{
+    for (size_t x = 0; x < _grid_size; x++)
+    {
+        row[x] = _cells.get_alive(x, y);
+    }
+}
@@ -0,0 +1,150 @@
+#include "simulation/lockstep_backend.h"
+
+#include <stdexcept>
+
+#include "SDL_log.h"
+#include "tomway_utility.h"
+#include "Tracy.hpp"
+
+tomway::lockstep_backend::lockstep_backend(
+    std::unique_ptr<simulation_backend> primary,
+    std::unique_ptr<simulation_backend> shadow)
+    : _primary(std::move(primary)),
+    _shadow(std::move(shadow))
+{
+    if (not _primary or not _shadow)
+    {
+        throw std::invalid_argument("Lockstep verification needs two backends!");
+    }
+    
+    LOG_INFO("Lockstep verification enabled: %s vs %s", _primary->get_name(), _shadow->get_name());
+}
+
+bool tomway::lockstep_backend::get_alive(size_t const x, size_t const y) const
+{
+    return _primary->get_alive(x, y);
+}
+
+uint64_t tomway::lockstep_backend::get_generation() const
+{
+    return _primary->get_generation();
+}
+
+size_t tomway::lockstep_backend::get_grid_size() const
+{
+    return _primary->get_grid_size();
+}
+
+void tomway::lockstep_backend::get_live_cells(live_cell_list& out) const
+{
+    _primary->get_live_cells(out);
+}
+
+char const* tomway::lockstep_backend::get_name() const
+{
+    return "lockstep";
+}
+
+void tomway::lockstep_backend::load(cell_container const& cells, uint64_t const generation)
+{
+    ZoneScoped;
+    _primary->load(cells, generation);
+    _shadow->load(cells, generation);
+    _diverged = false;
+    _divergence_generation = 0;
+    _verify();
+}
+
+void tomway::lockstep_backend::snapshot(cell_container& out) const
+{
+    _primary->snapshot(out);
+}
+
+void tomway::lockstep_backend::step(live_cell_list* live_cells)
+{
+    ZoneScoped;
+    _primary->step(live_cells);
+    _shadow->step(nullptr);
+    _verify();
+
+    // The fused live-cell list has to describe the same board the primary just produced
+    if (not _diverged and live_cells
+        and checksum(_primary->get_grid_size(), *live_cells) != _primary->checksum())
+    {
+        _diverged = true;
+        _divergence_generation = _primary->get_generation();
+        
+        LOG_ERROR(
+            "Lockstep divergence at generation %llu: %s emitted a live-cell list that doesn't match its board",
+            static_cast<unsigned long long>(_divergence_generation),
+            _primary->get_name());
+    }
+}
+
+bool tomway::lockstep_backend::has_diverged() const
+{
+    return _diverged;
+}
+
+uint64_t tomway::lockstep_backend::get_divergence_generation() const
+{
+    return _divergence_generation;
+}
+
+tomway::simulation_backend const& tomway::lockstep_backend::get_primary() const
+{
+    return *_primary;
+}
+
+tomway::simulation_backend const& tomway::lockstep_backend::get_shadow() const
+{
+    return *_shadow;
+}
+
+void tomway::lockstep_backend::_verify()
+{
+    ZoneScoped;
+    if (_diverged) return;
+
+    uint64_t const primary_checksum = _primary->checksum();
+    uint64_t const shadow_checksum = _shadow->checksum();
+    
+    if (primary_checksum == shadow_checksum and _primary->get_generation() == _shadow->get_generation()) return;
+
+    _diverged = true;
+    _divergence_generation = _primary->get_generation();
+    
+    LOG_ERROR(
+        "Lockstep divergence at generation %llu: %s checksum %016llx, %s checksum %016llx",
+        static_cast<unsigned long long>(_divergence_generation),
+        _primary->get_name(),
+        static_cast<unsigned long long>(primary_checksum),
+        _shadow->get_name(),
+        static_cast<unsigned long long>(shadow_checksum));
+
+    size_t const grid_size = _primary->get_grid_size();
+
+    if (grid_size != _shadow->get_grid_size())
+    {
+        LOG_ERROR("Lockstep backends disagree on grid size: %zu vs %zu", grid_size, _shadow->get_grid_size());
+        return;
+    }
+
+    for (size_t y = 0; y < grid_size; y++)
+    {
+        for (size_t x = 0; x < grid_size; x++)
+        {
+            bool const primary_alive = _primary->get_alive(x, y);
+            if (primary_alive == _shadow->get_alive(x, y)) continue;
+
+            LOG_ERROR(
+                "First differing cell: (%zu, %zu) is %s in %s",
+                x,
+                y,
+                primary_alive ? "alive" : "dead",
+                _primary->get_name());
+
+            return;
+        }
+    }
+}
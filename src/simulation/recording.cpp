@@ -0,0 +1,440 @@
+#include "simulation/recording.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "SDL_log.h"
+#include "tomway_utility.h"
+#include "Tracy.hpp"
+
+namespace
+{
+    char constexpr MAGIC[8] = { 'T', 'O', 'M', 'W', 'A', 'Y', 'R', 'C' };
+
+    void append_varint(std::vector<uint8_t>& out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    bool read_varint(uint8_t const*& cursor, uint8_t const* end, uint64_t& value)
+    {
+        value = 0;
+
+        for (unsigned shift = 0; shift < 64; shift += 7)
+        {
+            if (cursor == end) return false;
+            uint8_t const byte = *cursor++;
+            value |= uint64_t(byte & 0x7f) << shift;
+            if (not (byte & 0x80)) return true;
+        }
+
+        return false;
+    }
+
+    // Appends the board's words (XORed with previous when it isn't null) as alternating varint counts of zero words
+    // and literal words, followed by the literals themselves
+    void encode_words(tomway::cell_container const& cells, tomway::cell_container const* previous, std::vector<uint8_t>& out)
+    {
+        size_t const words_per_row = cells.words_per_row();
+        size_t const word_count = cells.grid_size() * words_per_row;
+        size_t index = 0;
+
+        auto const get = [&](size_t const i)
+        {
+            size_t const y = i / words_per_row;
+            size_t const w = i % words_per_row;
+            uint64_t const word = cells.get_word(y, w);
+            return previous ? word ^ previous->get_word(y, w) : word;
+        };
+
+        while (index < word_count)
+        {
+            size_t zeros = 0;
+            while (index + zeros < word_count and get(index + zeros) == 0) zeros++;
+            index += zeros;
+
+            size_t literals = 0;
+            while (index + literals < word_count and get(index + literals) != 0) literals++;
+
+            append_varint(out, zeros);
+            append_varint(out, literals);
+
+            // Changes tend to be a few bits in a word, so each literal is a mask of its non-zero bytes followed by
+            // just those bytes
+            for (size_t i = 0; i < literals; i++)
+            {
+                uint64_t const word = get(index + i);
+                size_t const mask_position = out.size();
+                uint8_t mask = 0;
+                out.push_back(0);
+
+                for (unsigned byte = 0; byte < sizeof(word); byte++)
+                {
+                    uint8_t const value = static_cast<uint8_t>(word >> byte * 8);
+                    if (value == 0) continue;
+                    mask |= 1 << byte;
+                    out.push_back(value);
+                }
+
+                out[mask_position] = mask;
+            }
+
+            index += literals;
+        }
+    }
+
+    // XORs the encoded words into cells, which is a plain copy when cells starts out empty. Without apply the payload
+    // is only checked, so a frame can be rejected before anything is changed. Bits past the end of a row are never
+    // written, so a payload that sets them is rejected too.
+    bool decode_words(uint8_t const* cursor, uint8_t const* end, tomway::cell_container& cells, bool const apply)
+    {
+        size_t const words_per_row = cells.words_per_row();
+        size_t const word_count = cells.grid_size() * words_per_row;
+        size_t const tail_bits = cells.grid_size() % tomway::cell_container::WORD_BITS;
+        uint64_t const padding_mask = tail_bits == 0 ? 0 : ~uint64_t(0) << tail_bits;
+        size_t index = 0;
+
+        while (cursor < end)
+        {
+            uint64_t zeros = 0;
+            uint64_t literals = 0;
+            if (not read_varint(cursor, end, zeros) or not read_varint(cursor, end, literals)) return false;
+            if (zeros > word_count - index or literals > word_count - index - zeros) return false;
+            index += zeros;
+
+            for (uint64_t i = 0; i < literals; i++, index++)
+            {
+                if (cursor == end) return false;
+                uint8_t const mask = *cursor++;
+                if (tomway::count_set_bits(mask) > static_cast<size_t>(end - cursor)) return false;
+                uint64_t word = 0;
+
+                for (unsigned byte = 0; byte < sizeof(word); byte++)
+                {
+                    if (mask & 1 << byte) word |= uint64_t(*cursor++) << byte * 8;
+                }
+
+                size_t const y = index / words_per_row;
+                size_t const w = index % words_per_row;
+                if (w + 1 == words_per_row and word & padding_mask) return false;
+                if (not apply) continue;
+                cells.set_word(y, w, cells.get_word(y, w) ^ word);
+            }
+        }
+
+        return true;
+    }
+}
+
+tomway::recording_writer::~recording_writer()
+{
+    close();
+}
+
+void tomway::recording_writer::close()
+{
+    if (not _thread.joinable()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+
+    _condition.notify_one();
+    _thread.join();
+    _file.close();
+    _stopping = false;
+
+    // The last frames can still be sitting in the stream's buffer until it's closed
+    if (_file.fail() and not _failed)
+    {
+        LOG_ERROR("Could not finish writing recording, the last generations may be missing.");
+        _failed = true;
+    }
+
+    LOG_INFO("Recording closed after %llu generations.", static_cast<unsigned long long>(_frames_written.load()));
+}
+
+uint64_t tomway::recording_writer::get_bytes_written() const
+{
+    return _bytes_written;
+}
+
+uint64_t tomway::recording_writer::get_frames_dropped() const
+{
+    return _frames_dropped;
+}
+
+uint64_t tomway::recording_writer::get_frames_written() const
+{
+    return _frames_written;
+}
+
+bool tomway::recording_writer::has_failed() const
+{
+    return _failed;
+}
+
+bool tomway::recording_writer::open(std::string const& path, size_t const grid_size)
+{
+    ZoneScoped;
+    close();
+    _file.open(path, std::ios::binary | std::ios::trunc);
+
+    if (not _file)
+    {
+        LOG_ERROR("Could not open recording: %s", path.c_str());
+        return false;
+    }
+
+    recording_header header = {};
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.keyframe_interval = KEYFRAME_INTERVAL;
+    header.grid_size = grid_size;
+    _file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+
+    if (not _file)
+    {
+        LOG_ERROR("Could not write recording header: %s", path.c_str());
+        _file.close();
+        return false;
+    }
+
+    _bytes_written = sizeof(header);
+    _failed = false;
+    _force_keyframe = true;
+    _frames_dropped = 0;
+    _frames_written = 0;
+    _grid_size = grid_size;
+    _pending.clear();
+    _previous = cell_container(0);
+    _thread = std::thread(&recording_writer::_run, this);
+    return true;
+}
+
+void tomway::recording_writer::push(cell_container&& cells, uint64_t const generation)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_failed) return;
+
+    if (_pending.size() >= MAX_PENDING_FRAMES)
+    {
+        if (_frames_dropped++ == 0) LOG_ERROR("Recording is falling behind, dropping generations.");
+        _force_keyframe = true;
+        return;
+    }
+
+    _pending.push_back({ std::move(cells), generation, _force_keyframe });
+    _force_keyframe = false;
+    _condition.notify_one();
+}
+
+void tomway::recording_writer::_run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (true)
+    {
+        _condition.wait(lock, [this] { return _stopping or not _pending.empty(); });
+        if (_pending.empty() or _failed) break;
+
+        pending_frame frame = std::move(_pending.front());
+        _pending.pop_front();
+        lock.unlock();
+        _write(frame);
+        lock.lock();
+    }
+}
+
+void tomway::recording_writer::_write(pending_frame& frame)
+{
+    ZoneScopedN("tomway::recording_writer::_write");
+
+    if (frame.cells.grid_size() != _grid_size)
+    {
+        LOG_ERROR("Recording grid size changed, dropping generation %llu.", static_cast<unsigned long long>(frame.generation));
+        return;
+    }
+
+    bool const keyframe = frame.keyframe
+        or _frames_written == 0
+        or frame.generation != _previous_generation + 1
+        or frame.generation - _last_keyframe_generation >= KEYFRAME_INTERVAL;
+
+    _payload.clear();
+    encode_words(frame.cells, keyframe ? nullptr : &_previous, _payload);
+
+    recording_frame_header header = {};
+    header.type = keyframe ? recording_frame_type::KEYFRAME : recording_frame_type::DELTA;
+    header.generation = frame.generation;
+    header.payload_size = _payload.size();
+    _file.write(reinterpret_cast<char const*>(&header), sizeof(header));
+    if (_file) _file.write(reinterpret_cast<char const*>(_payload.data()), static_cast<std::streamsize>(_payload.size()));
+
+    // A disk that's full or gone stays that way, so stop rather than count frames that never made it. Whatever was
+    // written before this frame is still a playable recording.
+    if (not _file)
+    {
+        LOG_ERROR("Could not write recording, stopping at generation %llu.", static_cast<unsigned long long>(frame.generation));
+        _failed = true;
+        return;
+    }
+
+    if (keyframe) _last_keyframe_generation = frame.generation;
+    _previous = std::move(frame.cells);
+    _previous_generation = frame.generation;
+    _bytes_written += sizeof(header) + _payload.size();
+    _frames_written++;
+}
+
+tomway::cell_container const& tomway::recording_reader::get_cells() const
+{
+    return _cells;
+}
+
+uint64_t tomway::recording_reader::get_first_generation() const
+{
+    return _frames.empty() ? 0 : _frames.front().generation;
+}
+
+uint64_t tomway::recording_reader::get_generation() const
+{
+    return _frames.empty() ? 0 : _frames[_current].generation;
+}
+
+uint64_t tomway::recording_reader::get_last_generation() const
+{
+    return _frames.empty() ? 0 : _frames.back().generation;
+}
+
+bool tomway::recording_reader::open(std::string const& path)
+{
+    ZoneScoped;
+    _frames.clear();
+    _current = 0;
+
+    if (not _file.open(path))
+    {
+        LOG_ERROR("Could not open recording: %s", path.c_str());
+        return false;
+    }
+
+    size_t const size = _file.get_size();
+    recording_header header = {};
+
+    if (size < sizeof(header))
+    {
+        LOG_ERROR("Malformed recording: file is smaller than the header.");
+        return false;
+    }
+
+    memcpy(&header, _file.get_data(), sizeof(header));
+
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 or header.grid_size > cell_container::MAX_GRID_SIZE)
+    {
+        LOG_ERROR("Malformed recording: bad header.");
+        return false;
+    }
+
+    if (header.version != recording_writer::VERSION)
+    {
+        LOG_ERROR("Unsupported recording version %u, expected %u.", header.version, recording_writer::VERSION);
+        return false;
+    }
+
+    // Index every frame up front. A recording that was cut off mid-frame plays up to the last whole frame.
+    uint64_t offset = sizeof(header);
+
+    while (size - offset >= sizeof(recording_frame_header))
+    {
+        recording_frame_header frame;
+        memcpy(&frame, _file.get_data() + offset, sizeof(frame));
+        offset += sizeof(frame);
+
+        bool const keyframe = frame.type == recording_frame_type::KEYFRAME;
+        bool const in_order = _frames.empty() or frame.generation > _frames.back().generation;
+
+        if (frame.payload_size > size - offset or not in_order or (_frames.empty() and not keyframe))
+        {
+            LOG_ERROR("Recording is damaged after %zu frames, playing what's there.", _frames.size());
+            break;
+        }
+
+        _frames.push_back({ frame.generation, offset, frame.payload_size, keyframe });
+        offset += frame.payload_size;
+    }
+
+    if (_frames.empty())
+    {
+        LOG_ERROR("Recording has no frames.");
+        return false;
+    }
+
+    _cells = cell_container(header.grid_size);
+
+    if (not _apply(0))
+    {
+        _frames.clear();
+        return false;
+    }
+
+    LOG_INFO("Opened recording %s with %zu frames.", path.c_str(), _frames.size());
+    return true;
+}
+
+void tomway::recording_reader::seek(uint64_t const generation)
+{
+    ZoneScoped;
+    auto const after = std::upper_bound(
+        _frames.begin(),
+        _frames.end(),
+        generation,
+        [](uint64_t const value, frame_entry const& frame) { return value < frame.generation; });
+
+    size_t const target = after == _frames.begin() ? 0 : after - _frames.begin() - 1;
+    if (target == _current) return;
+
+    size_t keyframe = target;
+    while (not _frames[keyframe].keyframe) keyframe--;
+
+    // Play forward from where we are if that doesn't cross a keyframe, otherwise start from the nearest one
+    size_t first = target > _current and keyframe <= _current ? _current + 1 : keyframe;
+
+    for (size_t i = first; i <= target; i++)
+    {
+        if (not _apply(i)) return;
+    }
+}
+
+bool tomway::recording_reader::step()
+{
+    if (_current + 1 >= _frames.size()) return false;
+    return _apply(_current + 1);
+}
+
+bool tomway::recording_reader::_apply(size_t const index)
+{
+    auto const& frame = _frames[index];
+    uint8_t const* payload = _file.get_data() + frame.offset;
+    uint8_t const* const end = payload + frame.payload_size;
+
+    // Check the whole frame before touching the board, so a bad frame leaves the board on the generation it was on
+    if (not decode_words(payload, end, _cells, false))
+    {
+        LOG_ERROR("Malformed recording frame for generation %llu.", static_cast<unsigned long long>(frame.generation));
+        return false;
+    }
+
+    if (frame.keyframe) _cells = cell_container(_cells.grid_size());
+    decode_words(payload, end, _cells, true);
+
+    _current = index;
+    return true;
+}
@@ -0,0 +1,97 @@
+#include "simulation/reference_backend.h"
+
+#include "Tracy.hpp"
+
+tomway::reference_backend::reference_backend()
+    : _cells{ cell_container(0), cell_container(0) }
+{
+}
+
+bool tomway::reference_backend::get_alive(size_t const x, size_t const y) const
+{
+    return _cells[_index].get_alive(x, y);
+}
+
+uint64_t tomway::reference_backend::get_generation() const
+{
+    return _generation;
+}
+
+size_t tomway::reference_backend::get_grid_size() const
+{
+    return _grid_size;
+}
+
+void tomway::reference_backend::get_live_cells(live_cell_list& out) const
+{
+    ZoneScoped;
+    _cells[_index].live_cells().append_to(out);
+}
+
+char const* tomway::reference_backend::get_name() const
+{
+    return to_string(simulation_backend_type::REFERENCE);
+}
+
+void tomway::reference_backend::load(cell_container const& cells, uint64_t const generation)
+{
+    ZoneScoped;
+    _grid_size = cells.grid_size();
+    _generation = generation;
+    _index = 0;
+    _cells[0] = cells;
+    _cells[1] = cell_container(_grid_size);
+}
+
+void tomway::reference_backend::snapshot(cell_container& out) const
+{
+    ZoneScoped;
+    out = _cells[_index];
+}
+
+void tomway::reference_backend::step(live_cell_list* live_cells)
+{
+    ZoneScoped;
+    unsigned int const new_index = (_index + 1) % 2;
+    if (live_cells) live_cells->clear();
+    // The next board may still be shared with a snapshot, take it back once here rather than on every cell
+    _cells[new_index].prepare_write();
+    
+    for (size_t y = 0; y < _grid_size; y++)
+    {
+        size_t const yp1 = wrap(y + 1);
+        size_t const ym1 = wrap(y - 1);
+        
+        for (size_t x = 0; x < _grid_size; x++)
+        {
+            size_t const xp1 = wrap(x + 1);
+            size_t const xm1 = wrap(x - 1);
+
+            int const neighbors_alive = _cells[_index].get_alive(xm1, y) // Left
+                 + _cells[_index].get_alive(xm1, ym1) // Upper Left
+                 + _cells[_index].get_alive(x, ym1) // Up
+                 + _cells[_index].get_alive(xp1, ym1) // Upper Right
+                 + _cells[_index].get_alive(xp1, y) // Right
+                 + _cells[_index].get_alive(xp1, yp1) // Lower Right
+                 + _cells[_index].get_alive(x, yp1) // Down
+                 + _cells[_index].get_alive(xm1, yp1); // Lower Left
+
+            bool const alive = (_cells[_index].get_alive(x, y) && neighbors_alive == 2) || neighbors_alive == 3;
+            _cells[new_index].set_alive_unchecked(x, y, alive);
+            if (live_cells and alive) live_cells->push_back({ static_cast<uint32_t>(x), static_cast<uint32_t>(y) });
+        }
+    }
+
+    _index = new_index;
+    _generation++;
+}
+
+inline size_t tomway::reference_backend::wrap(long long int val) const
+{
+    if (val < 0)
+    {
+        return _grid_size - 1;
+    }
+    
+    return static_cast<size_t>(val) > _grid_size - 1 ? 0 : val;
+}
@@ -0,0 +1,91 @@
+#include "simulation/simulation_backend.h"
+
+#include <stdexcept>
+
+#include "simulation/in_place_backend.h"
+#include "simulation/lockstep_backend.h"
+#include "simulation/reference_backend.h"
+#include "Tracy.hpp"
+
+namespace
+{
+    // splitmix64 finalizer, spreads coordinate bits before they are folded into the running hash
+    inline uint64_t mix(uint64_t value)
+    {
+        value ^= value >> 30;
+        value *= 0xbf58476d1ce4e5b9ull;
+        value ^= value >> 27;
+        value *= 0x94d049bb133111ebull;
+        value ^= value >> 31;
+        return value;
+    }
+}
+
+uint64_t tomway::simulation_backend::checksum() const
+{
+    ZoneScoped;
+    live_cell_list live_cells;
+    get_live_cells(live_cells);
+    return checksum(get_grid_size(), live_cells);
+}
+
+uint64_t tomway::simulation_backend::checksum(size_t const grid_size, live_cell_list const& live_cells)
+{
+    uint64_t hash = 14695981039346656037ull; // FNV offset basis
+    hash = (hash ^ mix(grid_size)) * 1099511628211ull;
+
+    for (auto const& cell : live_cells)
+    {
+        hash = (hash ^ mix(static_cast<uint64_t>(cell.y) << 32 | cell.x)) * 1099511628211ull;
+    }
+
+    return hash;
+}
+
+char const* tomway::to_string(simulation_backend_type const type)
+{
+    switch (type)
+    {
+    case simulation_backend_type::REFERENCE:
+        return "reference";
+    case simulation_backend_type::IN_PLACE:
+        return "in_place";
+    default:
+        return "unknown";
+    }
+}
+
+bool tomway::to_simulation_backend_type(std::string const& name, simulation_backend_type& type)
+{
+    for (auto const candidate : { simulation_backend_type::REFERENCE, simulation_backend_type::IN_PLACE })
+    {
+        if (name == to_string(candidate))
+        {
+            type = candidate;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::unique_ptr<tomway::simulation_backend> tomway::make_simulation_backend(simulation_backend_type const type)
+{
+    switch (type)
+    {
+    case simulation_backend_type::REFERENCE:
+        return std::make_unique<reference_backend>();
+    case simulation_backend_type::IN_PLACE:
+        return std::make_unique<in_place_backend>();
+    default:
+        throw std::invalid_argument("Unknown simulation backend type!");
+    }
+}
+
+std::unique_ptr<tomway::simulation_backend> tomway::make_simulation_backend(simulation_backend_config const& config)
+{
+    auto backend = make_simulation_backend(config.backend);
+    if (not config.lockstep_verify) return backend;
+
+    return std::make_unique<lockstep_backend>(std::move(backend), make_simulation_backend(config.verify_backend));
+}
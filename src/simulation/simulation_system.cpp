@@ -1,166 +1,403 @@
 #include "simulation/simulation_system.h"
+
+#include <algorithm>
+
 #include "tomway_utility.h"
 #include "Tracy.hpp"
 #include "ui_system.h"
-#include "rapidjson/document.h"
-#include "rapidjson/prettywriter.h"
-#include "rapidjson/stringbuffer.h"
+#include "simulation/board_file.h"
+#include "simulation/board_json.h"
+#include "simulation/board_rle.h"
+#include "simulation/lockstep_backend.h"
+
+namespace
+{
+    bool has_extension(std::string const& path, std::string const& extension)
+    {
+        return path.size() >= extension.size()
+            and path.compare(path.size() - extension.size(), extension.size(), extension) == 0;
+    }
+}
 
 tomway::simulation_system::simulation_system()
-    : _grid_size(0),
-    _cells{ cell_container(0), cell_container(0) }
+    : _backend(make_simulation_backend(_backend_config))
 {
+    _backend->load(cell_container(0), 0);
 }
 
-bool tomway::simulation_system::deserialize(std::string const& json)
+void tomway::simulation_system::close_replay()
 {
-    ZoneScoped;
-    rapidjson::Document document;
-    document.Parse(json.c_str());
+    if (not _replay) return;
+    _replay.reset();
+    LOG_INFO("Replay closed.");
+}
+
+tomway::simulation_backend const* tomway::simulation_system::get_backend() const
+{
+    return _backend.get();
+}
+
+tomway::simulation_backend_config const& tomway::simulation_system::get_backend_config() const
+{
+    return _backend_config;
+}
+
+size_t tomway::simulation_system::get_cell_count() const
+{
+    return _backend->get_grid_size() * _backend->get_grid_size();
+}
+
+float tomway::simulation_system::get_job_progress() const
+{
+    return _job.get_progress();
+}
 
-    if (not document.HasMember("cells") or not document["cells"].IsArray())
+tomway::board_job_type tomway::simulation_system::get_job_type() const
+{
+    return _job_type;
+}
+
+tomway::live_cell_list const& tomway::simulation_system::get_live_cells() const
+{
+    if (not _live_cells_valid)
     {
-        LOG_ERROR("Malformed save file: document[\"cells\"] not present or not array.");
-        return false;
+        ZoneScopedN("tomway::simulation_system::get_live_cells | Board scan");
+        _live_cells.clear();
+        _backend->get_live_cells(_live_cells);
+        _live_cells_valid = true;
     }
-    
-    auto const& json_data = document["cells"].GetArray();
 
-    if (not document.HasMember("grid_size") or not document["grid_size"].IsUint64())
+    return _live_cells;
+}
+
+tomway::replay_status tomway::simulation_system::get_replay_status() const
+{
+    if (not _replay) return {};
+    return { true, _replay->get_first_generation(), _replay->get_last_generation(), _replay->get_generation() };
+}
+
+bool tomway::simulation_system::is_recording() const
+{
+    return _recorder != nullptr;
+}
+
+bool tomway::simulation_system::is_replaying() const
+{
+    return _replay != nullptr;
+}
+
+bool tomway::simulation_system::load_file(std::string const& path, size_t const min_grid_size)
+{
+    ZoneScoped;
+    cell_container cells(0);
+    uint64_t generation = 0;
+    if (not _read_board(path, min_grid_size, cells, generation, nullptr)) return false;
+
+    _apply_loaded(cells, generation);
+    return true;
+}
+
+bool tomway::simulation_system::load_file_async(std::string const& path, size_t const min_grid_size)
+{
+    return _start_job(board_job_type::LOAD, [this, path, min_grid_size](progress_fn const& progress)
     {
-        LOG_ERROR("Malformed save file: document[\"grid_size\"] not present or not uint64.");
-        return false;
-    }
-    
-    auto grid_size = document["grid_size"].GetUint64();
+        return _read_board(path, min_grid_size, _job_cells, _job_generation, progress);
+    });
+}
+
+void tomway::simulation_system::new_frame()
+{
+    size_t const grid_size = _backend->get_grid_size();
 
-    if (json_data.Size() > grid_size * grid_size)
+    if (grid_size > 0)
     {
-        LOG_ERROR("Malformed save file: grid_size * grid_size is less than cell count.");
-        return false;
+        auto grid_string = string_format("Grid size: %zu x %zu", grid_size, grid_size);
+        ui_system::add_debug_text(grid_string);
     }
 
-    // Validation pass
-    for (rapidjson::SizeType i = 0; i < json_data.Size(); i++)
+    ui_system::add_debug_text(string_format("Simulation backend: %s", _backend->get_name()));
+
+    if (_backend_config.lockstep_verify)
     {
-        if (not json_data[i].IsArray())
+        auto const lockstep = static_cast<lockstep_backend const*>(_backend.get());
+
+        if (lockstep->has_diverged())
         {
-            LOG_ERROR("Cell at position %d is not an array.", i);
-            return false;
+            ui_system::add_debug_text(string_format(
+                "Lockstep %s vs %s: DIVERGED at generation %llu",
+                lockstep->get_primary().get_name(),
+                lockstep->get_shadow().get_name(),
+                static_cast<unsigned long long>(lockstep->get_divergence_generation())));
         }
-        
-        auto const& json_cell = json_data[i].GetArray();
-        
-        if (json_cell.Size() != 2 or not json_cell[0].IsUint64() or not json_cell[1].IsUint64())
+        else
         {
-            LOG_ERROR("Cell at position %d does not have two uint64 members.", i);
-            return false;
+            ui_system::add_debug_text(string_format(
+                "Lockstep %s vs %s: bit-exact through generation %llu",
+                lockstep->get_primary().get_name(),
+                lockstep->get_shadow().get_name(),
+                static_cast<unsigned long long>(lockstep->get_generation())));
         }
-        
     }
-    
-    _grid_size = grid_size;
-    _index = 0;
-    _cells[0] = { _grid_size };
-    _cells[1] = { _grid_size };
-    
-    for (rapidjson::SizeType i = 0; i < json_data.Size(); i++)
+
+    if (_recorder)
     {
-        auto const& json_cell = json_data[i].GetArray();
-        _cells[0].set_alive(json_cell[0].GetUint64(), json_cell[1].GetUint64(), true);
+        ui_system::add_debug_text(string_format(
+            "Recording: %llu generations, %.2f MB, %llu dropped",
+            static_cast<unsigned long long>(_recorder->get_frames_written()),
+            _recorder->get_bytes_written() / (1024.0 * 1024.0),
+            static_cast<unsigned long long>(_recorder->get_frames_dropped())));
     }
 
+    if (_replay)
+    {
+        ui_system::add_debug_text(string_format(
+            "Replay: generation %llu of %llu",
+            static_cast<unsigned long long>(_replay->get_generation()),
+            static_cast<unsigned long long>(_replay->get_last_generation())));
+    }
+
+    if (_job_type == board_job_type::SAVE)
+    {
+        ui_system::add_debug_text(string_format("Saving... %.0f%%", _job.get_progress() * 100.0f));
+    }
+}
+
+bool tomway::simulation_system::open_replay(std::string const& path)
+{
+    ZoneScoped;
+    stop_recording();
+    auto replay = std::make_unique<recording_reader>();
+    if (not replay->open(path)) return false;
+
+    _replay = std::move(replay);
+    _load_replay_frame();
     return true;
 }
 
-size_t tomway::simulation_system::get_cell_count() const
+bool tomway::simulation_system::paste_file(std::string const& path, size_t const center_x, size_t const center_y)
 {
-    return _cells[_index].size();
+    ZoneScoped;
+
+    if (_replay)
+    {
+        LOG_ERROR("Can't paste into a replay.");
+        return false;
+    }
+
+    rle_pattern pattern;
+    if (not pattern.read(path)) return false;
+
+    cell_container cells(0);
+    _backend->snapshot(cells);
+    size_t const grid_size = cells.grid_size();
+    // Unsigned wrap around keeps the corner on the board when the pattern hangs off the top or left edge
+    size_t const x = grid_size == 0 ? 0 : (center_x + grid_size - pattern.get_width() / 2 % grid_size) % grid_size;
+    size_t const y = grid_size == 0 ? 0 : (center_y + grid_size - pattern.get_height() / 2 % grid_size) % grid_size;
+    if (not pattern.paste(cells, x, y)) return false;
+
+    _backend->load(cells, _backend->get_generation());
+    _live_cells_valid = false;
+    LOG_INFO("Pasted %zu cells from %s.", pattern.get_population(), path.c_str());
+    return true;
 }
 
-tomway::cell_container const* tomway::simulation_system::get_current_cells() const
+bool tomway::simulation_system::save_file(std::string const& path) const
 {
     ZoneScoped;
-    return &_cells[_index];
+    if (has_extension(path, ".json")) return write_board_json(path, _backend->get_grid_size(), get_live_cells());
+
+    cell_container cells(0);
+    _backend->snapshot(cells);
+    return _write_board(path, cells, _backend->get_generation(), nullptr);
 }
 
-void tomway::simulation_system::new_frame()
+bool tomway::simulation_system::save_file_async(std::string const& path)
 {
-    if (_grid_size > 0)
+    ZoneScoped;
+    // Shares the backend's storage, the first step after this gives the backend a copy of its own to write
+    cell_container cells(0);
+    _backend->snapshot(cells);
+    uint64_t const generation = _backend->get_generation();
+
+    return _start_job(board_job_type::SAVE, [path, cells, generation](progress_fn const& progress)
     {
-        auto grid_string = string_format("Grid size: %zu x %zu", _grid_size, _grid_size);
-        ui_system::add_debug_text(grid_string);
-    }
+        return _write_board(path, cells, generation, progress);
+    });
+}
+
+void tomway::simulation_system::seek_replay(uint64_t const generation)
+{
+    if (not _replay) return;
+    _replay->seek(generation);
+    _load_replay_frame();
 }
 
-std::string tomway::simulation_system::serialize() const
+void tomway::simulation_system::set_backend(simulation_backend_config const& config)
 {
     ZoneScoped;
-    rapidjson::Document document;
-    rapidjson::Value cell_array;
-    cell_array.SetArray();
-    
-    for (auto const& cell : _cells[_index])
-    {
-        cell.serialize(document, cell_array);
-    }
+    cell_container cells(0);
+    _backend->snapshot(cells);
+    uint64_t const generation = _backend->get_generation();
 
-    document.SetObject();
-    document.AddMember("cells", cell_array, document.GetAllocator());
-    document.AddMember("grid_size", _grid_size, document.GetAllocator());
-    rapidjson::StringBuffer sb;
-    rapidjson::Writer<rapidjson::StringBuffer> writer(sb);
-    document.Accept(writer);    // Accept() traverses the DOM and generates Handler events.
-    return sb.GetString();
+    _backend_config = config;
+    _backend = make_simulation_backend(_backend_config);
+    _backend->load(cells, generation);
+    _live_cells_valid = false;
+    LOG_INFO("Simulation backend set to %s.", _backend->get_name());
 }
 
 void tomway::simulation_system::start(size_t const grid_size)
 {
     ZoneScoped;
-    _grid_size = grid_size;
-    _cells[0] = { _grid_size };
-    _cells[0].randomize();
-    _cells[1] = { _grid_size };
-    _cells[1].randomize();
+    stop_recording();
+    close_replay();
+    cell_container cells(grid_size);
+    cells.randomize();
+    _backend->load(cells, 0);
+    _live_cells_valid = false;
+}
+
+bool tomway::simulation_system::start_async(size_t const grid_size)
+{
+    return _start_job(board_job_type::LOAD, [this, grid_size](progress_fn const& progress)
+    {
+        _job_cells = cell_container(grid_size);
+        _job_cells.randomize(progress);
+        _job_generation = 0;
+        return true;
+    });
+}
+
+bool tomway::simulation_system::start_recording(std::string const& path)
+{
+    ZoneScoped;
+    close_replay();
+    auto recorder = std::make_unique<recording_writer>();
+    if (not recorder->open(path, _backend->get_grid_size())) return false;
+
+    _recorder = std::move(recorder);
+    cell_container cells(0);
+    _backend->snapshot(cells);
+    _recorder->push(std::move(cells), _backend->get_generation());
+    LOG_INFO("Recording to %s.", path.c_str());
+    return true;
+}
+
+bool tomway::simulation_system::step_replay()
+{
+    ZoneScoped;
+    if (not _replay or not _replay->step()) return false;
+    _load_replay_frame();
+    return true;
 }
 
 void tomway::simulation_system::step_simulation()
 {
     ZoneScoped;
-    unsigned int const new_index = (_index + 1) % 2;
-    
-    for (cell& cell : _cells[_index])
+    _backend->step(&_live_cells);
+    _live_cells_valid = true;
+    if (_recorder and _recorder->has_failed()) stop_recording();
+
+    if (_recorder)
+    {
+        // Only the snapshot happens here, the recording thread does the encoding and the writing
+        cell_container cells(0);
+        _backend->snapshot(cells);
+        _recorder->push(std::move(cells), _backend->get_generation());
+    }
+}
+
+void tomway::simulation_system::stop_recording()
+{
+    if (not _recorder) return;
+    _recorder->close();
+    _recorder.reset();
+}
+
+bool tomway::simulation_system::update_job(bool& success)
+{
+    if (_job_type == board_job_type::NONE or not _job.is_done()) return false;
+
+    ZoneScoped;
+    success = _job.finish();
+    if (_job_type == board_job_type::LOAD and success) _apply_loaded(_job_cells, _job_generation);
+
+    _job_cells = cell_container(0);
+    _job_type = board_job_type::NONE;
+    return true;
+}
+
+void tomway::simulation_system::_apply_loaded(cell_container const& cells, uint64_t const generation)
+{
+    stop_recording();
+    close_replay();
+    _backend->load(cells, generation);
+    _live_cells_valid = false;
+}
+
+void tomway::simulation_system::_load_replay_frame()
+{
+    _backend->load(_replay->get_cells(), _replay->get_generation());
+    _live_cells_valid = false;
+}
+
+bool tomway::simulation_system::_read_board(
+    std::string const& path,
+    size_t const min_grid_size,
+    cell_container& cells,
+    uint64_t& generation,
+    progress_fn const& progress)
+{
+    generation = 0;
+
+    if (has_extension(path, ".rle"))
     {
-        size_t const x = cell.get_x();
-        size_t const y = cell.get_y();
-        
-        size_t const xp1 = wrap(x + 1);
-        size_t const xm1 = wrap(x - 1);
-        size_t const yp1 = wrap(y + 1);
-        size_t const ym1 = wrap(y - 1);
-
-        int const neighbors_alive = _cells[_index].get_alive(xm1, y) // Left
-             + _cells[_index].get_alive(xm1, ym1) // Upper Left
-             + _cells[_index].get_alive(x, ym1) // Up
-             + _cells[_index].get_alive(xp1, ym1) // Upper Right
-             + _cells[_index].get_alive(xp1, y) // Right
-             + _cells[_index].get_alive(xp1, yp1) // Lower Right
-             + _cells[_index].get_alive(x, yp1) // Down
-             + _cells[_index].get_alive(xm1, yp1); // Lower Left
-
-        bool const alive = (cell.get_alive() && neighbors_alive == 2) || neighbors_alive == 3;
-        _cells[new_index].set_alive(x, y, alive);
+        rle_pattern pattern;
+        if (not pattern.read(path, progress)) return false;
+
+        size_t const grid_size = std::max({ min_grid_size, pattern.get_width(), pattern.get_height() });
+        cells = cell_container(grid_size);
+        pattern.paste(cells, (grid_size - pattern.get_width()) / 2, (grid_size - pattern.get_height()) / 2);
+        return true;
     }
 
-    _index = new_index;
+    if (board_file::is_board_file(path))
+    {
+        board_file file;
+        if (not file.open(path)) return false;
+        file.read(cells, progress);
+        generation = file.get_header().generation;
+        return true;
+    }
+
+    return read_board_json(path, cells, progress);
 }
 
-inline size_t tomway::simulation_system::wrap(long long int val) const
+bool tomway::simulation_system::_start_job(board_job_type const type, background_job::work_fn work)
 {
-    if (val < 0)
+    if (_job_type != board_job_type::NONE)
     {
-        return _grid_size - 1;
+        LOG_ERROR("Can't start a %s while a %s is still running.",
+            type == board_job_type::LOAD ? "load" : "save",
+            _job_type == board_job_type::LOAD ? "load" : "save");
+        return false;
     }
-    
-    return static_cast<size_t>(val) > _grid_size - 1 ? 0 : val;
+
+    _job_type = type;
+    _job.start(std::move(work));
+    return true;
+}
+
+bool tomway::simulation_system::_write_board(
+    std::string const& path,
+    cell_container const& cells,
+    uint64_t const generation,
+    progress_fn const& progress)
+{
+    if (has_extension(path, ".rle")) return write_board_rle(path, cells, progress);
+    if (not has_extension(path, ".json")) return board_file::write(path, cells, generation, progress);
+
+    live_cell_list live_cells;
+    cells.live_cells().append_to(live_cells);
+    return write_board_json(path, cells.grid_size(), live_cells, progress);
 }
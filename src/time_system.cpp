@@ -1,7 +1,13 @@
 #include "time_system.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
 #include "tomway_utility.h"
 
 #include "imgui.h"
+#include "Tracy.hpp"
 #include "ui_system.h"
 
 tomway::time_system::time_system(float ticks_per_sec)
@@ -16,6 +22,46 @@ bool tomway::time_system::get_new_tick() const
     return _new_tick;
 }
 
+float tomway::time_system::get_time_to_next_tick() const
+{
+    return std::max(1.0f / _ticks_per_sec - _tick_timer, 0.0f);
+}
+
+void tomway::time_system::limit_frame_rate()
+{
+    ZoneScoped;
+    if (_max_fps <= 0) return;
+
+    using clock = std::chrono::high_resolution_clock;
+    auto const deadline = _last_frame_start_time + std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(1.0 / _max_fps));
+
+    while (true)
+    {
+        auto const now = clock::now();
+        if (now >= deadline) return;
+        double const remaining = std::chrono::duration<double>(deadline - now).count();
+
+        // Spin once the next sleep could overshoot
+        if (remaining <= _sleep_estimate) continue;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        double const slept = std::chrono::duration<double>(clock::now() - now).count();
+
+        // Welford's running mean and variance
+        _sleep_count++;
+        double const delta = slept - _sleep_mean;
+        _sleep_mean += delta / _sleep_count;
+        _sleep_m2 += delta * (slept - _sleep_mean);
+        _sleep_estimate = _sleep_mean + std::sqrt(_sleep_m2 / (_sleep_count - 1));
+    }
+}
+
+void tomway::time_system::mark_idle()
+{
+    _idle = true;
+}
+
 float tomway::time_system::new_frame()
 {
     auto const new_frame_time = std::chrono::high_resolution_clock::now();
@@ -42,5 +88,19 @@ float tomway::time_system::new_frame()
 
     auto const fps_string = string_format("FPS: %zu", _fps);
     ui_system::add_debug_text(fps_string);
+
+    // Coming out of an idle wait the delta is however long the wait was. Moving the camera by all of it would make
+    // it jump, so the first frame back counts as one frame at the cap.
+    if (_idle)
+    {
+        _idle = false;
+        return std::min(delta, 1.0f / (_max_fps > 0 ? _max_fps : 60.0f));
+    }
+
     return delta;
 }
+
+void tomway::time_system::set_max_fps(float const max_fps)
+{
+    _max_fps = max_fps;
+}
@@ -61,6 +61,13 @@ void tomway::ui_system::bind_menu_callbacks(
     _inst->_menu_exit_callback = menu_exit_callback;
 }
 
+void tomway::ui_system::bind_replay_callbacks(get_replay_status_fn const& get_status_fn, seek_replay_fn const& seek_fn)
+{
+    check_system_ready();
+    _inst->_replay_status_get_fn = get_status_fn;
+    _inst->_replay_seek_fn = seek_fn;
+}
+
 void tomway::ui_system::bind_sim_config(get_sim_config_fn const get_config_fn, set_sim_config_fn const set_config_fn)
 {
     check_system_ready();
@@ -92,9 +99,16 @@ bool tomway::ui_system::is_menu_open()
     return _inst->_menu_state != menu_state::sim;
 }
 
+void tomway::ui_system::set_loading_progress(float const progress)
+{
+    check_system_ready();
+    _inst->_loading_progress = progress;
+}
+
 void tomway::ui_system::show_loading_screen()
 {
     check_system_ready();
+    _inst->_loading_progress = 0.0f;
     _inst->_loading_screen = true;
     LOG_INFO("Show Loading Screen");
 }
@@ -144,14 +158,19 @@ void tomway::ui_system::_draw_loading()
     ImGui::PushStyleColor(ImGuiCol_WindowBg, ImVec4(0.0f, 0.0f, 0.0f, 0.0f));
     ImGui::Begin("Loading", nullptr, window_flags);
     ImGui::PopStyleColor();
-    auto text_size = ImGui::CalcTextSize("Loading...");
+    auto const text = string_format("Loading... %.0f%%", _loading_progress * 100.0f);
+    auto text_size = ImGui::CalcTextSize(text.c_str());
     
     auto cursor_pos = ImVec2(
         (display_size.x - text_size.x) / 2,
         (display_size.y - text_size.y) / 2);
     
     ImGui::SetCursorPos(cursor_pos);
-    ImGui::Text("Loading...");
+    ImGui::Text("%s", text.c_str());
+
+    float constexpr bar_width = 300.0f;
+    ImGui::SetCursorPosX((display_size.x - bar_width) / 2);
+    ImGui::ProgressBar(_loading_progress, ImVec2(bar_width, 0.0f), "");
     ImGui::End();
 }
 
@@ -167,6 +186,10 @@ void tomway::ui_system::build_ui()
     {
         _draw_menu();
     }
+    else
+    {
+        _draw_replay();
+    }
 }
 
 // Do not make me static, this should only be called through the instance itself
@@ -258,3 +281,36 @@ void tomway::ui_system::_draw_main_menu()
 
     ImGui::End();
 }
+
+void tomway::ui_system::_draw_replay()
+{
+    if (not _replay_status_get_fn) return;
+    auto const status = _replay_status_get_fn();
+    if (not status.active) return;
+
+    ImGuiWindowFlags constexpr window_flags =
+        ImGuiWindowFlags_NoDecoration
+        | ImGuiWindowFlags_NoDocking
+        | ImGuiWindowFlags_AlwaysAutoResize
+        | ImGuiWindowFlags_NoSavedSettings
+        | ImGuiWindowFlags_NoFocusOnAppearing
+        | ImGuiWindowFlags_NoNav;
+
+    auto const viewport = ImGui::GetMainViewport();
+    ImGui::SetNextWindowPos(
+        ImVec2(viewport->GetCenter().x, viewport->WorkPos.y + viewport->WorkSize.y - 20.0f),
+        ImGuiCond_Always,
+        ImVec2(0.5f, 1.0f));
+
+    ImGui::Begin("Replay", nullptr, window_flags);
+    uint64_t generation = status.generation;
+    ImGui::SetNextItemWidth(600.0f);
+
+    if (ImGui::SliderScalar("Generation", ImGuiDataType_U64, &generation, &status.first_generation, &status.last_generation))
+    {
+        if (_replay_seek_fn) _replay_seek_fn(generation);
+    }
+
+    ImGui::Text("L: play/pause    Space: step    R: exit replay");
+    ImGui::End();
+}
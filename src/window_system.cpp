@@ -173,6 +173,11 @@ void tomway::window_system::toggle_mouse_visible()
 	set_mouse_visible(!_mouse_visible);
 }
 
+bool tomway::window_system::wait_for_events(int const timeout_ms) {
+	ZoneScoped;
+	return SDL_WaitEventTimeout(nullptr, timeout_ms) != 0;
+}
+
 void tomway::window_system::wait_while_minimized() {
 	auto flags = SDL_GetWindowFlags(_window);
 	
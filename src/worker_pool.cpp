@@ -0,0 +1,93 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+
+tomway::worker_pool::worker_pool()
+{
+    size_t const thread_count = std::max<size_t>(std::thread::hardware_concurrency(), 1) - 1;
+    _threads.reserve(thread_count);
+
+    for (size_t i = 0; i < thread_count; i++)
+    {
+        _threads.emplace_back(&worker_pool::_work, this);
+    }
+}
+
+tomway::worker_pool::~worker_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+
+    _work_condition.notify_all();
+
+    for (auto& thread : _threads)
+    {
+        thread.join();
+    }
+}
+
+size_t tomway::worker_pool::get_concurrency() const
+{
+    return _threads.size() + 1;
+}
+
+void tomway::worker_pool::run(size_t const part_count, part_fn const& work)
+{
+    if (part_count == 0) return;
+
+    if (part_count == 1 or _threads.empty())
+    {
+        for (size_t part = 0; part < part_count; part++)
+        {
+            work(part);
+        }
+
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _work_fn = &work;
+        _part_count = part_count;
+        _next_part.store(0, std::memory_order_relaxed);
+        _active = _threads.size();
+        _batch++;
+    }
+
+    _work_condition.notify_all();
+    _run_parts();
+
+    // Every worker has to check in, even the ones that found nothing left, before work can go out of scope
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done_condition.wait(lock, [this] { return _active == 0; });
+    _work_fn = nullptr;
+}
+
+void tomway::worker_pool::_run_parts()
+{
+    for (size_t part = _next_part++; part < _part_count; part = _next_part++)
+    {
+        (*_work_fn)(part);
+    }
+}
+
+void tomway::worker_pool::_work()
+{
+    uint64_t batch = 0;
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (true)
+    {
+        _work_condition.wait(lock, [this, batch] { return _stopping or _batch != batch; });
+        if (_stopping) return;
+
+        batch = _batch;
+        lock.unlock();
+        _run_parts();
+        lock.lock();
+
+        if (--_active == 0) _done_condition.notify_one();
+    }
+}